@@ -0,0 +1,484 @@
+/*
+ * Host replay harness for the IMU power pipeline.
+ *
+ * Feeds a recorded session (GET /record, see imu_recorder.h) or a synthetic
+ * one through the firmware's stroke_detector / imu_block / imu_power sources
+ * and reports each detected stroke plus overall throughput. Built twice by
+ * host/CMakeLists.txt: replay (float) and replay_fixed
+ * (IMU_POWER_FIXED_POINT=1). With --expect the exit status says whether the
+ * stroke count and mean power match, for ctest; --dump and --compare check
+ * one build's strokes against another's, stroke by stroke.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "imu_block.h"
+#include "imu_power.h"
+#include "imu_recorder.h"
+#include "stroke_detector.h"
+
+#define DEFAULT_BLOCK 10 /* Burst at the default FIFO ODR (imu_sensor_burst_samples) */
+#define MAX_EVENTS 4
+/* Share of the synthetic stroke spent in the drive. The drive must outlast
+ * STROKE_MIN_DURATION_US, and the recovery deceleration that cancels it must
+ * stay under the recovery threshold: at the default 40 spm and 1.5 g that
+ * is a 450 ms drive and 0.41 g of deceleration. */
+#define SYNTH_DRIVE_FRACTION 0.3
+
+typedef struct {
+  imu_record_header_t hdr;
+  imu_record_t* rec;
+  int64_t* ts_us; /* Unwrapped timestamps */
+  int count;
+} session_t;
+
+typedef struct {
+  const char* path;
+  float synthetic_s;
+  float synth_spm;
+  float synth_peak_g;
+  bool per_sample;
+  int block;
+  float catch_g, recovery_g, mass_kg; /* <= 0: use header value */
+  bool adaptive;
+  int repeat;
+  bool quiet;
+  bool curve; /* Print each stroke's power curve (block path) */
+  float speed_ms; /* > 0: feed a constant 1 Hz speed fix (block path) */
+  int expect_strokes; /* >= 0 with --expect */
+  float expect_power_w;
+  float tolerance_pct;
+  const char* dump_path;    /* Write each stroke's power, one per line */
+  const char* compare_path; /* Check each stroke's power against such a file */
+} options_t;
+
+typedef struct {
+  int strokes;
+  double power_sum_w;
+  double ns_per_sample;
+  float* stroke_power_w; /* strokes entries */
+  int stroke_cap;
+} result_t;
+
+static void add_stroke(result_t* r, float power_w) {
+  if (r->strokes == r->stroke_cap) {
+    r->stroke_cap = r->stroke_cap ? 2 * r->stroke_cap : 256;
+    r->stroke_power_w = realloc(r->stroke_power_w, sizeof(float) * r->stroke_cap);
+  }
+  r->stroke_power_w[r->strokes++] = power_w;
+  r->power_sum_w += power_w;
+}
+
+/* ---- session input ---- */
+
+static void unwrap_timestamps(session_t* s) {
+  if (s->count == 0)
+    return;
+  /* A FIFO burst can predate start_us by a few ms: signed difference */
+  int64_t t = s->hdr.start_us + (int32_t)(s->rec[0].t_us - (uint32_t)s->hdr.start_us);
+  s->ts_us[0] = t;
+  for (int i = 1; i < s->count; i++) {
+    t += (uint32_t)(s->rec[i].t_us - s->rec[i - 1].t_us);
+    s->ts_us[i] = t;
+  }
+}
+
+static bool load_session(session_t* s, const char* path) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+
+  uint8_t hbuf[IMU_RECORDER_HEADER_SIZE];
+  if (fread(hbuf, 1, sizeof(hbuf), f) != sizeof(hbuf)) {
+    fprintf(stderr, "%s: truncated header\n", path);
+    fclose(f);
+    return false;
+  }
+  memcpy(&s->hdr, hbuf, sizeof(s->hdr));
+  if (s->hdr.magic != IMU_RECORDER_MAGIC || s->hdr.version != IMU_RECORDER_VERSION ||
+      s->hdr.record_size != sizeof(imu_record_t)) {
+    fprintf(stderr, "%s: not a version %d session file\n", path, IMU_RECORDER_VERSION);
+    fclose(f);
+    return false;
+  }
+
+  s->rec = malloc(sizeof(imu_record_t) * (s->hdr.record_count + 1));
+  s->ts_us = malloc(sizeof(int64_t) * (s->hdr.record_count + 1));
+  s->count = (int)fread(s->rec, sizeof(imu_record_t), s->hdr.record_count, f);
+  fclose(f);
+  if (s->count != (int)s->hdr.record_count)
+    fprintf(stderr, "%s: expected %u records, read %d\n", path, (unsigned)s->hdr.record_count,
+            s->count);
+  unwrap_timestamps(s);
+  return true;
+}
+
+/* A half-sine forward surge over the first SYNTH_DRIVE_FRACTION of each
+ * stroke, then a longer, weaker half-sine deceleration that cancels it, so
+ * the boat's mean acceleration is zero. Small deterministic noise and
+ * timestamp jitter on top. Gravity is tilted off every axis so the
+ * projection uses all three components. */
+static void synthesize_session(session_t* s, const options_t* opt) {
+  const int odr_hz = 100;
+  const float g[3] = {0.10f, 0.05f, 0.99f};
+  float gn = sqrtf(g[0] * g[0] + g[1] * g[1] + g[2] * g[2]);
+  const float period_s = 60.0f / opt->synth_spm;
+
+  memset(&s->hdr, 0, sizeof(s->hdr));
+  s->hdr.magic = IMU_RECORDER_MAGIC;
+  s->hdr.version = IMU_RECORDER_VERSION;
+  s->hdr.record_size = sizeof(imu_record_t);
+  s->hdr.start_us = 1000000;
+  s->hdr.accel_lsb_per_g = IMU_ACCEL_LSB_PER_G;
+  for (int k = 0; k < 3; k++) s->hdr.gravity[k] = g[k] / gn;
+  s->hdr.forward[1] = 1.0f;
+  s->hdr.mass_kg = TOTAL_MASS_KG;
+  s->hdr.catch_g = STROKE_CATCH_THRESHOLD_G;
+  s->hdr.recovery_g = STROKE_RECOVERY_THRESHOLD_G;
+
+  s->count = (int)(opt->synthetic_s * odr_hz);
+  s->hdr.record_count = (uint32_t)s->count;
+  s->rec = calloc((size_t)s->count + 1, sizeof(imu_record_t));
+  s->ts_us = malloc(sizeof(int64_t) * ((size_t)s->count + 1));
+
+  uint32_t seed = 1;
+  for (int i = 0; i < s->count; i++) {
+    double phase = fmod((double)i / odr_hz, period_s) / period_s;
+    /* Recovery: the constant deceleration that cancels the drive's 2/pi mean */
+    double a = phase < SYNTH_DRIVE_FRACTION
+                   ? opt->synth_peak_g * sin(M_PI * phase / SYNTH_DRIVE_FRACTION)
+                   : -opt->synth_peak_g * (2.0 / M_PI) * SYNTH_DRIVE_FRACTION /
+                         (1.0 - SYNTH_DRIVE_FRACTION);
+    seed = seed * 1103515245u + 12345u;
+    double noise = (double)((int)((seed >> 16) % 201) - 100) / 10000.0;
+
+    int64_t ts = s->hdr.start_us + (int64_t)i * (1000000 / odr_hz) + (i % 3) * 7;
+    s->ts_us[i] = ts;
+    s->rec[i].t_us = (uint32_t)ts;
+    s->rec[i].ax = (int16_t)lrint((s->hdr.gravity[0] + noise) * IMU_ACCEL_LSB_PER_G);
+    s->rec[i].ay = (int16_t)lrint((s->hdr.gravity[1] + a) * IMU_ACCEL_LSB_PER_G);
+    s->rec[i].az = (int16_t)lrint(s->hdr.gravity[2] * IMU_ACCEL_LSB_PER_G);
+  }
+}
+
+static int recorded_strokes(const session_t* s) {
+  int n = 0;
+  for (int i = 0; i < s->count; i++) n += (s->rec[i].flags & IMU_RECORD_FLAG_STROKE) != 0;
+  return n;
+}
+
+/* ---- replay ---- */
+
+typedef struct {
+  stroke_state_t stroke;
+  imu_calibration_t cal;
+  imu_power_state_t power;
+} pipeline_t;
+
+static void pipeline_init(pipeline_t* p, const session_t* s, const options_t* opt) {
+  stroke_detector_init(&p->stroke);
+  imu_power_init(&p->power);
+  memset(&p->cal, 0, sizeof(p->cal));
+  memcpy(p->cal.gravity, s->hdr.gravity, sizeof(p->cal.gravity));
+  memcpy(p->cal.saved, s->hdr.gravity, sizeof(p->cal.saved));
+  p->cal.calibrated = true;
+  memcpy(p->power.forward, s->hdr.forward, sizeof(p->power.forward));
+  p->power.mass_kg = opt->mass_kg > 0 ? opt->mass_kg : s->hdr.mass_kg;
+  p->stroke.catch_g = opt->catch_g > 0 ? opt->catch_g : s->hdr.catch_g;
+  p->stroke.recovery_g = opt->recovery_g > 0 ? opt->recovery_g : s->hdr.recovery_g;
+  p->stroke.adaptive = opt->adaptive;
+}
+
+static void report_stroke(const session_t* s, const pipeline_t* p, int64_t ts_us, float power_w,
+                          float rate_spm, bool print) {
+  if (print)
+    printf("stroke %4d  t=%8.2f s  power=%6.1f W  rate=%5.1f spm\n", p->stroke.stroke_count,
+           (ts_us - s->hdr.start_us) / 1e6, power_w, rate_spm);
+}
+
+static void report_curve(const imu_power_curve_t* c) {
+  printf("  curve %u x %u ms:", c->n_bins, c->bin_ms);
+  for (int k = 0; k < c->n_bins; k++) printf(" %d", c->power_w[k]);
+  printf("\n");
+}
+
+/* Firmware FIFO path: blocks through imu_block_prepare + *_update_block */
+static void replay_blocks(const session_t* s, const options_t* opt, pipeline_t* p, result_t* r,
+                          bool print) {
+  static imu_block_t blk;
+  int64_t last_ts = 0;
+  int64_t next_fix_us = 0;
+
+  for (int base = 0; base < s->count; base += opt->block) {
+    int n = s->count - base < opt->block ? s->count - base : opt->block;
+    blk.count = n;
+    for (int i = 0; i < n; i++) {
+      blk.ax[i] = s->rec[base + i].ax;
+      blk.ay[i] = s->rec[base + i].ay;
+      blk.az[i] = s->rec[base + i].az;
+      blk.gx[i] = s->rec[base + i].gx;
+      blk.gy[i] = s->rec[base + i].gy;
+      blk.gz[i] = s->rec[base + i].gz;
+      blk.ts_us[i] = s->ts_us[base + i];
+    }
+
+    stroke_event_t events[MAX_EVENTS];
+    float event_power_w[MAX_EVENTS];
+    imu_power_curve_t event_curve[MAX_EVENTS];
+    imu_block_prepare(&blk, &last_ts);
+    int n_events = stroke_detector_update_block(&p->stroke, blk.dynamic_g, blk.ts_us, n,
+                                                blk.phase, events, MAX_EVENTS);
+    imu_orientation_track_block(&p->cal, &blk, p->power.forward);
+    if (opt->speed_ms > 0 && blk.ts_us[0] >= next_fix_us) {
+      speed_fusion_correct(&p->power.speed, opt->speed_ms, blk.ts_us[0]);
+      next_fix_us = blk.ts_us[0] + 1000000;
+    }
+    imu_power_update_block(&p->power, &p->cal, &blk, events, n_events, event_power_w, NULL,
+                           event_curve, NULL);
+
+    for (int e = 0; e < n_events; e++) {
+      add_stroke(r, event_power_w[e]);
+      report_stroke(s, p, events[e].timestamp_us, event_power_w[e], events[e].stroke_rate_spm,
+                    print);
+      if (print && opt->curve)
+        report_curve(&event_curve[e]);
+    }
+  }
+}
+
+/* Per-sample API: one stroke_detector_update + imu_power_update per sample.
+ * Gravity stays at the header value (no gyro tracking). */
+static void replay_samples(const session_t* s, pipeline_t* p, result_t* r, bool print) {
+  const float inv_lsb = 1.0f / s->hdr.accel_lsb_per_g;
+  int64_t last_ts = 0;
+
+  for (int i = 0; i < s->count; i++) {
+    const float acce[3] = {s->rec[i].ax * inv_lsb, s->rec[i].ay * inv_lsb,
+                           s->rec[i].az * inv_lsb};
+    int64_t ts = s->ts_us[i];
+    float dt_s = last_ts ? (ts - last_ts) / 1e6f : 0.0f;
+    last_ts = ts;
+
+    float mag = sqrtf(acce[0] * acce[0] + acce[1] * acce[1] + acce[2] * acce[2]);
+    int stroke = stroke_detector_update(&p->stroke, fabsf(mag - 1.0f), ts);
+
+    float power_w;
+    imu_power_update(&p->power, &p->cal, acce, p->stroke.phase, dt_s, &power_w);
+    if (stroke) {
+      add_stroke(r, power_w);
+      report_stroke(s, p, ts, power_w, p->stroke.stroke_rate_spm, print);
+    }
+  }
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(const session_t* s, const options_t* opt, result_t* r) {
+  double elapsed = 0;
+  for (int rep = 0; rep < opt->repeat; rep++) {
+    pipeline_t p;
+    result_t pass = {0};
+    pipeline_init(&p, s, opt);
+
+    double t0 = now_ns();
+    if (opt->per_sample)
+      replay_samples(s, &p, &pass, rep == 0 && !opt->quiet);
+    else
+      replay_blocks(s, opt, &p, &pass, rep == 0 && !opt->quiet);
+    elapsed += now_ns() - t0;
+
+    if (rep == 0)
+      *r = pass;
+    else
+      free(pass.stroke_power_w);
+  }
+  r->ns_per_sample = s->count ? elapsed / ((double)s->count * opt->repeat) : 0;
+}
+
+/* ---- stroke-by-stroke comparison ---- */
+
+static bool dump_strokes(const result_t* r, const char* path) {
+  FILE* f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  for (int i = 0; i < r->strokes; i++) fprintf(f, "%.3f\n", r->stroke_power_w[i]);
+  fclose(f);
+  return true;
+}
+
+/* Every stroke within tolerance_pct of the reference's, and as many */
+static bool compare_strokes(const result_t* r, const char* path, float tolerance_pct) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  int n = 0, bad = 0;
+  double worst_pct = 0;
+  float ref_w;
+  while (fscanf(f, "%f", &ref_w) == 1) {
+    if (n < r->strokes) {
+      double err_pct = ref_w != 0.0f ? 100.0 * fabs(r->stroke_power_w[n] - ref_w) / fabs(ref_w)
+                                     : (r->stroke_power_w[n] != 0.0f ? 100.0 : 0.0);
+      if (err_pct > worst_pct)
+        worst_pct = err_pct;
+      if (err_pct > tolerance_pct && bad++ < 5)
+        printf("stroke %4d  power=%6.1f W  reference=%6.1f W  (%.2f%%)\n", n + 1,
+               r->stroke_power_w[n], ref_w, err_pct);
+    }
+    n++;
+  }
+  fclose(f);
+  printf("compare: %d strokes, reference %d, worst %.3f%% (tolerance %.2f%%)\n", r->strokes, n,
+         worst_pct, tolerance_pct);
+  if (n != r->strokes || bad > 0) {
+    printf("FAIL: %s\n", n != r->strokes ? "stroke count differs" : "stroke power differs");
+    return false;
+  }
+  return true;
+}
+
+/* ---- main ---- */
+
+static void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [options] session.imr\n"
+          "       %s [options] --synthetic SECONDS\n"
+          "  --synthetic S   generate S seconds of synthetic strokes instead of a file\n"
+          "  --spm N         synthetic stroke rate (default 40)\n"
+          "  --peak G        synthetic peak surge (default 1.5)\n"
+          "  --per-sample    use the polled per-sample API instead of blocks\n"
+          "  --block N       samples per block (default %d, max %d)\n"
+          "  --catch G       override the session's catch threshold\n"
+          "  --recovery G    override the session's recovery threshold\n"
+          "  --adaptive      adapt the thresholds, starting from catch/recovery\n"
+          "  --mass KG       override the session's mass\n"
+          "  --repeat N      replay N times for a steadier ns/sample (default 1)\n"
+          "  --curve         print each stroke's power curve (block path only)\n"
+          "  --speed MS      feed a constant boat speed fix once a second (block path only)\n"
+          "  --expect N:W    exit 1 unless N strokes at a mean power of W watts\n"
+          "  --tolerance PCT allowed power error for --expect/--compare (default 0.5)\n"
+          "  --dump FILE     write each stroke's power to FILE\n"
+          "  --compare FILE  exit 1 unless every stroke matches FILE from --dump\n"
+          "  -q              summary only\n"
+          "  -v              show firmware ESP_LOGI/D output\n",
+          argv0, argv0, DEFAULT_BLOCK, IMU_BLOCK_MAX_SAMPLES);
+}
+
+int main(int argc, char** argv) {
+  options_t opt = {
+      .synth_spm = 40.0f,
+      .synth_peak_g = 1.5f,
+      .block = DEFAULT_BLOCK,
+      .repeat = 1,
+      .expect_strokes = -1,
+      .tolerance_pct = 0.5f,
+  };
+
+  for (int i = 1; i < argc; i++) {
+    const char* a = argv[i];
+    bool has_val = i + 1 < argc;
+    if (strcmp(a, "--synthetic") == 0 && has_val)
+      opt.synthetic_s = strtof(argv[++i], NULL);
+    else if (strcmp(a, "--spm") == 0 && has_val)
+      opt.synth_spm = strtof(argv[++i], NULL);
+    else if (strcmp(a, "--peak") == 0 && has_val)
+      opt.synth_peak_g = strtof(argv[++i], NULL);
+    else if (strcmp(a, "--per-sample") == 0)
+      opt.per_sample = true;
+    else if (strcmp(a, "--block") == 0 && has_val)
+      opt.block = atoi(argv[++i]);
+    else if (strcmp(a, "--catch") == 0 && has_val)
+      opt.catch_g = strtof(argv[++i], NULL);
+    else if (strcmp(a, "--recovery") == 0 && has_val)
+      opt.recovery_g = strtof(argv[++i], NULL);
+    else if (strcmp(a, "--mass") == 0 && has_val)
+      opt.mass_kg = strtof(argv[++i], NULL);
+    else if (strcmp(a, "--repeat") == 0 && has_val)
+      opt.repeat = atoi(argv[++i]);
+    else if (strcmp(a, "--speed") == 0 && has_val)
+      opt.speed_ms = strtof(argv[++i], NULL);
+    else if (strcmp(a, "--expect") == 0 && has_val) {
+      if (sscanf(argv[++i], "%d:%f", &opt.expect_strokes, &opt.expect_power_w) != 2) {
+        usage(argv[0]);
+        return 2;
+      }
+    } else if (strcmp(a, "--tolerance") == 0 && has_val)
+      opt.tolerance_pct = strtof(argv[++i], NULL);
+    else if (strcmp(a, "--dump") == 0 && has_val)
+      opt.dump_path = argv[++i];
+    else if (strcmp(a, "--compare") == 0 && has_val)
+      opt.compare_path = argv[++i];
+    else if (strcmp(a, "--adaptive") == 0)
+      opt.adaptive = true;
+    else if (strcmp(a, "--curve") == 0)
+      opt.curve = true;
+    else if (strcmp(a, "-q") == 0)
+      opt.quiet = true;
+    else if (strcmp(a, "-v") == 0)
+      host_log_level = 4;
+    else if (a[0] != '-' && !opt.path)
+      opt.path = a;
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if ((!opt.path) == (opt.synthetic_s <= 0) || opt.block < 1 ||
+      opt.block > IMU_BLOCK_MAX_SAMPLES || opt.repeat < 1 || opt.synth_spm <= 0) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  session_t s = {0};
+  if (opt.path) {
+    if (!load_session(&s, opt.path))
+      return 1;
+  } else {
+    synthesize_session(&s, &opt);
+  }
+
+  result_t r = {0};
+  run(&s, &opt, &r);
+
+  printf("samples=%d  strokes=%d", s.count, r.strokes);
+  if (opt.path)
+    printf(" (recorded %d, dropped %u)", recorded_strokes(&s), (unsigned)s.hdr.dropped);
+  double mean_w = r.strokes ? r.power_sum_w / r.strokes : 0.0;
+  printf("  mean_power=%.1f W  %.1f ns/sample  [%s, %s]\n", mean_w, r.ns_per_sample,
+         IMU_POWER_FIXED_POINT ? "fixed" : "float", opt.per_sample ? "per-sample" : "block");
+
+  int status = 0;
+  if (opt.expect_strokes >= 0) {
+    double err_pct = 100.0 * fabs(mean_w - opt.expect_power_w) / opt.expect_power_w;
+    if (r.strokes != opt.expect_strokes || err_pct > opt.tolerance_pct) {
+      printf("FAIL: expected %d strokes at %.1f W (+/- %.2f%%), got %d at %.1f W (%.2f%%)\n",
+             opt.expect_strokes, opt.expect_power_w, opt.tolerance_pct, r.strokes, mean_w,
+             err_pct);
+      status = 1;
+    }
+  }
+
+  if (opt.dump_path && !dump_strokes(&r, opt.dump_path))
+    status = 1;
+  if (opt.compare_path && !compare_strokes(&r, opt.compare_path, opt.tolerance_pct))
+    status = 1;
+
+  free(r.stroke_power_w);
+  free(s.rec);
+  free(s.ts_us);
+  return status;
+}
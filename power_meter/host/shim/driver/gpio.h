@@ -0,0 +1,7 @@
+#pragma once
+
+/* Host shim: just the pin type imu_sensor.h declares its API with */
+
+typedef int gpio_num_t;
+
+#define GPIO_NUM_NC (-1)
@@ -0,0 +1,10 @@
+#pragma once
+
+/* Host shim: just enough of esp_err.h for the IMU pipeline sources */
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+const char* esp_err_to_name(esp_err_t code);
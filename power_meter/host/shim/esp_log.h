@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdio.h>
+
+/* Host shim: ESP_LOGx print to stdout when host_log_level allows it.
+ * Levels follow esp_log_level_t: 1 = error ... 5 = verbose. */
+
+extern int host_log_level;
+
+#define HOST_LOG(level, tag, fmt, ...)                 \
+  do {                                                 \
+    if (host_log_level >= (level))                     \
+      printf("%s: " fmt "\n", tag, ##__VA_ARGS__);     \
+  } while (0)
+
+#define ESP_LOGE(tag, fmt, ...) HOST_LOG(1, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) HOST_LOG(2, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) HOST_LOG(3, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) HOST_LOG(4, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) HOST_LOG(5, tag, fmt, ##__VA_ARGS__)
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Host shim: monotonic microseconds */
+int64_t esp_timer_get_time(void);
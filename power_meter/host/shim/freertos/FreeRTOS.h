@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Host shim: tick type and conversion at the firmware's 100 Hz tick */
+
+typedef uint32_t TickType_t;
+
+#define configTICK_RATE_HZ 100
+#define pdMS_TO_TICKS(ms) ((TickType_t)((ms) * configTICK_RATE_HZ / 1000))
@@ -0,0 +1,30 @@
+#include <time.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "imu_sensor.h"
+
+/* Warnings and errors only: per-stroke ESP_LOGI would swamp the replay output */
+int host_log_level = 2;
+
+const char* esp_err_to_name(esp_err_t code) {
+  return code == ESP_OK ? "ESP_OK" : "ESP_FAIL";
+}
+
+int64_t esp_timer_get_time(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  (void)ticks;
+}
+
+/* There is no sensor on the host, so imu_calibrate() is unusable and the
+ * replay takes gravity from the session header instead */
+esp_err_t imu_sensor_read_sample(imu_raw_sample_t* sample) {
+  (void)sample;
+  return ESP_FAIL;
+}
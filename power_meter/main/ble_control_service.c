@@ -0,0 +1,438 @@
+/*
+ * Vendor BLE control service
+ *
+ * Lets a phone app switch the WiFi log server on or off without touching the
+ * device, and page through the stroke history without WiFi:
+ * - WiFi Control - Write (0x00 = off, 0x01 = on)
+ * - Stroke History - Write (uint32 LE cursor), Read (page from the cursor)
+ * - Power Curve - Read/Notify (last stroke's power curve)
+ * - Boat Speed - Write (uint16 LE, 1/256 m/s, e.g. the watch's GPS speed)
+ * - Seat Stroke - Read/Notify (last stroke, for a crew aggregator)
+ */
+
+#include "ble_control_service.h"
+
+#include <math.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "host/ble_hs.h"
+#include "host/ble_uuid.h"
+#include "stroke_history.h"
+
+#define TAG "CONTROL_SVC"
+
+/* Private function declarations */
+static int wifi_control_access(uint16_t conn_handle,
+                               uint16_t attr_handle,
+                               struct ble_gatt_access_ctxt* ctxt,
+                               void* arg);
+static int stroke_history_access(uint16_t conn_handle,
+                                 uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt* ctxt,
+                                 void* arg);
+static int power_curve_access(uint16_t conn_handle,
+                              uint16_t attr_handle,
+                              struct ble_gatt_access_ctxt* ctxt,
+                              void* arg);
+static int boat_speed_access(uint16_t conn_handle,
+                             uint16_t attr_handle,
+                             struct ble_gatt_access_ctxt* ctxt,
+                             void* arg);
+static int seat_stroke_access(uint16_t conn_handle,
+                              uint16_t attr_handle,
+                              struct ble_gatt_access_ctxt* ctxt,
+                              void* arg);
+
+/* Service and Characteristic UUIDs (little-endian byte order) */
+static const ble_uuid128_t control_svc_uuid = CONTROL_UUID128_INIT(0x00);
+static const ble_uuid128_t wifi_control_chr_uuid = CONTROL_UUID128_INIT(0x01);
+static const ble_uuid128_t stroke_history_chr_uuid = CONTROL_UUID128_INIT(0x02);
+static const ble_uuid128_t power_curve_chr_uuid = CONTROL_UUID128_INIT(0x03);
+static const ble_uuid128_t boat_speed_chr_uuid = CONTROL_UUID128_INIT(0x04);
+static const ble_uuid128_t seat_stroke_chr_uuid = CONTROL_UUID128_INIT(CONTROL_SEAT_STROKE_ID);
+
+/* Characteristic value handles */
+static uint16_t wifi_control_val_handle;
+static uint16_t stroke_history_val_handle;
+static uint16_t power_curve_val_handle;
+static uint16_t boat_speed_val_handle;
+static uint16_t seat_stroke_val_handle;
+
+static control_wifi_cb_t s_wifi_cb;
+static control_speed_cb_t s_speed_cb;
+
+/* Stroke history cursor per connection. Only the NimBLE host task touches
+ * it (access callbacks and the GAP disconnect handler), so no lock. A
+ * connection without an entry reads from the oldest stroke. */
+#define MAX_CURSORS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+static struct {
+  uint16_t conn_handle;
+  uint32_t from;
+} s_cursors[MAX_CURSORS] = {
+    [0 ... MAX_CURSORS - 1] = {.conn_handle = BLE_HS_CONN_HANDLE_NONE},
+};
+
+/* Last stroke's curve: written by the BLE notify task, read by the host */
+static imu_power_curve_t s_curve;
+static portMUX_TYPE s_curve_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Last stroke's seat record, sent_ms unset; same access pattern as s_curve */
+static control_stroke_msg_t s_stroke;
+static portMUX_TYPE s_stroke_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* GATT services table */
+static const struct ble_gatt_svc_def control_svcs[] = {
+    {.type = BLE_GATT_SVC_TYPE_PRIMARY,
+     .uuid = &control_svc_uuid.u,
+     .characteristics =
+         (struct ble_gatt_chr_def[]){
+             /* WiFi Control Characteristic. Encrypted writes only: the
+              * SoftAP it brings up is open and takes set: commands */
+             {.uuid = &wifi_control_chr_uuid.u,
+              .access_cb = wifi_control_access,
+              .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP |
+                       BLE_GATT_CHR_F_WRITE_ENC,
+              .val_handle = &wifi_control_val_handle},
+             /* Stroke History Characteristic */
+             {.uuid = &stroke_history_chr_uuid.u,
+              .access_cb = stroke_history_access,
+              .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE,
+              .val_handle = &stroke_history_val_handle},
+             /* Power Curve Characteristic */
+             {.uuid = &power_curve_chr_uuid.u,
+              .access_cb = power_curve_access,
+              .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+              .val_handle = &power_curve_val_handle},
+             /* Boat Speed Characteristic, encrypted writes only */
+             {.uuid = &boat_speed_chr_uuid.u,
+              .access_cb = boat_speed_access,
+              .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP |
+                       BLE_GATT_CHR_F_WRITE_ENC,
+              .val_handle = &boat_speed_val_handle},
+             /* Seat Stroke Characteristic */
+             {.uuid = &seat_stroke_chr_uuid.u,
+              .access_cb = seat_stroke_access,
+              .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+              .val_handle = &seat_stroke_val_handle},
+             {0} /* No more characteristics */
+         }},
+    {0} /* No more services */
+};
+
+/**
+ * GATT access callback for the WiFi Control characteristic.
+ *
+ * Accepts a single byte: CONTROL_WIFI_ON or CONTROL_WIFI_OFF. The request is
+ * handed to the registered callback, which queues the actual WiFi start/stop.
+ *
+ * @param conn_handle BLE connection handle
+ * @param attr_handle GATT attribute handle being accessed
+ * @param ctxt GATT access context containing operation type and data buffer
+ * @param arg User argument (unused)
+ * @return 0 on success, BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN for a wrong length,
+ * BLE_ATT_ERR_UNLIKELY for unsupported operations or values
+ */
+static int wifi_control_access(uint16_t conn_handle,
+                               uint16_t attr_handle,
+                               struct ble_gatt_access_ctxt* ctxt,
+                               void* arg) {
+  if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) {
+    return BLE_ATT_ERR_UNLIKELY;
+  }
+  if (OS_MBUF_PKTLEN(ctxt->om) != 1) {
+    return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+  }
+
+  uint8_t value;
+  if (ble_hs_mbuf_to_flat(ctxt->om, &value, sizeof(value), NULL) != 0) {
+    return BLE_ATT_ERR_UNLIKELY;
+  }
+  if (value != CONTROL_WIFI_ON && value != CONTROL_WIFI_OFF) {
+    return BLE_ATT_ERR_UNLIKELY;
+  }
+
+  ESP_LOGI(TAG, "WiFi %s requested; conn_handle=%d", value ? "on" : "off", conn_handle);
+  if (s_wifi_cb) {
+    s_wifi_cb(value == CONTROL_WIFI_ON);
+  }
+  return 0;
+}
+
+/**
+ * GATT access callback for the Stroke History characteristic.
+ *
+ * A write sets the connection's cursor: a uint32 LE stroke index. A read
+ * returns a page starting there: uint32 LE index of the first record, then up
+ * to CONTROL_HISTORY_PAGE stroke_record_t, oldest first. The first index is
+ * later than the cursor if those strokes were already overwritten; no
+ * records means the reader is up to date. Reads don't move the cursor, since
+ * NimBLE calls back again for every Read Blob of a long value; the client
+ * writes first index + record count to get the next page.
+ *
+ * @param conn_handle BLE connection handle
+ * @param attr_handle GATT attribute handle being accessed
+ * @param ctxt GATT access context containing operation type and data buffer
+ * @param arg User argument (unused)
+ * @return 0 on success, BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN for a wrong length,
+ * BLE_ATT_ERR_INSUFFICIENT_RES if the page doesn't fit or no cursor slot is
+ * free, BLE_ATT_ERR_UNLIKELY for unsupported operations
+ */
+static int stroke_history_access(uint16_t conn_handle,
+                                 uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt* ctxt,
+                                 void* arg) {
+  int slot = -1;
+  for (int i = 0; i < MAX_CURSORS && slot < 0; i++) {
+    if (s_cursors[i].conn_handle == conn_handle)
+      slot = i;
+  }
+
+  if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+    uint8_t le[4];
+    if (OS_MBUF_PKTLEN(ctxt->om) != sizeof(le)) {
+      return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    if (ble_hs_mbuf_to_flat(ctxt->om, le, sizeof(le), NULL) != 0) {
+      return BLE_ATT_ERR_UNLIKELY;
+    }
+    for (int i = 0; i < MAX_CURSORS && slot < 0; i++) {
+      if (s_cursors[i].conn_handle == BLE_HS_CONN_HANDLE_NONE)
+        slot = i;
+    }
+    if (slot < 0) {
+      return BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
+    s_cursors[slot].conn_handle = conn_handle;
+    s_cursors[slot].from = le[0] | le[1] << 8 | le[2] << 16 | (uint32_t)le[3] << 24;
+    return 0;
+  }
+
+  if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) {
+    return BLE_ATT_ERR_UNLIKELY;
+  }
+
+  stroke_record_t page[CONTROL_HISTORY_PAGE];
+  uint32_t first;
+  int n = stroke_history_read(slot < 0 ? 0 : s_cursors[slot].from, page, CONTROL_HISTORY_PAGE,
+                              &first);
+  /* Records are packed little-endian already; so is the chip */
+  const uint8_t le[4] = {first, first >> 8, first >> 16, first >> 24};
+  if (os_mbuf_append(ctxt->om, le, sizeof(le)) != 0 ||
+      os_mbuf_append(ctxt->om, page, n * sizeof(stroke_record_t)) != 0) {
+    return BLE_ATT_ERR_INSUFFICIENT_RES;
+  }
+  return 0;
+}
+
+/**
+ * GATT access callback for the Power Curve characteristic.
+ *
+ * Returns the last stroke's curve: uint8 bin count, uint8 bin width (ms),
+ * then one int16 LE mean power (W) per bin, up to 66 bytes. A notification
+ * carries the same value, cut to the connection's MTU; a central on the
+ * default 23-byte MTU should read the value when notified.
+ *
+ * @param conn_handle BLE connection handle
+ * @param attr_handle GATT attribute handle being accessed
+ * @param ctxt GATT access context containing operation type and data buffer
+ * @param arg User argument (unused)
+ * @return 0 on success, BLE_ATT_ERR_INSUFFICIENT_RES if the value doesn't
+ * fit, BLE_ATT_ERR_UNLIKELY for unsupported operations
+ */
+static int power_curve_access(uint16_t conn_handle,
+                              uint16_t attr_handle,
+                              struct ble_gatt_access_ctxt* ctxt,
+                              void* arg) {
+  if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) {
+    return BLE_ATT_ERR_UNLIKELY;
+  }
+
+  uint8_t buf[2 + 2 * IMU_CURVE_BINS];
+  portENTER_CRITICAL(&s_curve_lock);
+  int n = s_curve.n_bins;
+  buf[0] = s_curve.n_bins;
+  buf[1] = (uint8_t)s_curve.bin_ms;
+  for (int k = 0; k < n; k++) {
+    buf[2 + 2 * k] = (uint8_t)s_curve.power_w[k];
+    buf[3 + 2 * k] = (uint8_t)((uint16_t)s_curve.power_w[k] >> 8);
+  }
+  portEXIT_CRITICAL(&s_curve_lock);
+
+  if (os_mbuf_append(ctxt->om, buf, 2 + 2 * n) != 0) {
+    return BLE_ATT_ERR_INSUFFICIENT_RES;
+  }
+  return 0;
+}
+
+/**
+ * GATT access callback for the Boat Speed characteristic.
+ *
+ * Accepts the boat's speed over ground as uint16 LE in 1/256 m/s, the unit
+ * of the Running Speed and Cadence service. A central with GPS writes it as
+ * each fix arrives (~1 Hz); the value goes to the registered callback.
+ *
+ * @param conn_handle BLE connection handle
+ * @param attr_handle GATT attribute handle being accessed
+ * @param ctxt GATT access context containing operation type and data buffer
+ * @param arg User argument (unused)
+ * @return 0 on success, BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN for a wrong length,
+ * BLE_ATT_ERR_UNLIKELY for unsupported operations
+ */
+static int boat_speed_access(uint16_t conn_handle,
+                             uint16_t attr_handle,
+                             struct ble_gatt_access_ctxt* ctxt,
+                             void* arg) {
+  if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) {
+    return BLE_ATT_ERR_UNLIKELY;
+  }
+  uint8_t le[2];
+  if (OS_MBUF_PKTLEN(ctxt->om) != sizeof(le)) {
+    return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+  }
+  if (ble_hs_mbuf_to_flat(ctxt->om, le, sizeof(le), NULL) != 0) {
+    return BLE_ATT_ERR_UNLIKELY;
+  }
+
+  float speed_ms = (le[0] | le[1] << 8) / 256.0f;
+  ESP_LOGD(TAG, "Boat speed %.2f m/s; conn_handle=%d", speed_ms, conn_handle);
+  if (s_speed_cb) {
+    s_speed_cb(speed_ms);
+  }
+  return 0;
+}
+
+/**
+ * GATT access callback for the Seat Stroke characteristic.
+ *
+ * Returns the last stroke as a control_stroke_msg_t, stamped with the
+ * current time. NimBLE reads the value through here when it builds each
+ * notification, so sent_ms is as close to the air as this side can get.
+ *
+ * @param conn_handle BLE connection handle
+ * @param attr_handle GATT attribute handle being accessed
+ * @param ctxt GATT access context containing operation type and data buffer
+ * @param arg User argument (unused)
+ * @return 0 on success, BLE_ATT_ERR_INSUFFICIENT_RES if the value doesn't
+ * fit, BLE_ATT_ERR_UNLIKELY for unsupported operations
+ */
+static int seat_stroke_access(uint16_t conn_handle,
+                              uint16_t attr_handle,
+                              struct ble_gatt_access_ctxt* ctxt,
+                              void* arg) {
+  if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) {
+    return BLE_ATT_ERR_UNLIKELY;
+  }
+
+  portENTER_CRITICAL(&s_stroke_lock);
+  control_stroke_msg_t msg = s_stroke;
+  portEXIT_CRITICAL(&s_stroke_lock);
+  msg.sent_ms = (uint32_t)(esp_timer_get_time() / 1000);
+
+  if (os_mbuf_append(ctxt->om, &msg, sizeof(msg)) != 0) {
+    return BLE_ATT_ERR_INSUFFICIENT_RES;
+  }
+  return 0;
+}
+
+/* Public functions */
+
+/**
+ * Set the callback for WiFi control writes.
+ *
+ * @param cb Invoked from the NimBLE host task with the requested state
+ */
+void control_service_set_wifi_cb(control_wifi_cb_t cb) {
+  s_wifi_cb = cb;
+}
+
+/**
+ * Set the callback for Boat Speed writes.
+ *
+ * @param cb Invoked from the NimBLE host task with the speed in m/s
+ */
+void control_service_set_speed_cb(control_speed_cb_t cb) {
+  s_speed_cb = cb;
+}
+
+/**
+ * Forget a connection's stroke history cursor. Call from the GAP disconnect
+ * handler.
+ *
+ * @param conn_handle Handle of the connection that closed
+ */
+void control_service_conn_closed(uint16_t conn_handle) {
+  for (int i = 0; i < MAX_CURSORS; i++) {
+    if (s_cursors[i].conn_handle == conn_handle)
+      s_cursors[i].conn_handle = BLE_HS_CONN_HANDLE_NONE;
+  }
+}
+
+/**
+ * Publish a finished stroke's power curve and notify subscribed centrals.
+ * Call from the BLE notify task, once per stroke.
+ *
+ * @param curve Curve from imu_power_update_block(); ignored while empty
+ */
+void control_service_notify_curve(const imu_power_curve_t* curve) {
+  if (curve->n_bins == 0) {
+    return;
+  }
+  portENTER_CRITICAL(&s_curve_lock);
+  s_curve = *curve;
+  portEXIT_CRITICAL(&s_curve_lock);
+  ble_gatts_chr_updated(power_curve_val_handle);
+}
+
+/**
+ * Publish a confirmed local stroke and notify subscribed centrals (a crew
+ * aggregator). Call from the BLE notify task, once per stroke.
+ *
+ * @param seq Stroke count
+ * @param power_w Stroke power
+ * @param rate_spm Smoothed stroke rate
+ * @param catch_us stroke_event_t.catch_exact_us
+ * @param release_us stroke_event_t.release_us
+ */
+void control_service_notify_stroke(uint16_t seq,
+                                   float power_w,
+                                   float rate_spm,
+                                   int64_t catch_us,
+                                   int64_t release_us) {
+  const control_stroke_msg_t msg = {
+      .seq = seq,
+      .power_w = power_w <= 0.0f ? 0 : power_w >= 65535.0f ? 65535 : (uint16_t)lrintf(power_w),
+      .rate_cspm = (uint16_t)lrintf(rate_spm * 100.0f),
+      .drive_ms = (uint16_t)((release_us - catch_us) / 1000),
+      .catch_ms = (uint32_t)(catch_us / 1000),
+  };
+  portENTER_CRITICAL(&s_stroke_lock);
+  s_stroke = msg;
+  portEXIT_CRITICAL(&s_stroke_lock);
+  ble_gatts_chr_updated(seat_stroke_val_handle);
+}
+
+/**
+ * Initialize the vendor control service.
+ *
+ * Must be called after NimBLE stack initialization and before starting
+ * the BLE host task.
+ *
+ * @return 0 on success, non-zero error code on failure
+ */
+int control_service_init(void) {
+  int rc = ble_gatts_count_cfg(control_svcs);
+  if (rc != 0) {
+    ESP_LOGE(TAG, "failed to count GATT services, error code: %d", rc);
+    return rc;
+  }
+
+  rc = ble_gatts_add_svcs(control_svcs);
+  if (rc != 0) {
+    ESP_LOGE(TAG, "failed to add GATT services, error code: %d", rc);
+    return rc;
+  }
+
+  ESP_LOGI(TAG, "Control service initialized");
+  return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef BLE_CONTROL_SERVICE_H
+#define BLE_CONTROL_SERVICE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "host/ble_gatt.h"
+#include "host/ble_uuid.h"
+#include "imu_power.h"
+
+/* Vendor control service. 128-bit UUIDs:
+ *   Service      b5e1a000-5c4d-4f3e-9a8b-7c6d5e4f3a2b
+ *   WiFi control b5e1a001-5c4d-4f3e-9a8b-7c6d5e4f3a2b  (write, 1 byte)
+ *   Stroke hist. b5e1a002-5c4d-4f3e-9a8b-7c6d5e4f3a2b  (write uint32 cursor, read page)
+ *   Power curve  b5e1a003-5c4d-4f3e-9a8b-7c6d5e4f3a2b  (read, notify; once per stroke)
+ *   Boat speed   b5e1a004-5c4d-4f3e-9a8b-7c6d5e4f3a2b  (write, uint16 1/256 m/s)
+ *   Seat stroke  b5e1a005-5c4d-4f3e-9a8b-7c6d5e4f3a2b  (read, notify; control_stroke_msg_t)
+ */
+#define CONTROL_UUID128_INIT(id)                                                              \
+  BLE_UUID128_INIT(0x2b, 0x3a, 0x4f, 0x5e, 0x6d, 0x7c, 0x8b, 0x9a, 0x3e, 0x4f, 0x4d, 0x5c, (id), \
+                   0xa0, 0xe1, 0xb5)
+#define CONTROL_SEAT_STROKE_ID 0x05
+#define CONTROL_WIFI_OFF 0x00
+#define CONTROL_WIFI_ON 0x01
+
+/* Stroke records per history read: 4 + 30 * 16 = 484 bytes, under the
+ * 512-byte ATT attribute limit */
+#define CONTROL_HISTORY_PAGE 30
+
+/* Seat stroke value, 16 bytes LE, notified once per local stroke. Times are
+ * the sending unit's esp_timer in ms; sent_ms is taken as the value goes
+ * out, so a receiver can estimate the clock offset (crew.h). */
+typedef struct __attribute__((packed)) {
+  uint16_t seq;       /* Stroke count, wraps */
+  uint16_t power_w;
+  uint16_t rate_cspm; /* 0.01 spm */
+  uint16_t drive_ms;  /* Catch to release */
+  uint32_t catch_ms;  /* Interpolated catch */
+  uint32_t sent_ms;
+} control_stroke_msg_t;
+
+/* Called from the NimBLE host task; must not block */
+typedef void (*control_wifi_cb_t)(bool on);
+typedef void (*control_speed_cb_t)(float speed_ms);
+
+/* Public function declarations */
+int control_service_init(void);
+void control_service_set_wifi_cb(control_wifi_cb_t cb);
+void control_service_set_speed_cb(control_speed_cb_t cb);
+void control_service_conn_closed(uint16_t conn_handle);
+void control_service_notify_curve(const imu_power_curve_t* curve);
+void control_service_notify_stroke(uint16_t seq,
+                                   float power_w,
+                                   float rate_spm,
+                                   int64_t catch_us,
+                                   int64_t release_us);
+
+#endif  // BLE_CONTROL_SERVICE_H
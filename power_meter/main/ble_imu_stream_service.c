@@ -0,0 +1,469 @@
+/*
+ * Vendor BLE IMU stream service
+ *
+ * Streams the sample pipeline to a phone app at the full IMU rate:
+ * - Raw Samples - Notify (sensor counts, six int16 per sample)
+ * - Derived - Notify (forward acceleration, stroke delta-v, detector input)
+ *
+ * The IMU task queues samples into a lock-free ring while someone is
+ * subscribed; a low-priority sender packs them into MTU-sized notifications
+ * every IMU_STREAM_PERIOD_MS.
+ */
+
+#include "ble_imu_stream_service.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <string.h>
+#include "conn_policy.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host/ble_hs.h"
+#include "host/ble_uuid.h"
+#include "perf_stats.h"
+#include "spsc_ring.h"
+#include "task_plan.h"
+
+#define TAG "IMU_STREAM_SVC"
+
+/* 128 samples: 0.5 s at 250 Hz, ten sender wakeups */
+#define RING_CAPACITY 128
+/* (IMU_STREAM_MAX_PAYLOAD - header) / smallest sample */
+#define MAX_CHUNK \
+  ((IMU_STREAM_MAX_PAYLOAD - sizeof(imu_stream_header_t)) / sizeof(imu_stream_derived_t))
+/* LL data length to ask for: 251 octets and its airtime on 1M PHY,
+ * (251 + 14) * 8 us */
+#define LL_TX_OCTETS 251
+#define LL_TX_TIME_US 2120
+
+_Static_assert(sizeof(imu_stream_raw_t) == 12, "imu_stream_raw_t must stay 12 bytes");
+_Static_assert(sizeof(imu_stream_derived_t) == 8, "imu_stream_derived_t must stay 8 bytes");
+_Static_assert(MAX_CHUNK <= UINT8_MAX, "count must fit imu_stream_header_t");
+
+/* Private function declarations */
+static int stream_access(uint16_t conn_handle,
+                         uint16_t attr_handle,
+                         struct ble_gatt_access_ctxt* ctxt,
+                         void* arg);
+
+/* Service and Characteristic UUIDs (little-endian byte order) */
+static const ble_uuid128_t stream_svc_uuid = IMU_STREAM_UUID128_INIT(0x00);
+static const ble_uuid128_t raw_chr_uuid = IMU_STREAM_UUID128_INIT(0x01);
+static const ble_uuid128_t derived_chr_uuid = IMU_STREAM_UUID128_INIT(0x02);
+
+/* Characteristic value handles */
+static uint16_t raw_val_handle;
+static uint16_t derived_val_handle;
+
+/* Streaming connections. Written by the NimBLE host task (subscribe, MTU,
+ * disconnect), snapshotted by the sender under s_sub_lock. */
+#define MAX_SUBSCRIBERS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+typedef struct {
+  uint16_t conn_handle; /* BLE_HS_CONN_HANDLE_NONE = free slot */
+  uint16_t mtu;
+  bool raw;
+  bool derived;
+} stream_sub_t;
+static stream_sub_t s_subs[MAX_SUBSCRIBERS] = {
+    [0 ... MAX_SUBSCRIBERS - 1] = {.conn_handle = BLE_HS_CONN_HANDLE_NONE},
+};
+static portMUX_TYPE s_sub_lock = portMUX_INITIALIZER_UNLOCKED;
+/* Summaries of s_subs for the IMU task */
+static _Atomic bool s_active;
+static _Atomic bool s_derived;
+
+/* One queued sample, both formats */
+typedef struct {
+  uint32_t index;
+  uint32_t t_us;
+  uint16_t period_us;
+  imu_stream_raw_t raw;
+  imu_stream_derived_t derived;
+} stream_sample_t;
+
+static spsc_ring_t s_ring;
+static stream_sample_t s_ring_storage[RING_CAPACITY];
+static uint32_t s_next_index; /* IMU task only */
+static TaskHandle_t s_task;
+
+/* GATT services table */
+static const struct ble_gatt_svc_def stream_svcs[] = {
+    {.type = BLE_GATT_SVC_TYPE_PRIMARY,
+     .uuid = &stream_svc_uuid.u,
+     .characteristics =
+         (struct ble_gatt_chr_def[]){
+             /* Raw Samples Characteristic */
+             {.uuid = &raw_chr_uuid.u,
+              .access_cb = stream_access,
+              .flags = BLE_GATT_CHR_F_NOTIFY,
+              .val_handle = &raw_val_handle},
+             /* Derived Characteristic */
+             {.uuid = &derived_chr_uuid.u,
+              .access_cb = stream_access,
+              .flags = BLE_GATT_CHR_F_NOTIFY,
+              .val_handle = &derived_val_handle},
+             {0} /* No more characteristics */
+         }},
+    {0} /* No more services */
+};
+
+/**
+ * GATT access callback for both stream characteristics.
+ *
+ * The characteristics are notify-only, so read/write operations are not
+ * permitted.
+ *
+ * @param conn_handle BLE connection handle
+ * @param attr_handle GATT attribute handle being accessed
+ * @param ctxt GATT access context containing operation type and data buffer
+ * @param arg User argument (unused)
+ * @return BLE_ATT_ERR_UNLIKELY to reject all access attempts
+ */
+static int stream_access(uint16_t conn_handle,
+                         uint16_t attr_handle,
+                         struct ble_gatt_access_ctxt* ctxt,
+                         void* arg) {
+  return BLE_ATT_ERR_UNLIKELY;
+}
+
+static int16_t sat_i16(float v) {
+  return v <= -32768.0f ? -32768 : v >= 32767.0f ? 32767 : (int16_t)lrintf(v);
+}
+
+/* Refresh s_active/s_derived; call with s_sub_lock held */
+static void update_summary(void) {
+  bool active = false;
+  bool derived = false;
+  for (int i = 0; i < MAX_SUBSCRIBERS; i++) {
+    active |= s_subs[i].conn_handle != BLE_HS_CONN_HANDLE_NONE;
+    derived |= s_subs[i].conn_handle != BLE_HS_CONN_HANDLE_NONE && s_subs[i].derived;
+  }
+  atomic_store(&s_active, active);
+  atomic_store(&s_derived, derived);
+}
+
+/* Ask for the link a stream wants. Each request is best effort: the central
+ * may refuse, and the sender works with whatever MTU it ends up with. */
+static void tune_link(uint16_t conn_handle, uint16_t mtu) {
+  int rc;
+  if (mtu < CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU) {
+    rc = ble_gattc_exchange_mtu(conn_handle, NULL, NULL);
+    if (rc != 0)
+      ESP_LOGD(TAG, "conn %d: MTU exchange not started: %d", conn_handle, rc);
+  }
+  rc = ble_gap_set_data_len(conn_handle, LL_TX_OCTETS, LL_TX_TIME_US);
+  if (rc != 0)
+    ESP_LOGD(TAG, "conn %d: data length request failed: %d", conn_handle, rc);
+#if CONFIG_BT_NIMBLE_50_FEATURE_SUPPORT
+  rc = ble_gap_set_prefered_le_phy(conn_handle, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_2M_MASK,
+                                   BLE_GAP_LE_PHY_CODED_ANY);
+  if (rc != 0)
+    ESP_LOGD(TAG, "conn %d: 2M PHY request failed: %d", conn_handle, rc);
+#endif
+}
+
+/* Samples of size bytes that one notification carries at mtu, 0 if not even
+ * one fits */
+static int samples_per_packet(uint16_t mtu, size_t size) {
+  int payload = mtu - 3;
+  if (payload > IMU_STREAM_MAX_PAYLOAD)
+    payload = IMU_STREAM_MAX_PAYLOAD;
+  payload -= (int)sizeof(imu_stream_header_t);
+  return payload > 0 ? payload / (int)size : 0;
+}
+
+/* Encode samples[0..n) in one format and queue it to handles[0..n_handles).
+ * Same fan-out as the power service: one mbuf, os_mbuf_dup() for all but
+ * the last subscriber. */
+static void send_packet(const stream_sample_t* samples,
+                        int n,
+                        imu_stream_format_t format,
+                        const uint16_t* handles,
+                        int n_handles) {
+  uint8_t buf[IMU_STREAM_MAX_PAYLOAD];
+  const imu_stream_header_t hdr = {
+      .first = samples[0].index,
+      .t_us = samples[0].t_us,
+      .period_us = samples[0].period_us,
+      .count = (uint8_t)n,
+      .format = format,
+  };
+  /* Packed little-endian already; so is the chip */
+  memcpy(buf, &hdr, sizeof(hdr));
+  int len = sizeof(hdr);
+  for (int i = 0; i < n; i++) {
+    if (format == IMU_STREAM_RAW) {
+      memcpy(buf + len, &samples[i].raw, sizeof(imu_stream_raw_t));
+      len += sizeof(imu_stream_raw_t);
+    } else {
+      memcpy(buf + len, &samples[i].derived, sizeof(imu_stream_derived_t));
+      len += sizeof(imu_stream_derived_t);
+    }
+  }
+
+  struct os_mbuf* om = ble_hs_mbuf_from_flat(buf, len);
+  if (om == NULL) {
+    perf_count(&g_perf_stats.ble_notify_fail);
+    return;
+  }
+  uint16_t val_handle = format == IMU_STREAM_RAW ? raw_val_handle : derived_val_handle;
+  for (int i = 0; i < n_handles; i++) {
+    struct os_mbuf* m = i == n_handles - 1 ? om : os_mbuf_dup(om);
+    if (m == NULL || ble_gatts_notify_custom(handles[i], val_handle, m) != 0)
+      perf_count(&g_perf_stats.ble_notify_fail);
+  }
+}
+
+/* Send a chunk popped from the ring, split where samples were dropped or the
+ * rate changed so every notification is on one uniform grid */
+static void send_chunk(const stream_sample_t* chunk,
+                       int n,
+                       const uint16_t* raw_handles,
+                       int n_raw,
+                       const uint16_t* derived_handles,
+                       int n_derived) {
+  int start = 0;
+  for (int i = 1; i <= n; i++) {
+    if (i < n && chunk[i].index == chunk[i - 1].index + 1 &&
+        chunk[i].period_us == chunk[i - 1].period_us)
+      continue;
+    if (n_raw > 0)
+      send_packet(chunk + start, i - start, IMU_STREAM_RAW, raw_handles, n_raw);
+    if (n_derived > 0)
+      send_packet(chunk + start, i - start, IMU_STREAM_DERIVED, derived_handles, n_derived);
+    start = i;
+  }
+}
+
+static void stream_task(void* arg) {
+  static stream_sample_t chunk[MAX_CHUNK];
+  int64_t hold_since_us = 0;
+  while (1) {
+    if (!atomic_load(&s_active)) {
+      /* Nothing left to send to; restart from fresh samples */
+      spsc_ring_clear(&s_ring);
+      hold_since_us = 0;
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+    vTaskDelay(pdMS_TO_TICKS(IMU_STREAM_PERIOD_MS));
+
+    /* Subscribers whose MTU takes at least one sample; the chunk size is
+     * what the smallest of them takes */
+    uint16_t raw_handles[MAX_SUBSCRIBERS];
+    uint16_t derived_handles[MAX_SUBSCRIBERS];
+    int n_raw = 0;
+    int n_derived = 0;
+    int per_packet = MAX_CHUNK;
+    portENTER_CRITICAL(&s_sub_lock);
+    for (int i = 0; i < MAX_SUBSCRIBERS; i++) {
+      const stream_sub_t* s = &s_subs[i];
+      if (s->conn_handle == BLE_HS_CONN_HANDLE_NONE)
+        continue;
+      int raw = samples_per_packet(s->mtu, sizeof(imu_stream_raw_t));
+      int derived = samples_per_packet(s->mtu, sizeof(imu_stream_derived_t));
+      if (s->raw && raw > 0) {
+        raw_handles[n_raw++] = s->conn_handle;
+        per_packet = raw < per_packet ? raw : per_packet;
+      }
+      if (s->derived && derived > 0) {
+        derived_handles[n_derived++] = s->conn_handle;
+        per_packet = derived < per_packet ? derived : per_packet;
+      }
+    }
+    portEXIT_CRITICAL(&s_sub_lock);
+    if (n_raw + n_derived == 0) {
+      continue; /* Waiting for an MTU exchange */
+    }
+
+    /* Hold a partly filled notification for a while: fewer, fuller packets
+     * are what makes this cheaper than WiFi */
+    uint32_t n = spsc_ring_count(&s_ring);
+    int64_t now = esp_timer_get_time();
+    if (n == 0) {
+      hold_since_us = 0;
+      continue;
+    }
+    if (hold_since_us == 0)
+      hold_since_us = now;
+    if (n < (uint32_t)per_packet && now - hold_since_us < IMU_STREAM_MAX_HOLD_MS * 1000LL) {
+      continue;
+    }
+
+    while (n > 0) {
+      /* The controller is behind: leave the rest queued rather than take
+       * the buffers the power notifications need */
+      if (os_msys_num_free() < IMU_STREAM_MIN_FREE_MBUFS + n_raw + n_derived)
+        break;
+      size_t got = spsc_ring_pop(&s_ring, chunk, n < (uint32_t)per_packet ? n : per_packet);
+      if (got == 0)
+        break;
+      send_chunk(chunk, (int)got, raw_handles, n_raw, derived_handles, n_derived);
+      n -= got;
+    }
+    hold_since_us = 0;
+  }
+}
+
+/* Public functions */
+
+/**
+ * GAP subscription event callback for the stream characteristics.
+ *
+ * The first subscription on a connection starts its stream: the link is
+ * tuned for throughput and held at the active connection interval. Dropping
+ * the last one stops it.
+ *
+ * @param event GAP event containing subscription information
+ */
+void imu_stream_service_subscribe_cb(struct ble_gap_event* event) {
+  uint16_t attr = event->subscribe.attr_handle;
+  if (attr != raw_val_handle && attr != derived_val_handle) {
+    return;
+  }
+  uint16_t conn_handle = event->subscribe.conn_handle;
+  bool notify = event->subscribe.cur_notify;
+  uint16_t mtu = ble_att_mtu(conn_handle);
+
+  stream_sub_t* slot = NULL;
+  portENTER_CRITICAL(&s_sub_lock);
+  for (int i = 0; i < MAX_SUBSCRIBERS && !slot; i++) {
+    if (s_subs[i].conn_handle == conn_handle)
+      slot = &s_subs[i];
+  }
+  bool was = slot != NULL;
+  for (int i = 0; i < MAX_SUBSCRIBERS && !slot && notify; i++) {
+    if (s_subs[i].conn_handle == BLE_HS_CONN_HANDLE_NONE) {
+      slot = &s_subs[i];
+      *slot = (stream_sub_t){.conn_handle = conn_handle, .mtu = mtu};
+    }
+  }
+  if (slot) {
+    if (attr == raw_val_handle)
+      slot->raw = notify;
+    else
+      slot->derived = notify;
+    if (!slot->raw && !slot->derived)
+      slot->conn_handle = BLE_HS_CONN_HANDLE_NONE;
+  }
+  bool now = slot && slot->conn_handle != BLE_HS_CONN_HANDLE_NONE;
+  update_summary();
+  portEXIT_CRITICAL(&s_sub_lock);
+
+  if (notify && !slot) {
+    ESP_LOGW(TAG, "conn %d: subscriber table full", conn_handle);
+    return;
+  }
+  ESP_LOGI(TAG, "%s stream %s for conn %d (mtu %d)", attr == raw_val_handle ? "raw" : "derived",
+           notify ? "enabled" : "disabled", conn_handle, mtu);
+  if (now && !was) {
+    tune_link(conn_handle, mtu);
+    conn_policy_on_stream(conn_handle, true);
+    xTaskNotifyGive(s_task);
+  } else if (was && !now) {
+    conn_policy_on_stream(conn_handle, false);
+  }
+}
+
+/**
+ * GAP MTU event callback. Later notifications to the connection are sized
+ * to the new MTU.
+ *
+ * @param conn_handle BLE connection handle
+ * @param mtu Negotiated ATT MTU
+ */
+void imu_stream_service_mtu_cb(uint16_t conn_handle, uint16_t mtu) {
+  portENTER_CRITICAL(&s_sub_lock);
+  for (int i = 0; i < MAX_SUBSCRIBERS; i++) {
+    if (s_subs[i].conn_handle == conn_handle)
+      s_subs[i].mtu = mtu;
+  }
+  portEXIT_CRITICAL(&s_sub_lock);
+}
+
+/**
+ * Forget a closed connection. Call from the GAP disconnect handler.
+ *
+ * @param conn_handle BLE connection handle that was closed
+ */
+void imu_stream_service_conn_closed(uint16_t conn_handle) {
+  portENTER_CRITICAL(&s_sub_lock);
+  for (int i = 0; i < MAX_SUBSCRIBERS; i++) {
+    if (s_subs[i].conn_handle == conn_handle)
+      s_subs[i].conn_handle = BLE_HS_CONN_HANDLE_NONE;
+  }
+  update_summary();
+  portEXIT_CRITICAL(&s_sub_lock);
+}
+
+bool imu_stream_service_active(void) {
+  return atomic_load_explicit(&s_active, memory_order_relaxed);
+}
+
+bool imu_stream_service_derived_active(void) {
+  return atomic_load_explicit(&s_derived, memory_order_relaxed);
+}
+
+/**
+ * Queue a block's samples for the subscribed centrals. Call from the IMU
+ * task once per block.
+ *
+ * @param blk Block after imu_power_update_block()
+ * @param period_us Nominal sample spacing of the block
+ * @param derived True if blk->a_fwd_ms2 and blk->dv_ms were filled
+ */
+void imu_stream_service_push_block(const imu_block_t* blk, uint32_t period_us, bool derived) {
+  if (!atomic_load_explicit(&s_active, memory_order_relaxed)) {
+    return;
+  }
+  for (int i = 0; i < blk->count; i++) {
+    stream_sample_t s = {
+        .index = s_next_index++,
+        .t_us = (uint32_t)blk->ts_us[i],
+        .period_us = (uint16_t)period_us,
+        .raw = {blk->ax[i], blk->ay[i], blk->az[i], blk->gx[i], blk->gy[i], blk->gz[i]},
+        .derived =
+            {
+                .a_fwd_cm_s2 = derived ? sat_i16(blk->a_fwd_ms2[i] * 100.0f) : 0,
+                .dv_mm_s = derived ? sat_i16(blk->dv_ms[i] * 1000.0f) : 0,
+                .dynamic_mg = sat_i16(blk->dynamic_g[i] * 1000.0f),
+                .phase = (uint8_t)blk->phase[i],
+            },
+    };
+    if (!spsc_ring_push(&s_ring, &s))
+      perf_count(&g_perf_stats.stream_drops);
+  }
+}
+
+/**
+ * Initialize the IMU stream service and its sender task.
+ *
+ * Must be called after NimBLE stack initialization and before starting
+ * the BLE host task.
+ *
+ * @return 0 on success, non-zero error code on failure
+ */
+int imu_stream_service_init(void) {
+  spsc_ring_init(&s_ring, s_ring_storage, sizeof(stream_sample_t), RING_CAPACITY);
+
+  int rc = ble_gatts_count_cfg(stream_svcs);
+  if (rc != 0) {
+    ESP_LOGE(TAG, "failed to count GATT services, error code: %d", rc);
+    return rc;
+  }
+
+  rc = ble_gatts_add_svcs(stream_svcs);
+  if (rc != 0) {
+    ESP_LOGE(TAG, "failed to add GATT services, error code: %d", rc);
+    return rc;
+  }
+
+  xTaskCreatePinnedToCore(stream_task, "imu_stream", 3 * 1024, NULL, TASK_PRIO_IMU_STREAM,
+                          &s_task, TASK_CORE_RADIO);
+  perf_stats_register_task(s_task);
+
+  ESP_LOGI(TAG, "IMU stream service initialized");
+  return 0;
+}
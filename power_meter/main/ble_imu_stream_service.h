@@ -0,0 +1,85 @@
+#ifndef BLE_IMU_STREAM_SERVICE_H
+#define BLE_IMU_STREAM_SERVICE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "host/ble_gap.h"
+#include "host/ble_uuid.h"
+#include "imu_block.h"
+
+/* Vendor IMU stream service, for lab captures over BLE instead of WiFi.
+ * 128-bit UUIDs:
+ *   Service      b5e1b000-5c4d-4f3e-9a8b-7c6d5e4f3a2b
+ *   Raw samples  b5e1b001-5c4d-4f3e-9a8b-7c6d5e4f3a2b  (notify; IMU_STREAM_RAW)
+ *   Derived      b5e1b002-5c4d-4f3e-9a8b-7c6d5e4f3a2b  (notify; IMU_STREAM_DERIVED)
+ *
+ * Enabling notifications on either characteristic starts the stream for that
+ * connection; disabling them stops it. While nobody subscribes, the IMU task
+ * only tests a flag.
+ *
+ * Each notification is an imu_stream_header_t followed by count samples of
+ * the characteristic's format, as many as the connection's MTU takes (up to
+ * IMU_STREAM_MAX_PAYLOAD, one LL packet with data length extension). All
+ * fields are little-endian. Samples in one notification are consecutive;
+ * a gap in first + count between notifications is samples dropped under
+ * load. On subscribe the unit asks for a larger MTU, a longer LL data
+ * length, 2M PHY where the controller has it (CONFIG_BT_NIMBLE_50_FEATURE_SUPPORT),
+ * and the active connection interval for as long as the stream runs. */
+#define IMU_STREAM_UUID128_INIT(id)                                                           \
+  BLE_UUID128_INIT(0x2b, 0x3a, 0x4f, 0x5e, 0x6d, 0x7c, 0x8b, 0x9a, 0x3e, 0x4f, 0x4d, 0x5c, (id), \
+                   0xb0, 0xe1, 0xb5)
+
+/* 251-byte LL payload - 4 L2CAP - 3 ATT */
+#define IMU_STREAM_MAX_PAYLOAD 244
+/* Sender wakeup period, and how long a partly filled notification may wait
+ * for more samples */
+#define IMU_STREAM_PERIOD_MS 50
+#define IMU_STREAM_MAX_HOLD_MS 200
+/* mbufs left to the power service: the stream backs off below this */
+#define IMU_STREAM_MIN_FREE_MBUFS 6
+
+typedef enum {
+  IMU_STREAM_RAW = 1,
+  IMU_STREAM_DERIVED = 2,
+} imu_stream_format_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t first;     /* Index of the first sample since boot */
+  uint32_t t_us;      /* Its acquisition time, esp_timer us, low 32 bits */
+  uint16_t period_us; /* Nominal sample spacing */
+  uint8_t count;      /* Samples that follow */
+  uint8_t format;     /* imu_stream_format_t */
+} imu_stream_header_t;
+
+/* IMU_STREAM_RAW: sensor counts, IMU_ACCEL_LSB_PER_G and IMU_GYRO_LSB_PER_DPS */
+typedef struct __attribute__((packed)) {
+  int16_t ax, ay, az;
+  int16_t gx, gy, gz;
+} imu_stream_raw_t;
+
+/* IMU_STREAM_DERIVED: what the pipeline made of the sample */
+typedef struct __attribute__((packed)) {
+  int16_t a_fwd_cm_s2; /* Forward acceleration, gravity removed */
+  int16_t dv_mm_s;     /* Delta-v of the stroke in progress */
+  int16_t dynamic_mg;  /* Stroke detector input */
+  uint8_t phase;       /* stroke_phase_t */
+  uint8_t reserved;
+} imu_stream_derived_t;
+
+/* Public function declarations */
+int imu_stream_service_init(void);
+void imu_stream_service_subscribe_cb(struct ble_gap_event* event);
+void imu_stream_service_mtu_cb(uint16_t conn_handle, uint16_t mtu);
+void imu_stream_service_conn_closed(uint16_t conn_handle);
+
+/* Any subscriber to either format, and to the derived one. IMU task: the
+ * derived values need imu_power_state_t.trace. */
+bool imu_stream_service_active(void);
+bool imu_stream_service_derived_active(void);
+
+/* IMU task, after imu_power_update_block(). derived = blk->a_fwd_ms2/dv_ms
+ * were filled for this block; otherwise those go out as 0. Never blocks;
+ * samples that don't fit the queue are dropped. */
+void imu_stream_service_push_block(const imu_block_t* blk, uint32_t period_us, bool derived);
+
+#endif  // BLE_IMU_STREAM_SERVICE_H
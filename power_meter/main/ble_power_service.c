@@ -9,10 +9,16 @@
 
 #include "ble_power_service.h"
 
+#include <math.h>
+#include <stdatomic.h>
 #include <string.h>
+#include "conn_policy.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
 #include "host/ble_hs.h"
 #include "host/ble_uuid.h"
+#include "perf_stats.h"
 
 #define TAG "POWER_SVC"
 
@@ -42,21 +48,52 @@ static uint16_t power_measurement_val_handle;
 static uint16_t power_feature_val_handle;
 static uint16_t sensor_location_val_handle;
 
-/* Connection and subscription state */
-static uint16_t power_conn_handle = BLE_HS_CONN_HANDLE_NONE;
-static bool power_notify_enabled = false;
+/* Centrals with power notifications enabled, one entry per connection.
+ * Written by the NimBLE host task (subscribe/disconnect), snapshotted by the
+ * notifying task under s_sub_lock. */
+#define MAX_SUBSCRIBERS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+static uint16_t s_subscribers[MAX_SUBSCRIBERS] = {
+    [0 ... MAX_SUBSCRIBERS - 1] = BLE_HS_CONN_HANDLE_NONE,
+};
+static portMUX_TYPE s_sub_lock = portMUX_INITIALIZER_UNLOCKED;
 
-/* Cycling Power Feature value:
- * Bit 3 (0x08) = Crank Revolution Data Supported
- */
-static const uint8_t power_feature_value[4] = {0x08, 0x00, 0x00, 0x00};
+/* esp_timer time of the RELEASE that produced the notification in flight, or
+ * 0. Set by the notify task before queueing, consumed by the host task on
+ * BLE_GAP_EVENT_NOTIFY_TX. */
+static _Atomic int64_t s_latency_origin_us;
+
+/* Every field stays within the default 23-byte MTU's 20-byte payload */
+_Static_assert(CPM_MAX_LEN <= 20, "Cycling Power Measurement exceeds one ATT_MTU 23 notification");
+
+/* Cycling Power Feature value: the fields in CPM_FIELDS that are built in */
+static const uint8_t power_feature_value[4] = {CPM_FEATURE_BITS & 0xff,
+                                               (CPM_FEATURE_BITS >> 8) & 0xff, 0x00, 0x00};
 
 /* Sensor Location: Left Crank (0x0D) */
 static const uint8_t sensor_location_value = SENSOR_LOCATION_LEFT_CRANK;
 
-/* Crank revolution tracking */
-static uint16_t cumulative_crank_revs = 0;
-static uint16_t last_crank_event_time = 0;
+/* Values behind the measurement fields. Written by the IMU task once per
+ * revolution (crew_balance by the crew publisher), read by the notify task;
+ * updated and copied under s_cpm_lock so a notification never carries a new
+ * count with the old event time. */
+typedef struct {
+  uint16_t crank_revs;
+  uint16_t crank_time;  /* 1/1024 s */
+  uint16_t torque;      /* Accumulated, 1/32 N m */
+  int16_t force_max_n;  /* Over the last revolution */
+  int16_t force_min_n;  /* Lowest boat force, <= 0: slowing into the catch */
+  uint32_t energy_j;    /* Session total (session.h), sent in kJ */
+  int lr_balance;       /* 0.5 %, -1 = none */
+  int crew_balance;     /* 0.5 %, -1 = none */
+} cpm_values_t;
+static cpm_values_t s_cpm = {.lr_balance = -1, .crew_balance = -1};
+static portMUX_TYPE s_cpm_lock = portMUX_INITIALIZER_UNLOCKED;
+static _Atomic int s_strokes_per_rev = 1;
+/* The revolution in progress, IMU task only */
+static int s_strokes_in_rev;
+static float s_rev_energy_j[2];
+static float s_rev_force_n;
+static float s_rev_min_force_n;
 
 /* GATT services table */
 static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
@@ -111,7 +148,8 @@ static int power_measurement_access(uint16_t conn_handle,
  * GATT access callback for Cycling Power Feature characteristic.
  *
  * Handles read operations to retrieve the power meter's supported features.
- * Currently reports support for Crank Revolution Data (bit 3).
+ * The value is built from CPM_FIELDS: the feature bit of every measurement
+ * field compiled in (CPM_SEND_*), so it matches what notifications carry.
  *
  * @param conn_handle BLE connection handle
  * @param attr_handle GATT attribute handle being accessed
@@ -199,93 +237,295 @@ void gatt_svr_register_cb(struct ble_gatt_register_ctxt* ctxt, void* arg) {
   }
 }
 
+/* Add or remove conn_handle from the subscriber table. Returns the number of
+ * subscribers afterwards, or -1 if the table is full. */
+static int set_subscribed(uint16_t conn_handle, bool notify) {
+  int n = 0;
+  bool done = false;
+  portENTER_CRITICAL(&s_sub_lock);
+  for (int i = 0; i < MAX_SUBSCRIBERS; i++) {
+    if (s_subscribers[i] == conn_handle) {
+      if (!notify)
+        s_subscribers[i] = BLE_HS_CONN_HANDLE_NONE;
+      done = true;
+    }
+  }
+  for (int i = 0; i < MAX_SUBSCRIBERS && notify && !done; i++) {
+    if (s_subscribers[i] == BLE_HS_CONN_HANDLE_NONE) {
+      s_subscribers[i] = conn_handle;
+      done = true;
+    }
+  }
+  for (int i = 0; i < MAX_SUBSCRIBERS; i++) n += s_subscribers[i] != BLE_HS_CONN_HANDLE_NONE;
+  portEXIT_CRITICAL(&s_sub_lock);
+  return done || !notify ? n : -1;
+}
+
 /**
- * Set the active BLE connection handle for power notifications.
+ * Forget a closed connection.
  *
- * Updates the connection handle used for sending power measurement
- * notifications. Automatically disables notifications when connection is
- * closed.
+ * NimBLE also reports an unsubscribe on disconnect, but drop the handle here
+ * as well so a stale entry can never outlive its connection.
  *
- * @param conn_handle BLE connection handle, or BLE_HS_CONN_HANDLE_NONE if
- * disconnected
+ * @param conn_handle BLE connection handle that was closed
  */
-void power_service_set_conn_handle(uint16_t conn_handle) {
-  power_conn_handle = conn_handle;
-  if (conn_handle == BLE_HS_CONN_HANDLE_NONE) {
-    power_notify_enabled = false;
-  }
+void power_service_conn_closed(uint16_t conn_handle) {
+  set_subscribed(conn_handle, false);
 }
 
 /**
  * GAP subscription event callback for power measurement notifications.
  *
  * Called when a client subscribes or unsubscribes from power measurement
- * notifications. Updates the notification enabled flag accordingly.
+ * notifications. Adds or removes the connection from the subscriber table.
  *
  * @param event GAP event containing subscription information
  */
 void power_service_subscribe_cb(struct ble_gap_event* event) {
   if (event->subscribe.attr_handle == power_measurement_val_handle) {
-    power_notify_enabled = event->subscribe.cur_notify;
-    ESP_LOGI(TAG, "power measurement notifications %s",
-             power_notify_enabled ? "enabled" : "disabled");
+    bool notify = event->subscribe.cur_notify;
+    int n = set_subscribed(event->subscribe.conn_handle, notify);
+    if (n < 0) {
+      ESP_LOGW(TAG, "conn %d: subscriber table full", event->subscribe.conn_handle);
+      return;
+    }
+    ESP_LOGI(TAG, "power measurement notifications %s for conn %d (%d subscribed)",
+             notify ? "enabled" : "disabled", event->subscribe.conn_handle, n);
+    conn_policy_on_subscribe(event->subscribe.conn_handle, notify);
   }
 }
 
-/**
- * Send a power measurement notification to the connected client.
- *
- * Constructs and sends a Cycling Power Measurement notification containing
- * instantaneous power and simulated crank revolution data. Only sends if
- * a client is connected and has subscribed to notifications.
- *
- * The crank revolution data is currently simulated:
- * - Increments cumulative revolutions by 1 per call
- * - Increments event time by 256 units (1/4 second in 1/1024 second units)
- *
- * @param power_watts Instantaneous power value in watts to send
- */
-void send_power_notification(int16_t power_watts) {
-  if (!power_notify_enabled || power_conn_handle == BLE_HS_CONN_HANDLE_NONE) {
-    return;
+/* ---- measurement fields, one has/put pair per CPM_FIELDS entry ---- */
+
+static inline void put_le16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static inline bool cpm_has_balance(const cpm_values_t* v) {
+  return v->crew_balance >= 0 || v->lr_balance >= 0;
+}
+static inline int cpm_put_balance(uint8_t* p, const cpm_values_t* v) {
+  p[0] = (uint8_t)(v->crew_balance >= 0 ? v->crew_balance : v->lr_balance);
+  return 1;
+}
+
+static inline bool cpm_has_torque(const cpm_values_t* v) {
+  return true;
+}
+static inline int cpm_put_torque(uint8_t* p, const cpm_values_t* v) {
+  put_le16(p, v->torque);
+  return 2;
+}
+
+static inline bool cpm_has_crank(const cpm_values_t* v) {
+  return true;
+}
+static inline int cpm_put_crank(uint8_t* p, const cpm_values_t* v) {
+  put_le16(p, v->crank_revs);
+  put_le16(p + 2, v->crank_time);
+  return 4;
+}
+
+static inline bool cpm_has_force(const cpm_values_t* v) {
+  return v->crank_revs != 0;
+}
+static inline int cpm_put_force(uint8_t* p, const cpm_values_t* v) {
+  put_le16(p, (uint16_t)v->force_max_n);
+  put_le16(p + 2, (uint16_t)v->force_min_n);
+  return 4;
+}
+
+static inline bool cpm_has_energy(const cpm_values_t* v) {
+  return true;
+}
+static inline int cpm_put_energy(uint8_t* p, const cpm_values_t* v) {
+  put_le16(p, (uint16_t)(v->energy_j / 1000));
+  return 2;
+}
+
+/* Encode a measurement into buf (CPM_MAX_LEN bytes). Fields not built in
+ * fold away at compile time. Returns the length. */
+static int build_measurement(uint8_t* buf, int16_t power_watts, const cpm_values_t* v) {
+  uint16_t flags = 0;
+  int len = 4;
+#define CPM_X_PUT(name, flag, feature, bytes, on) \
+  if ((on) && cpm_has_##name(v)) {                \
+    len += cpm_put_##name(buf + len, v);          \
+    flags |= (flag);                              \
+  }
+  CPM_FIELDS(CPM_X_PUT)
+#undef CPM_X_PUT
+  put_le16(buf, flags);
+  put_le16(buf + 2, (uint16_t)power_watts);
+  return len;
+}
+
+/* Build one measurement and queue it to every subscriber. The packet is
+ * encoded into a single mbuf; each extra subscriber gets an os_mbuf_dup() of
+ * it (ble_gatts_notify_custom consumes its mbuf) and the last one gets the
+ * original. Returns 0 if at least one notification was queued. */
+static int notify_power(int16_t power_watts) {
+  uint16_t handles[MAX_SUBSCRIBERS];
+  int n = 0;
+  portENTER_CRITICAL(&s_sub_lock);
+  for (int i = 0; i < MAX_SUBSCRIBERS; i++) {
+    if (s_subscribers[i] != BLE_HS_CONN_HANDLE_NONE)
+      handles[n++] = s_subscribers[i];
+  }
+  portEXIT_CRITICAL(&s_sub_lock);
+  if (n == 0) {
+    return BLE_HS_ENOTCONN;
   }
 
-  cycling_power_measurement_t measurement = {0};
   struct os_mbuf* om;
   int rc;
+  int sent = 0;
 
   /* Build measurement packet */
-  measurement.flags = CPM_FLAG_CRANK_REV_DATA_PRESENT;
-  measurement.instantaneous_power = power_watts;
-  measurement.cumulative_crank_revs = cumulative_crank_revs;
-  measurement.last_crank_event_time = last_crank_event_time;
+  portENTER_CRITICAL(&s_cpm_lock);
+  const cpm_values_t values = s_cpm;
+  portEXIT_CRITICAL(&s_cpm_lock);
+  uint8_t buf[CPM_MAX_LEN];
+  int len = build_measurement(buf, power_watts, &values);
 
   /* Allocate mbuf for notification */
-  om = ble_hs_mbuf_from_flat(&measurement, sizeof(measurement));
+  om = ble_hs_mbuf_from_flat(buf, len);
   if (om == NULL) {
+    perf_count(&g_perf_stats.ble_notify_fail);
     ESP_LOGE(TAG, "failed to allocate mbuf for notification");
-    return;
+    return BLE_HS_ENOMEM;
   }
 
-  /* Send notification */
-  rc = ble_gatts_notify_custom(power_conn_handle, power_measurement_val_handle, om);
-  if (rc != 0) {
-    ESP_LOGE(TAG, "failed to send notification, error code: %d", rc);
-  } else {
-    ESP_LOGD(TAG, "sent power: %d W, revs: %d, time: %d", power_watts, cumulative_crank_revs,
-             last_crank_event_time);
+  /* Fan out */
+  for (int i = 0; i < n; i++) {
+    struct os_mbuf* m = i == n - 1 ? om : os_mbuf_dup(om);
+    if (m == NULL) {
+      perf_count(&g_perf_stats.ble_notify_fail);
+      ESP_LOGE(TAG, "failed to duplicate mbuf for conn %d", handles[i]);
+      continue;
+    }
+    rc = ble_gatts_notify_custom(handles[i], power_measurement_val_handle, m);
+    if (rc != 0) {
+      perf_count(&g_perf_stats.ble_notify_fail);
+      ESP_LOGE(TAG, "failed to send notification to conn %d, error code: %d", handles[i], rc);
+    } else {
+      sent++;
+    }
+  }
+  ESP_LOGD(TAG, "sent power: %d W, revs: %d, time: %d (%d bytes) to %d/%d", power_watts,
+           values.crank_revs, values.crank_time, len, sent, n);
+  return sent > 0 ? 0 : BLE_HS_ENOTCONN;
+}
+
+/**
+ * Send a power measurement notification to the connected client.
+ *
+ * Constructs and sends a Cycling Power Measurement notification containing
+ * instantaneous power and the current crank revolution data to every
+ * connected client that has subscribed to notifications.
+ *
+ * @param power_watts Instantaneous power value in watts to send
+ */
+void send_power_notification(int16_t power_watts) {
+  notify_power(power_watts);
+}
+
+/**
+ * Send the notification for a freshly completed stroke.
+ *
+ * Same packet as send_power_notification(), but the time from release_us to
+ * the controller accepting the packet (BLE_GAP_EVENT_NOTIFY_TX) is recorded
+ * in g_perf_stats.notify_latency_us.
+ *
+ * @param power_watts Power of the stroke in watts
+ * @param release_us esp_timer time of the stroke's RELEASE transition
+ */
+void power_service_notify_stroke(int16_t power_watts, int64_t release_us) {
+  atomic_store(&s_latency_origin_us, release_us);
+  if (notify_power(power_watts) != 0) {
+    atomic_store(&s_latency_origin_us, 0);
   }
 }
 
 /**
- * Update crank revolution data from a real detected stroke.
- * Call this once per detected stroke with the stroke timestamp.
+ * GAP notify-tx event callback.
+ *
+ * Completes the latency measurement started by power_service_notify_stroke()
+ * on the first subscriber to finish. Keepalive repeats carry no origin and are
+ * ignored.
+ *
+ * @param event GAP event of type BLE_GAP_EVENT_NOTIFY_TX
  */
-void power_service_update_crank(int64_t event_time_us) {
-  cumulative_crank_revs++;
+void power_service_notify_tx_cb(struct ble_gap_event* event) {
+  if (event->notify_tx.attr_handle != power_measurement_val_handle ||
+      event->notify_tx.indication) {
+    return;
+  }
+  int64_t origin = atomic_exchange(&s_latency_origin_us, 0);
+  if (origin > 0 && event->notify_tx.status == 0) {
+    perf_hist_record(&g_perf_stats.notify_latency_us,
+                     (uint32_t)(esp_timer_get_time() - origin));
+  }
+}
+
+/**
+ * Update the measurement fields from a real detected stroke.
+ * Call this once per detected stroke. With two strokes per revolution,
+ * every second stroke completes one, and the left/right balance is the
+ * first stroke's share of the pair's energy.
+ */
+void power_service_update_stroke(int64_t catch_us,
+                                 float energy_j,
+                                 float peak_force_n,
+                                 float min_force_n) {
+  int k = s_strokes_in_rev++;
+  if (k < 2)
+    s_rev_energy_j[k] = energy_j;
+  if (k == 0 || peak_force_n > s_rev_force_n)
+    s_rev_force_n = peak_force_n;
+  if (k == 0 || min_force_n < s_rev_min_force_n)
+    s_rev_min_force_n = min_force_n;
+  int per_rev = atomic_load(&s_strokes_per_rev);
+  if (s_strokes_in_rev < per_rev)
+    return;
+  s_strokes_in_rev = 0;
+
+  float rev_j = per_rev == 2 ? s_rev_energy_j[0] + s_rev_energy_j[1] : energy_j;
+  int lr = per_rev == 2 && rev_j > 0.0f ? (int)lrintf(200.0f * s_rev_energy_j[0] / rev_j) : -1;
+  /* Work per revolution is 2 pi times the torque; in 1/32 N m */
+  uint16_t torque = (uint16_t)lrintf(rev_j > 0.0f ? rev_j * 32.0f / (2.0f * (float)M_PI) : 0.0f);
+  int16_t force = s_rev_force_n >= 32767.0f ? 32767 : (int16_t)lrintf(s_rev_force_n);
+  int16_t force_min =
+      s_rev_min_force_n <= -32768.0f ? -32768 : (int16_t)lrintf(s_rev_min_force_n);
   /* Convert microseconds to 1/1024 second units (wraps naturally as uint16) */
-  last_crank_event_time = (uint16_t)(event_time_us * 1024 / 1000000);
-  ESP_LOGD(TAG, "crank update: revs=%d time=%d", cumulative_crank_revs, last_crank_event_time);
+  uint16_t t = (uint16_t)(catch_us * 1024 / 1000000);
+
+  portENTER_CRITICAL(&s_cpm_lock);
+  uint16_t revs = ++s_cpm.crank_revs;
+  s_cpm.crank_time = t;
+  s_cpm.torque += torque;
+  s_cpm.force_max_n = force;
+  s_cpm.force_min_n = force_min;
+  s_cpm.lr_balance = lr;
+  portEXIT_CRITICAL(&s_cpm_lock);
+  ESP_LOGD(TAG, "crank update: revs=%d time=%d", revs, t);
+}
+
+void power_service_set_strokes_per_rev(int n) {
+  atomic_store(&s_strokes_per_rev, n == 2 ? 2 : 1);
+}
+
+void power_service_set_energy(uint32_t energy_j) {
+  portENTER_CRITICAL(&s_cpm_lock);
+  s_cpm.energy_j = energy_j;
+  portEXIT_CRITICAL(&s_cpm_lock);
+}
+
+void power_service_set_balance(int balance) {
+  portENTER_CRITICAL(&s_cpm_lock);
+  s_cpm.crew_balance = balance < 0 ? -1 : balance > 200 ? 200 : balance;
+  portEXIT_CRITICAL(&s_cpm_lock);
 }
 
 /**
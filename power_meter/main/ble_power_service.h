@@ -13,28 +13,92 @@
 #define SENSOR_LOCATION_UUID 0x2A5D
 
 /* Cycling Power Measurement Flags */
+#define CPM_FLAG_PEDAL_BALANCE_PRESENT 0x0001
+#define CPM_FLAG_ACC_TORQUE_PRESENT 0x0004
+#define CPM_FLAG_ACC_TORQUE_SOURCE_CRANK 0x0008
 #define CPM_FLAG_CRANK_REV_DATA_PRESENT 0x0020
+#define CPM_FLAG_EXTREME_FORCE_PRESENT 0x0040
+#define CPM_FLAG_ACC_ENERGY_PRESENT 0x0800
+
+/* Cycling Power Feature bits */
+#define CPF_PEDAL_BALANCE 0x0001
+#define CPF_ACC_TORQUE 0x0002
+#define CPF_CRANK_REV 0x0008
+#define CPF_EXTREME_MAGNITUDES 0x0010 /* Force: context bit 16 stays 0 */
+#define CPF_ACC_ENERGY 0x0080
+
+/* Optional Measurement fields to build in. A field set to 0 costs no bytes
+ * on the air and no code. */
+#ifndef CPM_SEND_BALANCE
+#define CPM_SEND_BALANCE 1 /* Crew seat share, or left/right with 2 strokes per rev */
+#endif
+#ifndef CPM_SEND_TORQUE
+#define CPM_SEND_TORQUE 1 /* Accumulated crank torque, stroke energy / 2 pi */
+#endif
+#ifndef CPM_SEND_EXTREME_FORCE
+#define CPM_SEND_EXTREME_FORCE 1 /* Peak and lowest boat force over the revolution */
+#endif
+#ifndef CPM_SEND_ENERGY
+#define CPM_SEND_ENERGY 1 /* Accumulated energy, kJ */
+#endif
+
+/* Optional fields in packet order, after flags and instantaneous power:
+ *   X(name, measurement flags, feature bit, bytes, built in) */
+#define CPM_FIELDS(X)                                                                   \
+  X(balance, CPM_FLAG_PEDAL_BALANCE_PRESENT, CPF_PEDAL_BALANCE, 1, CPM_SEND_BALANCE)   \
+  X(torque, CPM_FLAG_ACC_TORQUE_PRESENT | CPM_FLAG_ACC_TORQUE_SOURCE_CRANK, CPF_ACC_TORQUE, \
+    2, CPM_SEND_TORQUE)                                                                 \
+  X(crank, CPM_FLAG_CRANK_REV_DATA_PRESENT, CPF_CRANK_REV, 4, 1)                        \
+  X(force, CPM_FLAG_EXTREME_FORCE_PRESENT, CPF_EXTREME_MAGNITUDES, 4, CPM_SEND_EXTREME_FORCE) \
+  X(energy, CPM_FLAG_ACC_ENERGY_PRESENT, CPF_ACC_ENERGY, 2, CPM_SEND_ENERGY)
+
+#define CPM_X_FEATURE(name, flag, feature, bytes, on) | ((on) ? (feature) : 0)
+#define CPM_X_BYTES(name, flag, feature, bytes, on) +((on) ? (bytes) : 0)
+/* Cycling Power Feature value: exactly the fields built in */
+#define CPM_FEATURE_BITS (0 CPM_FIELDS(CPM_X_FEATURE))
+/* Longest measurement: flags, power, then every field built in */
+#define CPM_MAX_LEN (4 CPM_FIELDS(CPM_X_BYTES))
 
 /* Sensor Location Values */
 #define SENSOR_LOCATION_LEFT_CRANK 0x0D
 
-/* Power Measurement Data Structure (8 bytes) */
-typedef struct {
-  uint16_t flags;                 /* Feature flags */
-  int16_t instantaneous_power;    /* Watts */
-  uint16_t cumulative_crank_revs; /* Cumulative crank revolutions */
-  uint16_t last_crank_event_time; /* 1/1024 second resolution */
-} __attribute__((packed)) cycling_power_measurement_t;
-
 /* Public function declarations */
 int power_service_init(void);
-void power_service_set_conn_handle(uint16_t conn_handle);
+void power_service_conn_closed(uint16_t conn_handle);
 void power_service_subscribe_cb(struct ble_gap_event* event);
 void gatt_svr_register_cb(struct ble_gatt_register_ctxt* ctxt, void* arg);
 void send_power_notification(int16_t power_watts);
 
-/* Update crank revolution data from real stroke detection.
- * event_time_us: stroke timestamp from esp_timer_get_time() */
-void power_service_update_crank(int64_t event_time_us);
+/* Notify a completed stroke and time RELEASE -> NOTIFY_TX completion.
+ * release_us: stroke_event_t.release_us (esp_timer_get_time() time base) */
+void power_service_notify_stroke(int16_t power_watts, int64_t release_us);
+void power_service_notify_tx_cb(struct ble_gap_event* event);
+
+/* Update the per-stroke measurement fields from a confirmed stroke. IMU task.
+ *   catch_us     stroke_event_t.catch_exact_us (esp_timer_get_time() time
+ *                base), so cadence follows catch-to-catch timing, not
+ *                confirmation
+ *   energy_j     stroke energy (power over the drive times its duration)
+ *   peak_force_n mass times peak dynamic acceleration
+ *   min_force_n  lowest boat force since the previous stroke (<= 0, N),
+ *                from imu_power_update_block() */
+void power_service_update_stroke(int64_t catch_us,
+                                 float energy_j,
+                                 float peak_force_n,
+                                 float min_force_n);
+
+/* Strokes per crank revolution: 1 (default), or 2 to count a left + right
+ * pair of a double-blade paddle as one. Any task. */
+void power_service_set_strokes_per_rev(int n);
+
+/* Accumulated energy for the following notifications (J, sent in kJ): the
+ * session total, so it carries over a reset that continues the session.
+ * Any task. */
+void power_service_set_energy(uint32_t energy_j);
+
+/* Crew pedal power balance for the following notifications, 0-200 in 0.5 %
+ * (reference unknown), or -1 to leave it out. Takes precedence over the
+ * left/right balance. Any task. */
+void power_service_set_balance(int balance);
 
 #endif  // BLE_POWER_SERVICE_H
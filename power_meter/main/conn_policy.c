@@ -0,0 +1,170 @@
+#include "conn_policy.h"
+#include <stdatomic.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "host/ble_hs.h"
+
+#define TAG "CONN_POLICY"
+#define MAX_CONNS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+
+typedef enum {
+  MODE_NONE,
+  MODE_IDLE,
+  MODE_ACTIVE,
+} conn_mode_t;
+
+typedef struct {
+  uint16_t handle; /* BLE_HS_CONN_HANDLE_NONE = free slot */
+  bool subscribed;
+  bool streaming;   /* IMU stream: active parameters whatever s_active says */
+  bool retry;       /* Last request hit BLE_HS_EALREADY; resend on CONN_UPDATE */
+  conn_mode_t mode; /* Last mode successfully requested */
+} conn_slot_t;
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static conn_slot_t s_slots[MAX_CONNS] = {
+    [0 ... MAX_CONNS - 1] = {.handle = BLE_HS_CONN_HANDLE_NONE},
+};
+/* Start active: a fresh subscriber is usually about to paddle */
+static _Atomic bool s_active = true;
+static int64_t s_fast_adv_until_us;
+
+static conn_slot_t* find_slot(uint16_t handle) {
+  for (int i = 0; i < MAX_CONNS; i++) {
+    if (s_slots[i].handle == handle)
+      return &s_slots[i];
+  }
+  return NULL;
+}
+
+/* Issue the update for one connection. Host lock is taken by NimBLE, so this
+ * must not run inside s_lock. */
+static void request(uint16_t handle, bool active) {
+  struct ble_gap_upd_params params = {
+      .itvl_min = BLE_GAP_CONN_ITVL_MS(active ? CONN_POLICY_ACTIVE_ITVL_MIN_MS
+                                              : CONN_POLICY_IDLE_ITVL_MIN_MS),
+      .itvl_max = BLE_GAP_CONN_ITVL_MS(active ? CONN_POLICY_ACTIVE_ITVL_MAX_MS
+                                              : CONN_POLICY_IDLE_ITVL_MAX_MS),
+      .latency = active ? CONN_POLICY_ACTIVE_LATENCY : CONN_POLICY_IDLE_LATENCY,
+      .supervision_timeout = BLE_GAP_SUPERVISION_TIMEOUT_MS(
+          active ? CONN_POLICY_ACTIVE_TIMEOUT_MS : CONN_POLICY_IDLE_TIMEOUT_MS),
+  };
+  int rc = ble_gap_update_params(handle, &params);
+
+  portENTER_CRITICAL(&s_lock);
+  conn_slot_t* slot = find_slot(handle);
+  if (slot) {
+    slot->retry = rc == BLE_HS_EALREADY;
+    if (rc == 0)
+      slot->mode = active ? MODE_ACTIVE : MODE_IDLE;
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  if (rc == 0) {
+    ESP_LOGI(TAG, "conn %d: requesting %s parameters", handle, active ? "active" : "idle");
+  } else if (rc != BLE_HS_EALREADY) {
+    ESP_LOGW(TAG, "conn %d: ble_gap_update_params failed: %d", handle, rc);
+  }
+}
+
+/* Mode a tracked connection should be in */
+static bool want_active(const conn_slot_t* slot, bool active) {
+  return active || slot->streaming;
+}
+
+void conn_policy_on_connect(uint16_t conn_handle) {
+  portENTER_CRITICAL(&s_lock);
+  conn_slot_t* slot = find_slot(BLE_HS_CONN_HANDLE_NONE);
+  if (slot)
+    *slot = (conn_slot_t){.handle = conn_handle};
+  portEXIT_CRITICAL(&s_lock);
+  if (!slot)
+    ESP_LOGW(TAG, "conn %d: no policy slot", conn_handle);
+}
+
+void conn_policy_on_disconnect(uint16_t conn_handle) {
+  portENTER_CRITICAL(&s_lock);
+  conn_slot_t* slot = find_slot(conn_handle);
+  if (slot)
+    slot->handle = BLE_HS_CONN_HANDLE_NONE;
+  portEXIT_CRITICAL(&s_lock);
+}
+
+void conn_policy_on_subscribe(uint16_t conn_handle, bool notify) {
+  portENTER_CRITICAL(&s_lock);
+  conn_slot_t* slot = find_slot(conn_handle);
+  bool send = slot && notify && !slot->subscribed && !slot->streaming;
+  bool active = slot && want_active(slot, atomic_load(&s_active));
+  if (slot)
+    slot->subscribed = notify;
+  portEXIT_CRITICAL(&s_lock);
+
+  if (send)
+    request(conn_handle, active);
+}
+
+void conn_policy_on_stream(uint16_t conn_handle, bool streaming) {
+  bool active = atomic_load(&s_active);
+  portENTER_CRITICAL(&s_lock);
+  conn_slot_t* slot = find_slot(conn_handle);
+  /* Stopping a stream only matters if power notifications keep the link
+   * managed and the paddler is idle */
+  bool send = slot && streaming != slot->streaming && (streaming || (slot->subscribed && !active));
+  if (slot)
+    slot->streaming = streaming;
+  portEXIT_CRITICAL(&s_lock);
+
+  if (send)
+    request(conn_handle, streaming || active);
+}
+
+void conn_policy_on_conn_update(uint16_t conn_handle, int status) {
+  if (status != 0)
+    ESP_LOGW(TAG, "conn %d: parameter update rejected: %d", conn_handle, status);
+
+  bool active = atomic_load(&s_active);
+  portENTER_CRITICAL(&s_lock);
+  conn_slot_t* slot = find_slot(conn_handle);
+  /* Also catch a set_active() that raced with the update that just finished */
+  bool want = slot && want_active(slot, active);
+  bool send = slot && (slot->subscribed || slot->streaming) &&
+              (slot->retry || slot->mode != (want ? MODE_ACTIVE : MODE_IDLE));
+  portEXIT_CRITICAL(&s_lock);
+
+  if (send)
+    request(conn_handle, want);
+}
+
+void conn_policy_set_active(bool active) {
+  if (atomic_exchange(&s_active, active) == active)
+    return;
+
+  uint16_t handles[MAX_CONNS];
+  int n = 0;
+  portENTER_CRITICAL(&s_lock);
+  for (int i = 0; i < MAX_CONNS; i++) {
+    if (s_slots[i].handle != BLE_HS_CONN_HANDLE_NONE && s_slots[i].subscribed &&
+        !s_slots[i].streaming)
+      handles[n++] = s_slots[i].handle;
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  for (int i = 0; i < n; i++) request(handles[i], active);
+}
+
+int32_t conn_policy_adv_params(struct ble_gap_adv_params* params, bool fast) {
+  int64_t now = esp_timer_get_time();
+  if (fast)
+    s_fast_adv_until_us = now + (int64_t)CONN_POLICY_FAST_ADV_MS * 1000;
+
+  int64_t remaining_ms = (s_fast_adv_until_us - now) / 1000;
+  if (remaining_ms > 0) {
+    params->itvl_min = BLE_GAP_ADV_ITVL_MS(CONN_POLICY_FAST_ADV_ITVL_MIN_MS);
+    params->itvl_max = BLE_GAP_ADV_ITVL_MS(CONN_POLICY_FAST_ADV_ITVL_MAX_MS);
+    return (int32_t)remaining_ms;
+  }
+  params->itvl_min = BLE_GAP_ADV_ITVL_MS(CONN_POLICY_SLOW_ADV_ITVL_MIN_MS);
+  params->itvl_max = BLE_GAP_ADV_ITVL_MS(CONN_POLICY_SLOW_ADV_ITVL_MAX_MS);
+  return BLE_HS_FOREVER;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "host/ble_gap.h"
+
+/* BLE link timing policy.
+ *
+ * Centrals (Garmin in particular) pick slow connection intervals when left to
+ * themselves. Once a client subscribes to power notifications we ask for a
+ * short interval so a stroke reaches the watch within one or two connection
+ * events. When the paddler stops (the power zero timeout fires) we switch to
+ * a long interval with slave latency, and we switch back on the next stroke.
+ * A connection streaming IMU samples stays on the active interval throughout.
+ *
+ * Advertising runs fast for CONN_POLICY_FAST_ADV_MS after boot or a
+ * disconnect, then drops to a slow interval until someone connects.
+ *
+ * All functions may be called from any task; the NimBLE host API serialises
+ * the actual procedures. */
+
+/* Active: 15–30 ms, no latency, 4 s supervision timeout */
+#define CONN_POLICY_ACTIVE_ITVL_MIN_MS 15
+#define CONN_POLICY_ACTIVE_ITVL_MAX_MS 30
+#define CONN_POLICY_ACTIVE_LATENCY 0
+#define CONN_POLICY_ACTIVE_TIMEOUT_MS 4000
+/* Idle: 200–400 ms with 4 skipped events, so the peripheral wakes every ~2 s
+ * at most; 6 s supervision timeout stays above (1 + latency) * itvl * 2 */
+#define CONN_POLICY_IDLE_ITVL_MIN_MS 200
+#define CONN_POLICY_IDLE_ITVL_MAX_MS 400
+#define CONN_POLICY_IDLE_LATENCY 4
+#define CONN_POLICY_IDLE_TIMEOUT_MS 6000
+
+/* Advertising: fast window after boot/disconnect, then slow */
+#define CONN_POLICY_FAST_ADV_MS 30000
+#define CONN_POLICY_FAST_ADV_ITVL_MIN_MS 30
+#define CONN_POLICY_FAST_ADV_ITVL_MAX_MS 60
+#define CONN_POLICY_SLOW_ADV_ITVL_MIN_MS 1000
+#define CONN_POLICY_SLOW_ADV_ITVL_MAX_MS 1200
+
+/* GAP connection lifecycle (gap.c) */
+void conn_policy_on_connect(uint16_t conn_handle);
+void conn_policy_on_disconnect(uint16_t conn_handle);
+/* Power notifications were enabled/disabled: subscribers get the current mode */
+void conn_policy_on_subscribe(uint16_t conn_handle, bool notify);
+/* IMU stream started/stopped (ble_imu_stream_service.c): holds the active parameters */
+void conn_policy_on_stream(uint16_t conn_handle, bool streaming);
+/* BLE_GAP_EVENT_CONN_UPDATE: retries a request that collided with another one */
+void conn_policy_on_conn_update(uint16_t conn_handle, int status);
+
+/* Switch every tracked connection to active (paddling) or idle parameters.
+ * Cheap to call repeatedly; only a change of mode issues a request. */
+void conn_policy_set_active(bool active);
+
+/* Fill advertising intervals for the next ble_gap_adv_start() and return its
+ * duration in ms (BLE_HS_FOREVER once the fast window is over). fast = true
+ * starts a new fast window (boot, disconnect). */
+int32_t conn_policy_adv_params(struct ble_gap_adv_params* params, bool fast);
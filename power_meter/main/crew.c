@@ -0,0 +1,431 @@
+#include "crew.h"
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ble_control_service.h"
+#include "ble_power_service.h"
+#include "conn_policy.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "gap.h"
+#include "host/ble_hs.h"
+
+#define TAG "CREW"
+
+/* Passive scan, 30 ms of every 100 ms (0.625 ms units), only while a seat
+ * slot is free */
+#define SCAN_ITVL 160
+#define SCAN_WINDOW 48
+#define CONNECT_TIMEOUT_MS 5000
+
+typedef struct {
+  uint16_t conn_handle; /* BLE_HS_CONN_HANDLE_NONE = free */
+  uint16_t val_handle;  /* Seat stroke value, 0 until discovered */
+  ble_addr_t addr;
+  int64_t offset_us[CREW_OFFSET_WINDOW]; /* Arrival - sent_ms, per stroke */
+  int n_offsets;
+  int offset_idx;
+  bool subscribed;
+  int last_seq; /* -1 until the first stroke */
+} crew_peer_t;
+
+/* Strokes waiting for the rest of the crew */
+typedef struct {
+  bool open;
+  int64_t catch_us;  /* First catch of the group, local clock */
+  int64_t opened_us; /* Arrival of its first stroke */
+  uint32_t mask;
+  float power_w[CREW_MAX_SEATS];
+  float rate_spm[CREW_MAX_SEATS];
+} crew_group_t;
+
+static crew_publish_cb_t s_publish_cb;
+static _Atomic bool s_enabled;
+static _Atomic bool s_synced;
+/* Seat 0 plus every subscribed peer */
+static _Atomic uint32_t s_seat_mask = 1;
+
+/* Peer table: written by the NimBLE host task, snapshotted by others. Free
+ * from the start, so crew_peer_count() is right even if crew_init() never
+ * runs (demo build). */
+static crew_peer_t s_peers[CREW_MAX_PEERS] = {
+    [0 ... CREW_MAX_PEERS - 1] = {.conn_handle = BLE_HS_CONN_HANDLE_NONE},
+};
+static portMUX_TYPE s_peer_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Group: IMU task (seat 0), host task (peers), esp_timer task (timeout) */
+static crew_group_t s_group;
+static uint32_t s_stroke_count;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_timer;
+
+static const ble_uuid128_t seat_stroke_chr_uuid = CONTROL_UUID128_INIT(CONTROL_SEAT_STROKE_ID);
+
+static int crew_gap_event(struct ble_gap_event* event, void* arg);
+
+/* ---- merging ---- */
+
+/* Close the open group into *out. Under s_lock. */
+static void take_group(crew_stroke_t* out) {
+  memset(out, 0, sizeof(*out));
+  out->seat_mask = s_group.mask;
+  out->stroke_rate_spm = -1.0f;
+  for (int s = 0; s < CREW_MAX_SEATS; s++) {
+    if (!(s_group.mask & (1u << s)))
+      continue;
+    out->seat_power_w[s] = s_group.power_w[s];
+    out->power_w += s_group.power_w[s];
+    if (out->stroke_rate_spm < 0.0f)
+      out->stroke_rate_spm = s_group.rate_spm[s];
+  }
+  out->balance = (s_group.mask & 1u) && (s_group.mask & ~1u) && out->power_w > 0.0f
+                     ? (int)lrintf(200.0f * s_group.power_w[0] / out->power_w)
+                     : -1;
+  out->stroke_count = ++s_stroke_count;
+  s_group.open = false;
+}
+
+static void add_stroke(int seat, int64_t catch_us, float power_w, float rate_spm) {
+  crew_stroke_t out[2];
+  int n = 0;
+  bool arm = false;
+  int64_t now = esp_timer_get_time();
+
+  portENTER_CRITICAL(&s_lock);
+  /* A seat's second stroke, or one too far from the group, starts the next */
+  if (s_group.open &&
+      ((s_group.mask & (1u << seat)) || llabs(catch_us - s_group.catch_us) > CREW_ALIGN_US))
+    take_group(&out[n++]);
+  if (!s_group.open) {
+    s_group = (crew_group_t){.open = true, .catch_us = catch_us, .opened_us = now};
+    arm = true;
+  }
+  s_group.mask |= 1u << seat;
+  s_group.power_w[seat] = power_w;
+  s_group.rate_spm[seat] = rate_spm;
+  uint32_t expected = atomic_load(&s_seat_mask);
+  if ((s_group.mask & expected) == expected) {
+    take_group(&out[n++]);
+    arm = false;
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  if (arm) {
+    esp_timer_stop(s_timer);
+    esp_timer_start_once(s_timer, CREW_MERGE_TIMEOUT_US);
+  }
+  for (int i = 0; i < n; i++) s_publish_cb(&out[i]);
+}
+
+/* esp_timer task: publish whatever arrived. The timer may belong to a group
+ * already closed; a younger one gets re-armed for its own deadline. */
+static void on_merge_timeout(void* arg) {
+  crew_stroke_t out;
+  bool got = false;
+  int64_t wait_us = 0;
+
+  portENTER_CRITICAL(&s_lock);
+  if (s_group.open) {
+    int64_t age_us = esp_timer_get_time() - s_group.opened_us;
+    if (age_us >= CREW_MERGE_TIMEOUT_US - 1000) {
+      ESP_LOGD(TAG, "Group timed out, seats 0x%lx", (unsigned long)s_group.mask);
+      take_group(&out);
+      got = true;
+    } else {
+      wait_us = CREW_MERGE_TIMEOUT_US - age_us;
+    }
+  }
+  portEXIT_CRITICAL(&s_lock);
+
+  if (wait_us > 0)
+    esp_timer_start_once(s_timer, wait_us);
+  if (got)
+    s_publish_cb(&out);
+}
+
+/* ---- peers (NimBLE host task) ---- */
+
+static crew_peer_t* find_peer(uint16_t conn_handle) {
+  for (int i = 0; i < CREW_MAX_PEERS; i++)
+    if (s_peers[i].conn_handle == conn_handle)
+      return &s_peers[i];
+  return NULL;
+}
+
+static void update_seat_mask(void) {
+  uint32_t mask = 1;
+  portENTER_CRITICAL(&s_peer_lock);
+  for (int i = 0; i < CREW_MAX_PEERS; i++)
+    if (s_peers[i].conn_handle != BLE_HS_CONN_HANDLE_NONE && s_peers[i].subscribed)
+      mask |= 1u << (i + 1);
+  portEXIT_CRITICAL(&s_peer_lock);
+  atomic_store(&s_seat_mask, mask);
+}
+
+static void on_seat_stroke(crew_peer_t* peer, const control_stroke_msg_t* msg, int64_t rx_us) {
+  /* Offset of the peer's clock: the least-delayed of the recent strokes */
+  peer->offset_us[peer->offset_idx] = rx_us - (int64_t)msg->sent_ms * 1000;
+  peer->offset_idx = (peer->offset_idx + 1) % CREW_OFFSET_WINDOW;
+  if (peer->n_offsets < CREW_OFFSET_WINDOW)
+    peer->n_offsets++;
+  int64_t offset_us = peer->offset_us[0];
+  for (int i = 1; i < peer->n_offsets; i++)
+    if (peer->offset_us[i] < offset_us)
+      offset_us = peer->offset_us[i];
+
+  /* A read after the notification repeats it */
+  if (msg->seq == peer->last_seq)
+    return;
+  peer->last_seq = msg->seq;
+
+  int seat = (int)(peer - s_peers) + 1;
+  int64_t catch_us = (int64_t)msg->catch_ms * 1000 + offset_us;
+  ESP_LOGD(TAG, "Seat %d: %u W, catch %+lld ms from now", seat, msg->power_w,
+           (long long)(catch_us - rx_us) / 1000);
+  add_stroke(seat, catch_us, msg->power_w, msg->rate_cspm / 100.0f);
+}
+
+static bool is_power_meter(const struct ble_gap_disc_desc* disc) {
+  if (disc->event_type != BLE_HCI_ADV_RPT_EVTYPE_ADV_IND)
+    return false;
+  struct ble_hs_adv_fields fields;
+  if (ble_hs_adv_parse_fields(&fields, disc->data, disc->length_data) != 0)
+    return false;
+  if (fields.name_len != strlen(DEVICE_NAME) ||
+      memcmp(fields.name, DEVICE_NAME, fields.name_len) != 0)
+    return false;
+  for (int i = 0; i < fields.num_uuids16; i++)
+    if (ble_uuid_u16(&fields.uuids16[i].u) == CYCLING_POWER_SVC_UUID)
+      return true;
+  return false;
+}
+
+static void start_scan(void) {
+  if (!atomic_load(&s_enabled) || !atomic_load(&s_synced) || ble_gap_disc_active() ||
+      ble_gap_conn_active() || crew_peer_count() >= CREW_MAX_PEERS)
+    return;
+  const struct ble_gap_disc_params params = {
+      .itvl = SCAN_ITVL,
+      .window = SCAN_WINDOW,
+      .passive = 1,
+      .filter_duplicates = 1,
+  };
+  int rc = ble_gap_disc(gap_own_addr_type(), BLE_HS_FOREVER, &params, crew_gap_event, NULL);
+  if (rc != 0)
+    ESP_LOGW(TAG, "failed to start scanning: %d", rc);
+}
+
+static void connect_to(const ble_addr_t* addr) {
+  for (int i = 0; i < CREW_MAX_PEERS; i++)
+    if (s_peers[i].conn_handle != BLE_HS_CONN_HANDLE_NONE &&
+        ble_addr_cmp(&s_peers[i].addr, addr) == 0)
+      return;
+
+  ble_gap_disc_cancel();
+  /* The link carries strokes, so start at the active interval right away */
+  const struct ble_gap_conn_params params = {
+      .scan_itvl = SCAN_ITVL,
+      .scan_window = SCAN_WINDOW,
+      .itvl_min = BLE_GAP_CONN_ITVL_MS(CONN_POLICY_ACTIVE_ITVL_MIN_MS),
+      .itvl_max = BLE_GAP_CONN_ITVL_MS(CONN_POLICY_ACTIVE_ITVL_MAX_MS),
+      .latency = CONN_POLICY_ACTIVE_LATENCY,
+      .supervision_timeout = BLE_GAP_SUPERVISION_TIMEOUT_MS(CONN_POLICY_ACTIVE_TIMEOUT_MS),
+  };
+  int rc = ble_gap_connect(gap_own_addr_type(), addr, CONNECT_TIMEOUT_MS, &params,
+                           crew_gap_event, NULL);
+  if (rc != 0) {
+    ESP_LOGW(TAG, "failed to connect: %d", rc);
+    start_scan();
+  }
+}
+
+static int on_subscribed(uint16_t conn_handle,
+                         const struct ble_gatt_error* error,
+                         struct ble_gatt_attr* attr,
+                         void* arg) {
+  crew_peer_t* peer = find_peer(conn_handle);
+  if (peer == NULL)
+    return 0;
+  if (error->status != 0) {
+    ESP_LOGW(TAG, "conn %d: subscribe failed: %d", conn_handle, error->status);
+    ble_gap_terminate(conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+    return 0;
+  }
+  peer->subscribed = true;
+  update_seat_mask();
+  ESP_LOGI(TAG, "Seat %d joined (conn %d)", (int)(peer - s_peers) + 1, conn_handle);
+  start_scan();
+  return 0;
+}
+
+/* Descriptors after the seat stroke value, up to the next declaration */
+static int on_dsc(uint16_t conn_handle,
+                  const struct ble_gatt_error* error,
+                  uint16_t chr_val_handle,
+                  const struct ble_gatt_dsc* dsc,
+                  void* arg) {
+  crew_peer_t* peer = find_peer(conn_handle);
+  if (peer == NULL)
+    return 0;
+  if (error->status == 0) {
+    uint16_t type = ble_uuid_u16(&dsc->uuid.u);
+    if (type == BLE_GATT_DSC_CLT_CFG_UUID16) {
+      static const uint8_t notify_on[2] = {0x01, 0x00};
+      if (ble_gattc_write_flat(conn_handle, dsc->handle, notify_on, sizeof(notify_on),
+                               on_subscribed, NULL) != 0)
+        ble_gap_terminate(conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+      /* Nonzero ends the procedure */
+      return BLE_HS_EDONE;
+    }
+    if (type != BLE_ATT_UUID_CHARACTERISTIC && type != BLE_ATT_UUID_PRIMARY_SERVICE &&
+        type != BLE_ATT_UUID_SECONDARY_SERVICE)
+      return 0;
+  }
+  /* The next characteristic or service, the end of the table, or an error:
+   * the value had no CCCD */
+  ESP_LOGW(TAG, "conn %d: seat stroke has no CCCD (%d)", conn_handle, error->status);
+  peer->val_handle = 0;
+  ble_gap_terminate(conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+  return BLE_HS_EDONE;
+}
+
+static int on_chr(uint16_t conn_handle,
+                  const struct ble_gatt_error* error,
+                  const struct ble_gatt_chr* chr,
+                  void* arg) {
+  crew_peer_t* peer = find_peer(conn_handle);
+  if (peer == NULL)
+    return 0;
+  if (error->status == 0) {
+    peer->val_handle = chr->val_handle;
+    return 0;
+  }
+  if (error->status == BLE_HS_EDONE && peer->val_handle != 0 &&
+      ble_gattc_disc_all_dscs(conn_handle, peer->val_handle, 0xffff, on_dsc, NULL) == 0)
+    return 0;
+  ESP_LOGW(TAG, "conn %d: no seat stroke characteristic (%d)", conn_handle, error->status);
+  peer->val_handle = 0;
+  ble_gap_terminate(conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+  return 0;
+}
+
+static void on_connected(uint16_t conn_handle) {
+  struct ble_gap_conn_desc desc;
+  crew_peer_t* peer = NULL;
+  if (ble_gap_conn_find(conn_handle, &desc) == 0) {
+    portENTER_CRITICAL(&s_peer_lock);
+    peer = find_peer(BLE_HS_CONN_HANDLE_NONE);
+    if (peer)
+      *peer = (crew_peer_t){.conn_handle = conn_handle, .addr = desc.peer_id_addr, .last_seq = -1};
+    portEXIT_CRITICAL(&s_peer_lock);
+  }
+  if (peer == NULL ||
+      ble_gattc_disc_chrs_by_uuid(conn_handle, 1, 0xffff, &seat_stroke_chr_uuid.u, on_chr,
+                                  NULL) != 0)
+    ble_gap_terminate(conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+}
+
+static int crew_gap_event(struct ble_gap_event* event, void* arg) {
+  switch (event->type) {
+    case BLE_GAP_EVENT_DISC:
+      if (is_power_meter(&event->disc))
+        connect_to(&event->disc.addr);
+      return 0;
+
+    case BLE_GAP_EVENT_DISC_COMPLETE:
+      start_scan();
+      return 0;
+
+    case BLE_GAP_EVENT_CONNECT:
+      if (event->connect.status == 0) {
+        on_connected(event->connect.conn_handle);
+      } else {
+        ESP_LOGW(TAG, "connection to seat failed: %d", event->connect.status);
+        start_scan();
+      }
+      return 0;
+
+    case BLE_GAP_EVENT_DISCONNECT: {
+      crew_peer_t* peer = find_peer(event->disconnect.conn.conn_handle);
+      if (peer) {
+        ESP_LOGI(TAG, "Seat %d left; reason=%d", (int)(peer - s_peers) + 1,
+                 event->disconnect.reason);
+        portENTER_CRITICAL(&s_peer_lock);
+        peer->conn_handle = BLE_HS_CONN_HANDLE_NONE;
+        peer->subscribed = false;
+        portEXIT_CRITICAL(&s_peer_lock);
+        update_seat_mask();
+        /* The seat's slot is free again; gap.c stopped advertising while
+         * every slot was taken */
+        gap_resume_advertising();
+      }
+      start_scan();
+      return 0;
+    }
+
+    case BLE_GAP_EVENT_NOTIFY_RX: {
+      int64_t rx_us = esp_timer_get_time();
+      crew_peer_t* peer = find_peer(event->notify_rx.conn_handle);
+      control_stroke_msg_t msg;
+      uint16_t len;
+      if (peer && event->notify_rx.attr_handle == peer->val_handle &&
+          ble_hs_mbuf_to_flat(event->notify_rx.om, &msg, sizeof(msg), &len) == 0 &&
+          len == sizeof(msg))
+        on_seat_stroke(peer, &msg, rx_us);
+      return 0;
+    }
+  }
+  return 0;
+}
+
+/* ---- public ---- */
+
+void crew_init(crew_publish_cb_t cb) {
+  s_publish_cb = cb;
+  const esp_timer_create_args_t args = {.callback = on_merge_timeout, .name = "crew"};
+  ESP_ERROR_CHECK(esp_timer_create(&args, &s_timer));
+}
+
+void crew_set_enabled(bool on) {
+  if (atomic_exchange(&s_enabled, on) == on)
+    return;
+  ESP_LOGI(TAG, "Crew aggregation %s", on ? "ON" : "OFF");
+  if (on) {
+    start_scan();
+    return;
+  }
+
+  ble_gap_disc_cancel();
+  uint16_t handles[CREW_MAX_PEERS];
+  int n = 0;
+  portENTER_CRITICAL(&s_peer_lock);
+  for (int i = 0; i < CREW_MAX_PEERS; i++)
+    if (s_peers[i].conn_handle != BLE_HS_CONN_HANDLE_NONE)
+      handles[n++] = s_peers[i].conn_handle;
+  portEXIT_CRITICAL(&s_peer_lock);
+  for (int i = 0; i < n; i++) ble_gap_terminate(handles[i], BLE_ERR_REM_USER_CONN_TERM);
+  power_service_set_balance(-1);
+}
+
+bool crew_enabled(void) {
+  return atomic_load(&s_enabled);
+}
+
+void crew_on_sync(void) {
+  atomic_store(&s_synced, true);
+  start_scan();
+}
+
+int crew_peer_count(void) {
+  int n = 0;
+  portENTER_CRITICAL(&s_peer_lock);
+  for (int i = 0; i < CREW_MAX_PEERS; i++) n += s_peers[i].conn_handle != BLE_HS_CONN_HANDLE_NONE;
+  portEXIT_CRITICAL(&s_peer_lock);
+  return n;
+}
+
+void crew_local_stroke(int64_t catch_us, float power_w, float rate_spm) {
+  add_stroke(0, catch_us, power_w, rate_spm);
+}
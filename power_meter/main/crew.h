@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "host/ble_gap.h"
+
+/* Crew aggregation: one unit combines the paddles of a C2/K2 into one power
+ * sensor for the watch.
+ *
+ * Every unit publishes its strokes on the control service's seat stroke
+ * characteristic. With crew mode on (set:crew:1, one unit per boat), this
+ * unit also acts as a BLE central. It scans for other power meters by name,
+ * connects, and subscribes to their seat strokes. Its own paddle is seat 0
+ * and the others follow in connection order.
+ *
+ * Each seat's clock offset is the minimum of (arrival - sent_ms) over the
+ * last CREW_OFFSET_WINDOW strokes: the least-delayed notification bounds
+ * the link latency. Remote catches mapped onto the local clock are grouped
+ * with the local one when they fall within CREW_ALIGN_US of the first catch
+ * of the group. A group is published when every connected seat has
+ * reported, or CREW_MERGE_TIMEOUT_US after its first stroke arrived,
+ * whichever comes first. Crew power goes out once per crew stroke: the sum
+ * of the seats' stroke power, with seat 0's share as the CPS pedal power
+ * balance. */
+
+/* Connection slots crew mode leaves to centrals: the watch plus a phone */
+#define CREW_CENTRAL_SLOTS 2
+#define CREW_MAX_PEERS (CONFIG_BT_NIMBLE_MAX_CONNECTIONS - CREW_CENTRAL_SLOTS)
+#define CREW_MAX_SEATS (CREW_MAX_PEERS + 1)
+#define CREW_OFFSET_WINDOW 16
+/* Crews paddle in time; half a stroke at 60 spm would already be the next */
+#define CREW_ALIGN_US 400000
+/* Seats confirm within a few samples of each other; the rest is one or two
+ * connection events at CONN_POLICY_ACTIVE_ITVL_MAX_MS */
+#define CREW_MERGE_TIMEOUT_US 250000
+
+/* A published crew stroke */
+typedef struct {
+  float power_w;                      /* Sum over the seats that reported */
+  float seat_power_w[CREW_MAX_SEATS]; /* 0 for seats that did not */
+  uint32_t seat_mask;
+  float stroke_rate_spm; /* Seat 0's if it reported, else the first seat's */
+  int balance;           /* Seat 0's share in 0.5 %, -1 without a second seat */
+  uint32_t stroke_count; /* Crew strokes published */
+} crew_stroke_t;
+
+/* Called from whichever task completed the group (IMU, NimBLE host or
+ * esp_timer); must not block */
+typedef void (*crew_publish_cb_t)(const crew_stroke_t* stroke);
+
+/* Once, before the IMU task starts */
+void crew_init(crew_publish_cb_t cb);
+
+/* Turn the aggregator role on or off. Any task; scanning starts once the
+ * host has synced (crew_on_sync). */
+void crew_set_enabled(bool on);
+bool crew_enabled(void);
+
+/* NimBLE sync callback */
+void crew_on_sync(void);
+
+/* Connected peer seats, for the connection slot count (gap.c) */
+int crew_peer_count(void);
+
+/* IMU task: a confirmed local stroke. Only call while crew_enabled(). */
+void crew_local_stroke(int64_t catch_us, float power_w, float rate_spm);
@@ -3,7 +3,11 @@
  */
 
 #include "gap.h"
+#include "ble_control_service.h"
+#include "ble_imu_stream_service.h"
 #include "ble_power_service.h"
+#include "conn_policy.h"
+#include "crew.h"
 
 #include <string.h>
 #include "esp_log.h"
@@ -18,11 +22,12 @@
 /* Private variables */
 static uint8_t own_addr_type;
 static uint8_t addr_val[6] = {0};
+static int s_num_conns;
 
 /* Private function declarations */
 static void format_addr(char* addr_str, uint8_t addr[]);
 static void print_conn_desc(struct ble_gap_conn_desc* desc);
-static void start_advertising(void);
+static void start_advertising(bool fast);
 static int gap_event_handler(struct ble_gap_event* event, void* arg);
 
 /* Private functions */
@@ -49,8 +54,19 @@ static void print_conn_desc(struct ble_gap_conn_desc* desc) {
            desc->sec_state.encrypted, desc->sec_state.authenticated, desc->sec_state.bonded);
 }
 
-static void start_advertising(void) {
+static void start_advertising(bool fast) {
   int rc = 0;
+  /* Crew seats (crew.c) share the controller's connection slots */
+  int used = s_num_conns + crew_peer_count();
+  if (used >= CONFIG_BT_NIMBLE_MAX_CONNECTIONS) {
+    ESP_LOGI(TAG, "all %d connection slots in use, not advertising", used);
+    return;
+  }
+  /* Still advertising for another central; restart with the new interval */
+  if (ble_gap_adv_active()) {
+    ble_gap_adv_stop();
+  }
+
   const char* name;
   struct ble_hs_adv_fields adv_fields = {0};
   struct ble_gap_adv_params adv_params = {0};
@@ -87,17 +103,16 @@ static void start_advertising(void) {
   adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
   adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
 
-  /* Set advertising interval (100ms - 150ms for faster discovery) */
-  adv_params.itvl_min = BLE_GAP_ADV_ITVL_MS(100);
-  adv_params.itvl_max = BLE_GAP_ADV_ITVL_MS(150);
+  /* Fast interval for a while after boot/disconnect, then slow (conn_policy.h) */
+  int32_t duration_ms = conn_policy_adv_params(&adv_params, fast);
 
   /* Start advertising */
-  rc = ble_gap_adv_start(own_addr_type, NULL, BLE_HS_FOREVER, &adv_params, gap_event_handler, NULL);
+  rc = ble_gap_adv_start(own_addr_type, NULL, duration_ms, &adv_params, gap_event_handler, NULL);
   if (rc != 0) {
     ESP_LOGE(TAG, "failed to start advertising, error code: %d", rc);
     return;
   }
-  ESP_LOGI(TAG, "advertising started!");
+  ESP_LOGI(TAG, "advertising started (%s)", duration_ms == BLE_HS_FOREVER ? "slow" : "fast");
 }
 
 static int gap_event_handler(struct ble_gap_event* event, void* arg) {
@@ -110,6 +125,7 @@ static int gap_event_handler(struct ble_gap_event* event, void* arg) {
                event->connect.status == 0 ? "established" : "failed", event->connect.status);
 
       if (event->connect.status == 0) {
+        s_num_conns++;
         rc = ble_gap_conn_find(event->connect.conn_handle, &desc);
         if (rc != 0) {
           ESP_LOGE(TAG, "failed to find connection, error code: %d", rc);
@@ -117,21 +133,26 @@ static int gap_event_handler(struct ble_gap_event* event, void* arg) {
         }
         print_conn_desc(&desc);
 
-        /* Store connection handle for notifications */
-        power_service_set_conn_handle(event->connect.conn_handle);
+        conn_policy_on_connect(event->connect.conn_handle);
+        /* Keep advertising so a second central (phone, tablet) can join */
+        start_advertising(false);
       } else {
-        start_advertising();
+        /* Resume whatever is left of the fast window */
+        start_advertising(false);
       }
       return rc;
 
     case BLE_GAP_EVENT_DISCONNECT:
       ESP_LOGI(TAG, "disconnected from peer; reason=%d", event->disconnect.reason);
 
-      /* Clear connection handle */
-      power_service_set_conn_handle(BLE_HS_CONN_HANDLE_NONE);
+      s_num_conns--;
+      power_service_conn_closed(event->disconnect.conn.conn_handle);
+      control_service_conn_closed(event->disconnect.conn.conn_handle);
+      imu_stream_service_conn_closed(event->disconnect.conn.conn_handle);
+      conn_policy_on_disconnect(event->disconnect.conn.conn_handle);
 
-      /* Restart advertising */
-      start_advertising();
+      /* Restart advertising, fast so the watch reconnects quickly */
+      start_advertising(true);
       return rc;
 
     case BLE_GAP_EVENT_CONN_UPDATE:
@@ -140,11 +161,13 @@ static int gap_event_handler(struct ble_gap_event* event, void* arg) {
       if (rc == 0) {
         print_conn_desc(&desc);
       }
+      conn_policy_on_conn_update(event->conn_update.conn_handle, event->conn_update.status);
       return rc;
 
     case BLE_GAP_EVENT_ADV_COMPLETE:
       ESP_LOGI(TAG, "advertise complete; reason=%d", event->adv_complete.reason);
-      start_advertising();
+      /* Fast window timed out: continue at the slow interval */
+      start_advertising(false);
       return rc;
 
     case BLE_GAP_EVENT_NOTIFY_TX:
@@ -155,6 +178,7 @@ static int gap_event_handler(struct ble_gap_event* event, void* arg) {
                  event->notify_tx.conn_handle, event->notify_tx.attr_handle,
                  event->notify_tx.status, event->notify_tx.indication);
       }
+      power_service_notify_tx_cb(event);
       return rc;
 
     case BLE_GAP_EVENT_SUBSCRIBE:
@@ -165,13 +189,29 @@ static int gap_event_handler(struct ble_gap_event* event, void* arg) {
                event->subscribe.prev_notify, event->subscribe.cur_notify,
                event->subscribe.prev_indicate, event->subscribe.cur_indicate);
 
-      /* Handle subscription to power measurement */
+      /* Handle subscription to power measurement and the IMU stream */
       power_service_subscribe_cb(event);
+      imu_stream_service_subscribe_cb(event);
+      return rc;
+
+    case BLE_GAP_EVENT_ENC_CHANGE:
+      ESP_LOGI(TAG, "encryption change; conn_handle=%d status=%d", event->enc_change.conn_handle,
+               event->enc_change.status);
       return rc;
 
+    case BLE_GAP_EVENT_REPEAT_PAIRING:
+      /* The central lost its keys (re-paired from the phone's settings):
+       * forget the old bond and let it pair again */
+      rc = ble_gap_conn_find(event->repeat_pairing.conn_handle, &desc);
+      if (rc != 0)
+        return BLE_GAP_REPEAT_PAIRING_IGNORE;
+      ble_store_util_delete_peer(&desc.peer_id_addr);
+      return BLE_GAP_REPEAT_PAIRING_RETRY;
+
     case BLE_GAP_EVENT_MTU:
       ESP_LOGI(TAG, "mtu update event; conn_handle=%d cid=%d mtu=%d", event->mtu.conn_handle,
                event->mtu.channel_id, event->mtu.value);
+      imu_stream_service_mtu_cb(event->mtu.conn_handle, event->mtu.value);
       return rc;
   }
 
@@ -179,6 +219,16 @@ static int gap_event_handler(struct ble_gap_event* event, void* arg) {
 }
 
 /* Public functions */
+uint8_t gap_own_addr_type(void) {
+  return own_addr_type;
+}
+
+void gap_resume_advertising(void) {
+  /* Already advertising: a slot was free all along */
+  if (!ble_gap_adv_active())
+    start_advertising(true);
+}
+
 void adv_init(void) {
   int rc = 0;
   char addr_str[18] = {0};
@@ -207,7 +257,7 @@ void adv_init(void) {
   ESP_LOGI(TAG, "device address: %s", addr_str);
 
   /* Start advertising */
-  start_advertising();
+  start_advertising(true);
 }
 
 int gap_init(void) {
@@ -14,5 +14,10 @@
 /* Public function declarations */
 void adv_init(void);
 int gap_init(void);
+/* Address type in use, valid once adv_init() has run (central role, crew.c) */
+uint8_t gap_own_addr_type(void);
+/* Advertise again (fast) if stopped and a connection slot is free; for
+ * crew.c once a seat has left. NimBLE host task. */
+void gap_resume_advertising(void);
 
 #endif  // GAP_H
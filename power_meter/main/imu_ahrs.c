@@ -0,0 +1,417 @@
+#include "imu_ahrs.h"
+#include <math.h>
+#include <string.h>
+
+/* Rows of the sensor-to-world rotation matrix. Row 2 is world up in the
+ * sensor frame; rows 0 and 1 give the world x/y components of a sensor-frame
+ * vector and, transposed, map a horizontal world vector back. */
+typedef struct {
+  float r[3][3];
+} rot_t;
+
+static void rot_from_q(const float q[4], rot_t* m) {
+  const float w = q[0], x = q[1], y = q[2], z = q[3];
+  m->r[0][0] = 1.0f - 2.0f * (y * y + z * z);
+  m->r[0][1] = 2.0f * (x * y - w * z);
+  m->r[0][2] = 2.0f * (x * z + w * y);
+  m->r[1][0] = 2.0f * (x * y + w * z);
+  m->r[1][1] = 1.0f - 2.0f * (x * x + z * z);
+  m->r[1][2] = 2.0f * (y * z - w * x);
+  m->r[2][0] = 2.0f * (x * z - w * y);
+  m->r[2][1] = 2.0f * (y * z + w * x);
+  m->r[2][2] = 1.0f - 2.0f * (x * x + y * y);
+}
+
+/* Forward vectors with a specialised step: the six signed sensor axes,
+ * numbered 2 * column + (negative), and anything else */
+#define AXIS_GENERIC (-1)
+
+/* Horizontal world direction of a sensor-frame vector. Returns false when it
+ * is too close to vertical to give a heading. With a constant axis the
+ * projection is a column of the matrix, and the compiler drops the rest. */
+static inline __attribute__((always_inline)) bool horizontal_on(const rot_t* m,
+                                                                const float v[3],
+                                                                int axis,
+                                                                float h[2]) {
+  if (axis == AXIS_GENERIC) {
+    h[0] = m->r[0][0] * v[0] + m->r[0][1] * v[1] + m->r[0][2] * v[2];
+    h[1] = m->r[1][0] * v[0] + m->r[1][1] * v[1] + m->r[1][2] * v[2];
+  } else if (axis & 1) {
+    h[0] = -m->r[0][axis >> 1];
+    h[1] = -m->r[1][axis >> 1];
+  } else {
+    h[0] = m->r[0][axis >> 1];
+    h[1] = m->r[1][axis >> 1];
+  }
+  float n2 = h[0] * h[0] + h[1] * h[1];
+  if (n2 < 0.01f)
+    return false;
+  float inv = 1.0f / sqrtf(n2);
+  h[0] *= inv;
+  h[1] *= inv;
+  return true;
+}
+
+static bool horizontal(const rot_t* m, const float v[3], float h[2]) {
+  return horizontal_on(m, v, AXIS_GENERIC, h);
+}
+
+/* Axis number of a unit sensor axis, AXIS_GENERIC for any other vector */
+static int axis_of(const float v[3]) {
+  for (int i = 0; i < 3; i++) {
+    if ((v[i] == 1.0f || v[i] == -1.0f) && v[(i + 1) % 3] == 0.0f && v[(i + 2) % 3] == 0.0f)
+      return 2 * i + (v[i] < 0.0f);
+  }
+  return AXIS_GENERIC;
+}
+
+#if IMU_POWER_FIXED_POINT
+#define Q_ONE (1 << AHRS_Q)
+#define Q_ONE_F ((float)Q_ONE)
+/* Fractional bits of bias_int: resolves the KI * dt * error steps */
+#define BIAS_Q 54
+/* Accelerometer counts per g as a shift (IMU_ACCEL_LSB_PER_G = 2^13) */
+#define ACCEL_Q 13
+/* Q30 seconds per us, times 2^20 */
+#define DT_Q30_PER_US_Q20 1125899907ll
+#define MAX_DT_US ((int32_t)(AHRS_MAX_DT_S * 1e6f))
+/* Gains in Q32; folded at compile time */
+#define KP_Q32 ((int64_t)(4294967296.0 / AHRS_TAU_S + 0.5))
+#define KI_Q32 ((int64_t)(4294967296.0 * AHRS_KI + 0.5))
+#define KH_Q32 ((int64_t)(4294967296.0 / AHRS_HEADING_TAU_S + 0.5))
+#endif
+
+/* Attitude as float, for the once-off and once-per-block paths */
+static void quat_f(const imu_ahrs_t* ahrs, float q[4]) {
+#if IMU_POWER_FIXED_POINT
+  for (int i = 0; i < 4; i++) q[i] = (float)ahrs->q[i] * (1.0f / Q_ONE_F);
+#else
+  memcpy(q, ahrs->q, sizeof(ahrs->q));
+#endif
+}
+
+void imu_ahrs_init(imu_ahrs_t* ahrs,
+                   const float gravity[3],
+                   const float forward[3],
+                   const float gyro_bias_rad[3]) {
+  /* Shortest rotation taking gravity onto +z: (1 + g.z, g x z), normalised */
+  float q[4] = {1.0f + gravity[2], gravity[1], -gravity[0], 0.0f};
+  float n2 = q[0] * q[0] + q[1] * q[1] + q[2] * q[2];
+  if (n2 < 1e-6f) {
+    /* Upside down: half turn about x */
+    q[0] = 0.0f;
+    q[1] = 1.0f;
+    q[2] = 0.0f;
+    n2 = 1.0f;
+  }
+  float inv = 1.0f / sqrtf(n2);
+#if IMU_POWER_FIXED_POINT
+  for (int i = 0; i < 4; i++) ahrs->q[i] = (int32_t)lrintf(q[i] * inv * Q_ONE_F);
+  for (int i = 0; i < 3; i++)
+    ahrs->bias_int[i] = llrint(-gyro_bias_rad[i] * (double)(1ll << BIAS_Q));
+  ahrs->heading[0] = Q_ONE;
+  ahrs->heading[1] = 0;
+#else
+  for (int i = 0; i < 4; i++) ahrs->q[i] = q[i] * inv;
+  for (int i = 0; i < 3; i++) ahrs->bias_int[i] = -gyro_bias_rad[i];
+  ahrs->heading[0] = 1.0f;
+  ahrs->heading[1] = 0.0f;
+#endif
+  imu_ahrs_set_forward(ahrs, forward);
+  ahrs->ready = true;
+}
+
+static imu_ahrs_step_fn step_for_axis(int axis);
+
+void imu_ahrs_set_forward(imu_ahrs_t* ahrs, const float forward[3]) {
+  memcpy(ahrs->forward, forward, sizeof(ahrs->forward));
+  ahrs->step = step_for_axis(axis_of(forward));
+  float q[4];
+  quat_f(ahrs, q);
+  rot_t m;
+  rot_from_q(q, &m);
+  float h[2];
+#if IMU_POWER_FIXED_POINT
+  for (int i = 0; i < 3; i++) ahrs->forward_q[i] = (int32_t)lrintf(forward[i] * Q_ONE_F);
+  if (horizontal(&m, forward, h)) {
+    ahrs->heading[0] = (int32_t)lrintf(h[0] * Q_ONE_F);
+    ahrs->heading[1] = (int32_t)lrintf(h[1] * Q_ONE_F);
+  }
+#else
+  if (horizontal(&m, forward, h)) {
+    ahrs->heading[0] = h[0];
+    ahrs->heading[1] = h[1];
+  }
+#endif
+}
+
+#if IMU_POWER_FIXED_POINT
+
+/* Integer square root (floor) of a 64-bit value, bit-by-bit */
+static uint32_t isqrt64(uint64_t v) {
+  uint64_t root = 0;
+  uint64_t bit = 1ull << 62;
+  while (bit > v) bit >>= 2;
+  while (bit) {
+    if (v >= root + bit) {
+      v -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)root;
+}
+
+/* 1 / |v| in Q30 from |v|^2 in Q60 */
+static int64_t inv_norm(uint64_t n2) {
+  uint32_t norm = isqrt64(n2);
+  return norm ? (int64_t)((1ull << (2 * AHRS_Q)) / norm) : 0;
+}
+
+/* rot_t in Q30 */
+typedef struct {
+  int32_t r[3][3];
+} rot_q_t;
+
+static inline void rot_from_q_q(const int32_t q[4], rot_q_t* m) {
+  const int64_t w = q[0], x = q[1], y = q[2], z = q[3];
+  const int s = AHRS_Q - 1; /* Q60 products, doubled */
+  m->r[0][0] = (int32_t)(Q_ONE - ((y * y + z * z) >> s));
+  m->r[0][1] = (int32_t)((x * y - w * z) >> s);
+  m->r[0][2] = (int32_t)((x * z + w * y) >> s);
+  m->r[1][0] = (int32_t)((x * y + w * z) >> s);
+  m->r[1][1] = (int32_t)(Q_ONE - ((x * x + z * z) >> s));
+  m->r[1][2] = (int32_t)((y * z - w * x) >> s);
+  m->r[2][0] = (int32_t)((x * z - w * y) >> s);
+  m->r[2][1] = (int32_t)((y * z + w * x) >> s);
+  m->r[2][2] = (int32_t)(Q_ONE - ((x * x + y * y) >> s));
+}
+
+/* horizontal_on() in Q30 */
+static inline __attribute__((always_inline)) bool horizontal_on_q(const rot_q_t* m,
+                                                                  const int32_t v[3],
+                                                                  int axis,
+                                                                  int32_t h[2]) {
+  int64_t hx, hy;
+  if (axis == AXIS_GENERIC) {
+    hx = ((int64_t)m->r[0][0] * v[0] + (int64_t)m->r[0][1] * v[1] + (int64_t)m->r[0][2] * v[2]) >>
+         AHRS_Q;
+    hy = ((int64_t)m->r[1][0] * v[0] + (int64_t)m->r[1][1] * v[1] + (int64_t)m->r[1][2] * v[2]) >>
+         AHRS_Q;
+  } else if (axis & 1) {
+    hx = -m->r[0][axis >> 1];
+    hy = -m->r[1][axis >> 1];
+  } else {
+    hx = m->r[0][axis >> 1];
+    hy = m->r[1][axis >> 1];
+  }
+  uint64_t n2 = (uint64_t)(hx * hx + hy * hy);
+  if (n2 < (1ull << (2 * AHRS_Q)) / 100)
+    return false;
+  int64_t inv = inv_norm(n2);
+  h[0] = (int32_t)((hx * inv) >> AHRS_Q);
+  h[1] = (int32_t)((hy * inv) >> AHRS_Q);
+  return true;
+}
+
+/* Sensor-frame heading from an already built rotation */
+static void forward_from_rot(const imu_ahrs_t* ahrs, const rot_q_t* m, imu_fwd_t fwd[3]) {
+  const int64_t hx = ahrs->heading[0], hy = ahrs->heading[1];
+  for (int i = 0; i < 3; i++) fwd[i] = (int32_t)((hx * m->r[0][i] + hy * m->r[1][i]) >> AHRS_Q);
+}
+
+/* The float step below, term for term. Products of two Q30 values are Q60 in
+ * int64 and shifted back; the accelerometer error is Q24 like the rates. */
+static inline __attribute__((always_inline)) void step_on(imu_ahrs_t* ahrs,
+                                                          const int32_t gyro[3],
+                                                          const int32_t accel[3],
+                                                          int32_t dt_us,
+                                                          imu_fwd_t fwd[3],
+                                                          int axis) {
+  int32_t* q = ahrs->q;
+  const int64_t w = q[0], x = q[1], y = q[2], z = q[3];
+  if (dt_us > MAX_DT_US)
+    dt_us = MAX_DT_US;
+  const int64_t dt = ((int64_t)dt_us * DT_Q30_PER_US_Q20) >> 20; /* s, Q30 */
+
+  /* Expected up direction in the sensor frame (row 2 of R) */
+  const int64_t vx = (x * z - w * y) >> (AHRS_Q - 1);
+  const int64_t vy = (y * z + w * x) >> (AHRS_Q - 1);
+  const int64_t vz = (w * w - x * x - y * y + z * z) >> AHRS_Q;
+
+  /* Rotating by a x v turns v towards a */
+  const int e_shift = AHRS_Q + ACCEL_Q - AHRS_RATE_Q;
+  const int64_t ex = (accel[1] * vz - accel[2] * vy) >> e_shift;
+  const int64_t ey = (accel[2] * vx - accel[0] * vz) >> e_shift;
+  const int64_t ez = (accel[0] * vy - accel[1] * vx) >> e_shift;
+
+  /* KI * dt * e: dt * e in Q54, to Q30, times KI in Q32, to BIAS_Q */
+  const int ki_shift = AHRS_Q + 32 - BIAS_Q;
+  ahrs->bias_int[0] += (((dt * ex) >> AHRS_RATE_Q) * KI_Q32) >> ki_shift;
+  ahrs->bias_int[1] += (((dt * ey) >> AHRS_RATE_Q) * KI_Q32) >> ki_shift;
+  ahrs->bias_int[2] += (((dt * ez) >> AHRS_RATE_Q) * KI_Q32) >> ki_shift;
+
+  const int b_shift = BIAS_Q - AHRS_RATE_Q;
+  const int64_t gx = gyro[0] + ((ex * KP_Q32) >> 32) + (ahrs->bias_int[0] >> b_shift);
+  const int64_t gy = gyro[1] + ((ey * KP_Q32) >> 32) + (ahrs->bias_int[1] >> b_shift);
+  const int64_t gz = gyro[2] + ((ez * KP_Q32) >> 32) + (ahrs->bias_int[2] >> b_shift);
+
+  /* Half-angle steps 0.5 * g * dt, Q30 */
+  const int64_t rx = (dt * gx) >> (AHRS_RATE_Q + 1);
+  const int64_t ry = (dt * gy) >> (AHRS_RATE_Q + 1);
+  const int64_t rz = (dt * gz) >> (AHRS_RATE_Q + 1);
+
+  /* q += q (x) (0, r) */
+  const int64_t nq[4] = {
+      w - ((x * rx + y * ry + z * rz) >> AHRS_Q),
+      x + ((w * rx + y * rz - z * ry) >> AHRS_Q),
+      y + ((w * ry - x * rz + z * rx) >> AHRS_Q),
+      z + ((w * rz + x * ry - y * rx) >> AHRS_Q),
+  };
+  const int64_t inv = inv_norm((uint64_t)(nq[0] * nq[0]) + (uint64_t)(nq[1] * nq[1]) +
+                               (uint64_t)(nq[2] * nq[2]) + (uint64_t)(nq[3] * nq[3]));
+  for (int i = 0; i < 4; i++) q[i] = (int32_t)((nq[i] * inv) >> AHRS_Q);
+
+  rot_q_t m;
+  rot_from_q_q(q, &m);
+  int32_t fh[2];
+  if (horizontal_on_q(&m, ahrs->forward_q, axis, fh)) {
+    const int64_t k = (dt * KH_Q32) >> 32;
+    const int64_t hx = ahrs->heading[0] + ((k * (fh[0] - ahrs->heading[0])) >> AHRS_Q);
+    const int64_t hy = ahrs->heading[1] + ((k * (fh[1] - ahrs->heading[1])) >> AHRS_Q);
+    uint64_t n2 = (uint64_t)(hx * hx + hy * hy);
+    if (n2 > (1ull << (2 * AHRS_Q)) / 1000000) {
+      const int64_t hinv = inv_norm(n2);
+      ahrs->heading[0] = (int32_t)((hx * hinv) >> AHRS_Q);
+      ahrs->heading[1] = (int32_t)((hy * hinv) >> AHRS_Q);
+    }
+  }
+  forward_from_rot(ahrs, &m, fwd);
+}
+
+#define AHRS_STEP(name, axis)                                                        \
+  static void name(imu_ahrs_t* ahrs, const int32_t gyro[3], const int32_t accel[3], \
+                   int32_t dt_us, imu_fwd_t fwd[3]) {                                \
+    step_on(ahrs, gyro, accel, dt_us, fwd, (axis));                                  \
+  }
+
+#else
+
+/* Sensor-frame heading from an already built rotation */
+static void forward_from_rot(const imu_ahrs_t* ahrs, const rot_t* m, imu_fwd_t fwd[3]) {
+  const float hx = ahrs->heading[0], hy = ahrs->heading[1];
+  for (int i = 0; i < 3; i++) fwd[i] = hx * m->r[0][i] + hy * m->r[1][i];
+}
+
+/* The filter step, instantiated below once per axis */
+static inline __attribute__((always_inline)) void step_on(imu_ahrs_t* ahrs,
+                                                          const float gyro[3],
+                                                          const float accel[3],
+                                                          float dt,
+                                                          imu_fwd_t fwd[3],
+                                                          int axis) {
+  float* q = ahrs->q;
+  const float w = q[0], x = q[1], y = q[2], z = q[3];
+  if (dt > AHRS_MAX_DT_S)
+    dt = AHRS_MAX_DT_S;
+
+  /* Expected up direction in the sensor frame (row 2 of R) */
+  const float vx = 2.0f * (x * z - w * y);
+  const float vy = 2.0f * (y * z + w * x);
+  const float vz = w * w - x * x - y * y + z * z;
+
+  /* Rotating by a x v turns v towards a */
+  const float ex = accel[1] * vz - accel[2] * vy;
+  const float ey = accel[2] * vx - accel[0] * vz;
+  const float ez = accel[0] * vy - accel[1] * vx;
+
+  const float ki_dt = AHRS_KI * dt;
+  ahrs->bias_int[0] += ki_dt * ex;
+  ahrs->bias_int[1] += ki_dt * ey;
+  ahrs->bias_int[2] += ki_dt * ez;
+
+  const float kp = 1.0f / AHRS_TAU_S;
+  const float gx = gyro[0] + kp * ex + ahrs->bias_int[0];
+  const float gy = gyro[1] + kp * ey + ahrs->bias_int[1];
+  const float gz = gyro[2] + kp * ez + ahrs->bias_int[2];
+
+  /* q += 0.5 * q (x) (0, w) * dt */
+  const float h = 0.5f * dt;
+  float nq[4] = {
+      w + h * (-x * gx - y * gy - z * gz),
+      x + h * (w * gx + y * gz - z * gy),
+      y + h * (w * gy - x * gz + z * gx),
+      z + h * (w * gz + x * gy - y * gx),
+  };
+  float inv = 1.0f / sqrtf(nq[0] * nq[0] + nq[1] * nq[1] + nq[2] * nq[2] + nq[3] * nq[3]);
+  for (int i = 0; i < 4; i++) q[i] = nq[i] * inv;
+
+  rot_t m;
+  rot_from_q(q, &m);
+  float fh[2];
+  if (horizontal_on(&m, ahrs->forward, axis, fh)) {
+    const float k = dt / AHRS_HEADING_TAU_S;
+    float hx = ahrs->heading[0] + k * (fh[0] - ahrs->heading[0]);
+    float hy = ahrs->heading[1] + k * (fh[1] - ahrs->heading[1]);
+    float n2 = hx * hx + hy * hy;
+    if (n2 > 1e-6f) {
+      float hinv = 1.0f / sqrtf(n2);
+      ahrs->heading[0] = hx * hinv;
+      ahrs->heading[1] = hy * hinv;
+    }
+  }
+  forward_from_rot(ahrs, &m, fwd);
+}
+
+#define AHRS_STEP(name, axis)                                                               \
+  static void name(imu_ahrs_t* ahrs, const float gyro[3], const float accel[3], float dt, \
+                   imu_fwd_t fwd[3]) {                                                      \
+    step_on(ahrs, gyro, accel, dt, fwd, (axis));                                            \
+  }
+
+#endif /* IMU_POWER_FIXED_POINT */
+
+AHRS_STEP(step_generic, AXIS_GENERIC)
+AHRS_STEP(step_pos_x, 0)
+AHRS_STEP(step_neg_x, 1)
+AHRS_STEP(step_pos_y, 2)
+AHRS_STEP(step_neg_y, 3)
+AHRS_STEP(step_pos_z, 4)
+AHRS_STEP(step_neg_z, 5)
+#undef AHRS_STEP
+
+static imu_ahrs_step_fn step_for_axis(int axis) {
+  static const imu_ahrs_step_fn steps[6] = {step_pos_x, step_neg_x, step_pos_y,
+                                            step_neg_y, step_pos_z, step_neg_z};
+  return axis == AXIS_GENERIC ? step_generic : steps[axis];
+}
+
+void imu_ahrs_up(const imu_ahrs_t* ahrs, float up[3]) {
+  float q[4];
+  quat_f(ahrs, q);
+  const float w = q[0], x = q[1], y = q[2], z = q[3];
+  up[0] = 2.0f * (x * z - w * y);
+  up[1] = 2.0f * (y * z + w * x);
+  up[2] = 1.0f - 2.0f * (x * x + y * y);
+}
+
+void imu_ahrs_forward(const imu_ahrs_t* ahrs, imu_fwd_t fwd[3]) {
+#if IMU_POWER_FIXED_POINT
+  rot_q_t m;
+  rot_from_q_q(ahrs->q, &m);
+#else
+  rot_t m;
+  rot_from_q(ahrs->q, &m);
+#endif
+  forward_from_rot(ahrs, &m, fwd);
+}
+
+void imu_ahrs_gyro_bias(const imu_ahrs_t* ahrs, float bias_rad[3]) {
+#if IMU_POWER_FIXED_POINT
+  for (int i = 0; i < 3; i++) bias_rad[i] = (float)-ahrs->bias_int[i] / (float)(1ll << BIAS_Q);
+#else
+  for (int i = 0; i < 3; i++) bias_rad[i] = -ahrs->bias_int[i];
+#endif
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "imu_block.h"
+
+/* Mahony attitude filter: quaternion orientation from gyro + accelerometer.
+ *
+ * The world frame has z along the at-rest accelerometer reading (up) and an
+ * arbitrary yaw; without a magnetometer only tilt is observable. The boat's
+ * forward direction is kept as a horizontal heading in that frame, pulled
+ * towards the horizontal projection of the configured sensor-frame forward
+ * axis with AHRS_HEADING_TAU_S. That follows turns of the boat but not the
+ * shaft's swing within a stroke. Acceleration projected onto the heading has
+ * no gravity component, whatever the shaft's roll or pitch.
+ *
+ * No trig and one square root per normalisation; a step is ~100 flops.
+ * set:axis only offers the six signed sensor axes, and for those the heading
+ * target is one column of the rotation matrix: imu_ahrs_set_forward() picks
+ * a step specialised for the axis and falls back to the general projection
+ * for any other vector.
+ *
+ * With IMU_POWER_FIXED_POINT the state and the step are integer: unit
+ * quantities (quaternion, heading, forward axis) in Q30, rates in Q24 rad/s,
+ * acceleration as raw counts (Q13 g at ±4 g), 64-bit intermediates and an
+ * integer square root per normalisation. Float is left to init, set_forward
+ * and the once-per-block imu_ahrs_up() / imu_ahrs_gyro_bias(). */
+
+/* Accelerometer correction time constant (s), Kp = 1 / AHRS_TAU_S. Long
+ * against a stroke, so each stroke's surge and deceleration average out. */
+#define AHRS_TAU_S 5.0f
+/* Integral gain: learns the gyro bias over a few tens of seconds */
+#define AHRS_KI 0.002f
+/* Heading time constant (s) */
+#define AHRS_HEADING_TAU_S 10.0f
+/* Longest step (s); a longer gap between samples is stepped as this. Keeps
+ * the fixed-point step inside its ranges. */
+#define AHRS_MAX_DT_S 0.1f
+
+#if IMU_POWER_FIXED_POINT
+#define AHRS_Q 30      /* Fractional bits of unit quantities */
+#define AHRS_RATE_Q 24 /* Fractional bits of angular rates (rad/s) */
+#endif
+
+typedef struct imu_ahrs imu_ahrs_t;
+
+/* One filter step, see imu_ahrs_update() */
+#if IMU_POWER_FIXED_POINT
+typedef void (*imu_ahrs_step_fn)(imu_ahrs_t* ahrs,
+                                 const int32_t gyro[3],
+                                 const int32_t accel[3],
+                                 int32_t dt_us,
+                                 imu_fwd_t fwd[3]);
+#else
+typedef void (*imu_ahrs_step_fn)(imu_ahrs_t* ahrs,
+                                 const float gyro[3],
+                                 const float accel[3],
+                                 float dt,
+                                 imu_fwd_t fwd[3]);
+#endif
+
+struct imu_ahrs {
+#if IMU_POWER_FIXED_POINT
+  int32_t q[4];         /* Sensor-to-world rotation, w x y z, Q30 */
+  int64_t bias_int[3];  /* Integral term (rad/s, Q54), converges to -gyro bias */
+  int32_t heading[2];   /* Boat forward, world x y, unit, Q30 */
+  int32_t forward_q[3]; /* forward in Q30 */
+#else
+  float q[4];         /* Sensor-to-world rotation, w x y z */
+  float bias_int[3];  /* Integral term (rad/s), converges to -gyro bias */
+  float heading[2];   /* Boat forward, world x y, unit */
+#endif
+  float forward[3];   /* Sensor-frame forward axis the heading follows */
+  imu_ahrs_step_fn step; /* Specialised for forward; set by imu_ahrs_set_forward() */
+  bool ready;
+};
+
+/* Level the filter on a gravity vector (sensor frame, normalised; the
+ * at-rest accelerometer direction) and point the heading along forward.
+ * gyro_bias_rad seeds the integral term. */
+void imu_ahrs_init(imu_ahrs_t* ahrs,
+                   const float gravity[3],
+                   const float forward[3],
+                   const float gyro_bias_rad[3]);
+
+/* Re-aim the heading at a new sensor-frame forward axis, keeping attitude */
+void imu_ahrs_set_forward(imu_ahrs_t* ahrs, const float forward[3]);
+
+/* One filter step (ahrs->step). gyro in rad/s, accel in g (not normalised: the correction
+ * is linear in it, so zero-mean surge cancels), dt in s. fwd receives the
+ * updated imu_ahrs_forward(), sharing the step's rotation matrix.
+ * Fixed point: gyro in Q24 rad/s, accel in raw counts, dt in us. */
+#if IMU_POWER_FIXED_POINT
+static inline void imu_ahrs_update(imu_ahrs_t* ahrs,
+                                   const int32_t gyro[3],
+                                   const int32_t accel[3],
+                                   int32_t dt_us,
+                                   imu_fwd_t fwd[3]) {
+  ahrs->step(ahrs, gyro, accel, dt_us, fwd);
+}
+#else
+static inline void imu_ahrs_update(imu_ahrs_t* ahrs,
+                                   const float gyro[3],
+                                   const float accel[3],
+                                   float dt,
+                                   imu_fwd_t fwd[3]) {
+  ahrs->step(ahrs, gyro, accel, dt, fwd);
+}
+#endif
+
+/* Sensor-frame unit vectors of world up (the expected at-rest accelerometer
+ * direction) and of the boat heading, for the current attitude */
+void imu_ahrs_up(const imu_ahrs_t* ahrs, float up[3]);
+void imu_ahrs_forward(const imu_ahrs_t* ahrs, imu_fwd_t fwd[3]);
+
+/* Gyro bias the integral term has learned (rad/s) */
+void imu_ahrs_gyro_bias(const imu_ahrs_t* ahrs, float bias_rad[3]);
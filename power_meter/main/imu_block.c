@@ -0,0 +1,51 @@
+#include "imu_block.h"
+#include <math.h>
+
+#if IMU_POWER_FIXED_POINT
+/* Integer square root (floor) of a 32-bit value, bit-by-bit */
+static uint32_t isqrt32(uint32_t v) {
+  uint32_t root = 0;
+  uint32_t bit = 1u << 30;
+  while (bit > v) bit >>= 2;
+  while (bit) {
+    if (v >= root + bit) {
+      v -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+#endif
+
+void imu_block_prepare(imu_block_t* blk, int64_t* last_ts_us) {
+  const int n = blk->count;
+  const float inv_lsb = 1.0f / IMU_ACCEL_LSB_PER_G;
+
+  int64_t prev = *last_ts_us;
+  for (int i = 0; i < n; i++) {
+    blk->dt_us[i] = prev ? (int32_t)(blk->ts_us[i] - prev) : 0;
+    prev = blk->ts_us[i];
+  }
+  if (n > 0)
+    *last_ts_us = prev;
+
+#if IMU_POWER_FIXED_POINT
+  /* |a|^2 in counts^2 fits uint32 (3 * 32768^2 < 2^32). Only the final
+   * threshold-ready value is converted for the stroke detector. */
+  for (int i = 0; i < n; i++) {
+    int32_t x = blk->ax[i], y = blk->ay[i], z = blk->az[i];
+    uint32_t mag2 = (uint32_t)(x * x) + (uint32_t)(y * y) + (uint32_t)(z * z);
+    int32_t dyn = (int32_t)isqrt32(mag2) - (int32_t)IMU_ACCEL_LSB_PER_G;
+    blk->dynamic_g[i] = (dyn < 0 ? -dyn : dyn) * inv_lsb;
+  }
+#else
+  for (int i = 0; i < n; i++) {
+    float x = blk->ax[i], y = blk->ay[i], z = blk->az[i];
+    float mag_g = sqrtf(x * x + y * y + z * z) * inv_lsb;
+    blk->dynamic_g[i] = fabsf(mag_g - 1.0f);
+  }
+#endif
+}
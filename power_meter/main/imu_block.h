@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include "stroke_detector.h"
+
+/* 1 = integer-only per-sample math in imu_block/imu_power, for cores without
+ * an FPU where float falls back to soft-float (ESP32-C3). Defaults on for
+ * RISC-V targets built without hardware float; override with
+ * -DIMU_POWER_FIXED_POINT=0/1. */
+#ifndef IMU_POWER_FIXED_POINT
+#if defined(__riscv) && !defined(__riscv_flen)
+#define IMU_POWER_FIXED_POINT 1
+#else
+#define IMU_POWER_FIXED_POINT 0
+#endif
+#endif
+
+/* Boat-forward vector component: Q30 with IMU_POWER_FIXED_POINT */
+#if IMU_POWER_FIXED_POINT
+typedef int32_t imu_fwd_t;
+#else
+typedef float imu_fwd_t;
+#endif
+
+/* Accelerometer sensitivity at ACCE_FS_4G (LSB per g) */
+#define IMU_ACCEL_LSB_PER_G 8192.0f
+/* Gyro sensitivity at GYRO_FS_500DPS (LSB per deg/s) */
+#define IMU_GYRO_LSB_PER_DPS 65.5f
+
+/* Largest number of samples processed in one block (one FIFO burst) */
+#define IMU_BLOCK_MAX_SAMPLES 32
+
+/* Structure-of-arrays buffer for one burst of IMU samples.
+ *
+ * The acquisition path fills count, ax/ay/az, gx/gy/gz and ts_us.
+ * imu_block_prepare() derives dt_us and dynamic_g;
+ * stroke_detector_update_block() fills phase; imu_orientation_track_block()
+ * fills fwd_x/y/z; imu_power_update_block() fills a_fwd_ms2/dv_ms when tracing is
+ * enabled.
+ * Keeping each quantity in its own array lets the per-sample arithmetic run
+ * as straight loops with no loop-carried state. */
+typedef struct {
+  int count;
+  int16_t ax[IMU_BLOCK_MAX_SAMPLES]; /* Raw counts, IMU_ACCEL_LSB_PER_G per g */
+  int16_t ay[IMU_BLOCK_MAX_SAMPLES];
+  int16_t az[IMU_BLOCK_MAX_SAMPLES];
+  int16_t gx[IMU_BLOCK_MAX_SAMPLES]; /* Raw counts, IMU_GYRO_LSB_PER_DPS per deg/s */
+  int16_t gy[IMU_BLOCK_MAX_SAMPLES];
+  int16_t gz[IMU_BLOCK_MAX_SAMPLES];
+  int64_t ts_us[IMU_BLOCK_MAX_SAMPLES];        /* Acquisition time */
+  int32_t dt_us[IMU_BLOCK_MAX_SAMPLES];        /* Time since previous sample, 0 if unknown */
+  float dynamic_g[IMU_BLOCK_MAX_SAMPLES];      /* |‖a‖ - 1 g|, stroke detector input */
+  stroke_phase_t phase[IMU_BLOCK_MAX_SAMPLES]; /* Stroke phase after each sample */
+  imu_fwd_t fwd_x[IMU_BLOCK_MAX_SAMPLES];      /* Horizontal boat-forward unit vector */
+  imu_fwd_t fwd_y[IMU_BLOCK_MAX_SAMPLES];      /* at each sample, sensor frame */
+  imu_fwd_t fwd_z[IMU_BLOCK_MAX_SAMPLES];
+  float a_fwd_ms2[IMU_BLOCK_MAX_SAMPLES];      /* Forward accel, gravity removed (trace) */
+  float dv_ms[IMU_BLOCK_MAX_SAMPLES];          /* Stroke delta-v after each sample (trace) */
+} imu_block_t;
+
+/* Fill dt_us and dynamic_g from the raw samples and timestamps.
+ * last_ts_us carries the final timestamp across blocks; pass 0 to start a new
+ * stream (the first sample then gets dt_us = 0 and is not integrated). */
+void imu_block_prepare(imu_block_t* blk, int64_t* last_ts_us);
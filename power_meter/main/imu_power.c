@@ -5,9 +5,22 @@
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "imu_sensor.h"
 
 #define TAG "IMU_POWER"
 
+#if IMU_POWER_FIXED_POINT
+/* m/s per unit of stroke_dv_acc: (9.81 / LSB) m/s^2 per count, 2^-W_SHIFT
+ * per a_q unit, 1e-6 s per us */
+#define DV_ACC_TO_MS (9.81f / IMU_ACCEL_LSB_PER_G / (1 << IMU_POWER_W_SHIFT) * 1e-6f)
+/* m/s^2 per a_q unit */
+#define A_Q_TO_MS2 (9.81f / IMU_ACCEL_LSB_PER_G / (1 << IMU_POWER_W_SHIFT))
+/* Drag EMA weight 0.1 in Q15, matching the float path */
+#define DRAG_ALPHA_Q15 3277
+/* m per unit of stroke_dvdt_acc */
+#define DVDT_ACC_TO_M (DV_ACC_TO_MS * (1 << IMU_POWER_DVDT_SHIFT) * 1e-6f)
+#endif
+
 /* Dot product of two 3D vectors */
 static float dot3(const float a[3], const float b[3]) {
   return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
@@ -27,23 +40,29 @@ static bool normalize3(float v[3]) {
 /* Acceleration stddev above which calibration is considered motion-corrupted */
 #define CALIBRATION_STDDEV_WARN_G 0.05f
 
-void imu_calibrate(imu_calibration_t* cal, mpu6050_handle_t mpu) {
+void imu_calibrate(imu_calibration_t* cal) {
   float sum[3] = {0, 0, 0};
   float sum_sq[3] = {0, 0, 0};
   int count = 0;
+  int32_t gyro_sum[3] = {0, 0, 0};
+  int gyro_count = 0;
 
   ESP_LOGI(TAG, "Gravity calibration: hold still for 2 seconds...");
 
   for (int i = 0; i < CALIBRATION_SAMPLES; i++) {
-    mpu6050_acce_value_t acce;
-    if (mpu6050_get_acce(mpu, &acce) == ESP_OK) {
-      sum[0] += acce.acce_x;
-      sum[1] += acce.acce_y;
-      sum[2] += acce.acce_z;
-      sum_sq[0] += acce.acce_x * acce.acce_x;
-      sum_sq[1] += acce.acce_y * acce.acce_y;
-      sum_sq[2] += acce.acce_z * acce.acce_z;
+    imu_raw_sample_t raw;
+    if (imu_sensor_read_sample(&raw) == ESP_OK) {
+      const float a[3] = {raw.ax / IMU_ACCEL_LSB_PER_G, raw.ay / IMU_ACCEL_LSB_PER_G,
+                          raw.az / IMU_ACCEL_LSB_PER_G};
+      for (int j = 0; j < 3; j++) {
+        sum[j] += a[j];
+        sum_sq[j] += a[j] * a[j];
+      }
       count++;
+      gyro_sum[0] += raw.gx;
+      gyro_sum[1] += raw.gy;
+      gyro_sum[2] += raw.gz;
+      gyro_count++;
     }
     vTaskDelay(pdMS_TO_TICKS(50)); /* 20 Hz */
   }
@@ -81,6 +100,11 @@ void imu_calibrate(imu_calibration_t* cal, mpu6050_handle_t mpu) {
     return;
   }
 
+  if (gyro_count > 0) {
+    for (int i = 0; i < 3; i++) cal->gyro_bias[i] = (float)gyro_sum[i] / gyro_count;
+  }
+  cal->still_count = 0;
+  cal->ahrs.ready = false;
   cal->calibrated = true;
   ESP_LOGI(TAG, "Calibration done. Down unit vector: x=%.3f y=%.3f z=%.3f", cal->gravity[0],
            cal->gravity[1], cal->gravity[2]);
@@ -100,52 +124,324 @@ bool imu_orientation_ok(const imu_calibration_t* cal, const float forward[3]) {
     return true;
 }
 
+bool imu_calibration_matches(const imu_calibration_t* cal) {
+  float sum[3] = {0, 0, 0};
+  int count = 0;
+  for (int i = 0; i < 5; i++) {
+    imu_raw_sample_t raw;
+    if (imu_sensor_read_sample(&raw) == ESP_OK) {
+      sum[0] += raw.ax / IMU_ACCEL_LSB_PER_G;
+      sum[1] += raw.ay / IMU_ACCEL_LSB_PER_G;
+      sum[2] += raw.az / IMU_ACCEL_LSB_PER_G;
+      count++;
+    }
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+  if (count == 0)
+    return true;
+
+  float g[3] = {sum[0] / count, sum[1] / count, sum[2] / count};
+  float mag = sqrtf(dot3(g, g));
+  if (fabsf(mag - 1.0f) > 0.1f || !normalize3(g))
+    return true; /* Moving: can't judge, keep the stored vector */
+
+  float c = dot3(g, cal->gravity);
+  if (c < CAL_STORED_MIN_COS) {
+    ESP_LOGW(TAG, "Stored gravity is %.0f deg off the current reading, recalibrating",
+             acosf(c < -1.0f ? -1.0f : c) * 57.2958f);
+    return false;
+  }
+  return true;
+}
+
+/* Cosine of the ~2° change worth saving */
+#define GRAVITY_SAVE_COS 0.9994f
+
+/* rad/s per raw gyro count */
+#define GYRO_RAD_PER_COUNT (3.14159265f / 180.0f / IMU_GYRO_LSB_PER_DPS)
+#if IMU_POWER_FIXED_POINT
+/* Raw gyro count to AHRS_RATE_Q rad/s, times 2^8; folded at compile time */
+#define GYRO_RATE_Q_PER_COUNT_Q8 \
+  ((int64_t)(GYRO_RAD_PER_COUNT * (double)(1ll << (AHRS_RATE_Q + 8)) + 0.5))
+#endif
+
+/* Count still recovery samples; at the end of a long enough stretch, report
+ * whether the vector has moved far enough from the saved one to persist */
+static bool gravity_save_due(imu_calibration_t* cal, const imu_block_t* blk) {
+  bool due = false;
+  for (int i = 0; i < blk->count; i++) {
+    if (blk->phase[i] != STROKE_PHASE_RECOVERY || blk->dynamic_g[i] > GRAVITY_SAVE_STILL_G) {
+      cal->still_count = 0;
+    } else if (++cal->still_count >= GRAVITY_SAVE_STILL_SAMPLES) {
+      cal->still_count = 0;
+      due = true;
+    }
+  }
+  if (!due || dot3(cal->gravity, cal->saved) >= GRAVITY_SAVE_COS)
+    return false;
+  memcpy(cal->saved, cal->gravity, sizeof(cal->saved));
+  ESP_LOGD(TAG, "Gravity drifted to x=%.3f y=%.3f z=%.3f", cal->gravity[0], cal->gravity[1],
+           cal->gravity[2]);
+  return true;
+}
+
+bool imu_orientation_track_block(imu_calibration_t* cal,
+                                 imu_block_t* blk,
+                                 const float forward[3]) {
+  const int n = blk->count;
+  if (!cal->calibrated || n == 0)
+    return false;
+  imu_ahrs_t* ahrs = &cal->ahrs;
+
+  if (!ahrs->ready) {
+    const float bias_rad[3] = {cal->gyro_bias[0] * GYRO_RAD_PER_COUNT,
+                               cal->gyro_bias[1] * GYRO_RAD_PER_COUNT,
+                               cal->gyro_bias[2] * GYRO_RAD_PER_COUNT};
+    imu_ahrs_init(ahrs, cal->gravity, forward, bias_rad);
+  } else if (memcmp(ahrs->forward, forward, sizeof(ahrs->forward)) != 0) {
+    imu_ahrs_set_forward(ahrs, forward);
+  }
+
+  /* Per sample: one step per burst on the block means would lag the tilt
+   * the surge causes within the burst, biasing the projection for the whole
+   * block. Fixed-point builds step the integer filter on the raw counts. */
+  imu_fwd_t fwd[3];
+  imu_ahrs_forward(ahrs, fwd);
+  for (int i = 0; i < n; i++) {
+    if (blk->dt_us[i] > 0) {
+#if IMU_POWER_FIXED_POINT
+      const int32_t rate[3] = {(int32_t)((blk->gx[i] * GYRO_RATE_Q_PER_COUNT_Q8) >> 8),
+                               (int32_t)((blk->gy[i] * GYRO_RATE_Q_PER_COUNT_Q8) >> 8),
+                               (int32_t)((blk->gz[i] * GYRO_RATE_Q_PER_COUNT_Q8) >> 8)};
+      const int32_t a[3] = {blk->ax[i], blk->ay[i], blk->az[i]};
+      imu_ahrs_update(ahrs, rate, a, blk->dt_us[i], fwd);
+#else
+      const float inv_lsb = 1.0f / IMU_ACCEL_LSB_PER_G;
+      const float rate[3] = {blk->gx[i] * GYRO_RAD_PER_COUNT, blk->gy[i] * GYRO_RAD_PER_COUNT,
+                             blk->gz[i] * GYRO_RAD_PER_COUNT};
+      const float a[3] = {blk->ax[i] * inv_lsb, blk->ay[i] * inv_lsb, blk->az[i] * inv_lsb};
+      imu_ahrs_update(ahrs, rate, a, blk->dt_us[i] * 1e-6f, fwd);
+#endif
+    }
+    blk->fwd_x[i] = fwd[0];
+    blk->fwd_y[i] = fwd[1];
+    blk->fwd_z[i] = fwd[2];
+  }
+
+  imu_ahrs_up(ahrs, cal->gravity);
+  float bias_rad[3];
+  imu_ahrs_gyro_bias(ahrs, bias_rad);
+  for (int j = 0; j < 3; j++) cal->gyro_bias[j] = bias_rad[j] / GYRO_RAD_PER_COUNT;
+  return gravity_save_due(cal, blk);
+}
+
 void imu_power_init(imu_power_state_t* state) {
   memset(state, 0, sizeof(*state));
   state->mass_kg = TOTAL_MASS_KG;
   state->forward[0] = FORWARD_AXIS_X;
   state->forward[1] = FORWARD_AXIS_Y;
   state->forward[2] = FORWARD_AXIS_Z;
+#if IMU_POWER_VERBOSE
   state->verbose = false;
+#endif
+  speed_fusion_init(&state->speed);
 }
 
-void imu_power_update(imu_power_state_t* state,
-                      const imu_calibration_t* cal,
-                      const mpu6050_acce_value_t* acce,
-                      stroke_phase_t stroke_phase,
-                      float dt_s,
-                      float* out_power_w) {
-  *out_power_w = 0.0f;
+/* Gravity removal and forward projection are both linear in the raw reading:
+ *
+ *   a_fwd = dot(raw - dot(raw, down) * down, fwd)
+ *         = dot(raw, fwd - dot(down, fwd) * down)
+ *
+ * so they collapse into one dot product with a weight vector that only changes
+ * when the calibration or the axis setting does. scale folds in the unit
+ * conversion (g -> m/s^2, and counts -> g for raw blocks). */
+static void forward_weights(const imu_power_state_t* state,
+                            const imu_calibration_t* cal,
+                            float scale,
+                            float w[3]) {
+  float gf = dot3(cal->gravity, state->forward);
+  for (int i = 0; i < 3; i++) {
+    w[i] = (state->forward[i] - gf * cal->gravity[i]) * scale;
+  }
+}
 
-  if (!cal->calibrated || dt_s <= 0.0f)
-    return;
+/* Delta-v of the stroke in progress (diagnostics; the integrator keeps its
+ * own representation). */
+static inline float live_delta_v(const imu_power_state_t* state) {
+#if IMU_POWER_FIXED_POINT
+  return state->stroke_dv_acc * DV_ACC_TO_MS;
+#else
+  return state->stroke_delta_v_ms;
+#endif
+}
 
-  const float* forward = state->forward;
+#if IMU_POWER_VERBOSE
+static void log_sample(const imu_power_state_t* state,
+                       float x_g,
+                       float y_g,
+                       float z_g,
+                       float a_forward_ms2,
+                       stroke_phase_t stroke_phase) {
+  static const char* const phase_names[] = {"RECOVERY", "CATCH", "PULL", "RELEASE"};
+  float dv = live_delta_v(state);
+#if IMU_POWER_FIXED_POINT
+  float dt = state->stroke_dt_us * 1e-6f;
+#else
+  float dt = state->stroke_dt_s;
+#endif
+  ESP_LOGI(TAG, "acce x=%.3f y=%.3f z=%.3f | a_fwd=%.3f m/s^2 | phase=%s | dv=%.3f m/s dt=%.2f s",
+           x_g, y_g, z_g, a_forward_ms2, phase_names[stroke_phase], dv, dt);
+}
+#endif
 
-  /* Raw reading as array for dot products */
-  const float raw[3] = {acce->acce_x, acce->acce_y, acce->acce_z};
+#if IMU_POWER_FIXED_POINT
+#define CURVE_DV_MS(dv) ((dv) * DV_ACC_TO_MS)
+#else
+#define CURVE_DV_MS(dv) (dv)
+#endif
 
-  /* Remove gravity component: a_dynamic = raw - dot(raw,down)*down */
-  float gravity_component = dot3(raw, cal->gravity);
-  float dynamic[3] = {
-      raw[0] - gravity_component * cal->gravity[0],
-      raw[1] - gravity_component * cal->gravity[1],
-      raw[2] - gravity_component * cal->gravity[2],
-  };
+static void curve_start(imu_power_state_t* state) {
+  state->curve_t_us[0] = 0;
+  state->curve_dv[0] = 0;
+  state->curve_n = 1;
+  state->curve_bin_us = IMU_CURVE_BIN_US;
+  state->curve_next_us = IMU_CURVE_BIN_US;
+}
 
-  /* Project onto forward axis to get signed forward acceleration (in g) */
-  float a_forward_g = dot3(dynamic, forward);
+/* A bin boundary is due at elapsed time t_us. Runs once per bin, not per
+ * sample; the boundary lands on the first sample at or after it. */
+static void curve_mark(imu_power_state_t* state, int32_t t_us, imu_curve_dv_t dv) {
+  if (state->curve_n > IMU_CURVE_BINS) {
+    if (state->curve_bin_us >= IMU_CURVE_BIN_MAX_US) {
+      state->curve_next_us = INT32_MAX; /* Last bin runs on to release */
+      return;
+    }
+    for (int k = 1; k <= IMU_CURVE_BINS / 2; k++) {
+      state->curve_t_us[k] = state->curve_t_us[2 * k];
+      state->curve_dv[k] = state->curve_dv[2 * k];
+    }
+    state->curve_n = IMU_CURVE_BINS / 2 + 1;
+    state->curve_bin_us *= 2;
+    state->curve_next_us = state->curve_n * state->curve_bin_us;
+    if (t_us < state->curve_next_us)
+      return;
+  }
+  state->curve_t_us[state->curve_n] = t_us;
+  state->curve_dv[state->curve_n] = dv;
+  state->curve_n++;
+  state->curve_next_us = state->curve_n * state->curve_bin_us;
+}
 
-  /* Convert g to m/s^2 */
-  float a_forward_ms2 = a_forward_g * 9.81f;
+/* Close the curve at release and convert it to per-bin power */
+static void curve_finish(imu_power_state_t* state, int32_t t_us, imu_curve_dv_t dv) {
+  int n = state->curve_n;
+  if (n == 0)
+    return; /* Stroke began before the integrator saw its catch */
+  if (t_us > state->curve_t_us[n - 1]) {
+    if (n > IMU_CURVE_BINS)
+      n--; /* Full at the widest bins: the last one absorbs the rest */
+    state->curve_t_us[n] = t_us;
+    state->curve_dv[n] = dv;
+    n++;
+  }
 
-  if (state->verbose) {
-    static const char* const phase_names[] = {"RECOVERY", "CATCH", "PULL", "RELEASE"};
-    ESP_LOGI(TAG, "acce x=%.3f y=%.3f z=%.3f | a_fwd=%.3f m/s^2 | phase=%s | dv=%.3f m/s dt=%.2f s",
-             acce->acce_x, acce->acce_y, acce->acce_z, a_forward_ms2, phase_names[stroke_phase],
-             state->stroke_delta_v_ms, state->stroke_dt_s);
+  /* Same energy terms as finish_stroke(), per bin; drag by the trapezoid
+   * rule on the bin's ends */
+  const float m = state->mass_kg;
+  const float vc = state->speed_active ? state->speed_catch_ms : 0.0f;
+  const float drag = state->speed_active ? state->drag_force_n : 0.0f;
+  imu_power_curve_t* c = &state->curve;
+  c->bin_ms = (uint16_t)(state->curve_bin_us / 1000);
+  c->n_bins = (uint8_t)(n - 1);
+  float v0 = CURVE_DV_MS(state->curve_dv[0]);
+  for (int k = 0; k < n - 1; k++) {
+    float v1 = CURVE_DV_MS(state->curve_dv[k + 1]);
+    float dt = (state->curve_t_us[k + 1] - state->curve_t_us[k]) * 1e-6f;
+    float e = 0.5f * m * (v1 * v1 - v0 * v0) + m * vc * (v1 - v0) +
+              drag * (vc + 0.5f * (v0 + v1)) * dt;
+    float p = e / dt;
+    c->power_w[k] = p <= -32768.0f ? -32768 : p >= 32767.0f ? 32767 : (int16_t)lrintf(p);
+    v0 = v1;
   }
+  state->curve_n = 0;
+}
+
+/* Stroke power from the integrated delta-v and duration (see below). */
+static void finish_stroke(imu_power_state_t* state) {
+  const float m = state->mass_kg;
+  const float dv = state->stroke_delta_v_ms;
+  const float t = state->stroke_dt_s;
+  float energy_j = 0.5f * m * dv * dv;
+  if (state->speed_active) {
+    const float vc = state->speed_catch_ms;
+    energy_j += m * vc * dv + state->drag_force_n * (vc * t + state->stroke_dvdt_m);
+  }
+  state->avg_stroke_power_w = energy_j / t;
+  if (state->speed_active) {
+    ESP_LOGI(TAG, "Stroke: delta_v=%.3f m/s  v=%.2f m/s  drag=%.1f N  dur=%.2f s  power=%.1f W",
+             dv, state->speed_catch_ms, state->drag_force_n, t, state->avg_stroke_power_w);
+  } else {
+    ESP_LOGI(TAG, "Stroke: delta_v=%.3f m/s  dur=%.2f s  power=%.1f W", dv, t,
+             state->avg_stroke_power_w);
+  }
+}
+
+#if IMU_POWER_FIXED_POINT
 
+/* Integer counterpart of the float integrator below. Same transitions; the
+ * only float work is converting the totals once per stroke. */
+static inline void integrate_sample(imu_power_state_t* state,
+                                    stroke_phase_t stroke_phase,
+                                    int32_t a_q,
+                                    int32_t dt_us) {
+  bool new_stroke =
+      (stroke_phase == STROKE_PHASE_CATCH && state->prev_phase != STROKE_PHASE_CATCH &&
+       state->prev_phase != STROKE_PHASE_PULL);
+  if (new_stroke) {
+    state->stroke_dv_acc = 0;
+    state->stroke_dt_us = 0;
+    state->stroke_dvdt_acc = 0;
+    state->speed_catch_ms = state->speed.v_ms + state->speed_acc * DV_ACC_TO_MS;
+    curve_start(state);
+  }
+
+  state->speed_acc += (int64_t)(a_q - state->speed_bias_q) * dt_us;
+  if (a_q < state->min_a_q)
+    state->min_a_q = a_q;
+  if (stroke_phase == STROKE_PHASE_CATCH || stroke_phase == STROKE_PHASE_PULL) {
+    state->stroke_dv_acc += (int64_t)a_q * dt_us;
+    state->stroke_dt_us += dt_us;
+    state->stroke_dvdt_acc += (state->stroke_dv_acc >> IMU_POWER_DVDT_SHIFT) * dt_us;
+    if (state->stroke_dt_us >= state->curve_next_us)
+      curve_mark(state, (int32_t)state->stroke_dt_us, state->stroke_dv_acc);
+  }
+
+  bool stroke_ending =
+      (stroke_phase == STROKE_PHASE_RELEASE && state->prev_phase != STROKE_PHASE_RELEASE);
+  if (stroke_ending && state->stroke_dt_us > 0) {
+    state->stroke_delta_v_ms = state->stroke_dv_acc * DV_ACC_TO_MS;
+    state->stroke_dt_s = state->stroke_dt_us * 1e-6f;
+    state->stroke_dvdt_m = state->stroke_dvdt_acc * DVDT_ACC_TO_M;
+    state->drag_force_n = state->mass_kg * state->drag_accel_q * A_Q_TO_MS2;
+    finish_stroke(state);
+    curve_finish(state, (int32_t)state->stroke_dt_us, state->stroke_dv_acc);
+  }
+
+  if (stroke_phase == STROKE_PHASE_RECOVERY && a_q < 0) {
+    int64_t err = (int64_t)(-a_q) - state->drag_accel_q;
+    state->drag_accel_q += (int32_t)((err * DRAG_ALPHA_Q15) >> 15);
+  }
+
+  state->prev_phase = stroke_phase;
+}
+
+#else
+
+/* Advance the per-stroke integrator by one sample of forward acceleration. */
+static inline void integrate_sample(imu_power_state_t* state,
+                                    stroke_phase_t stroke_phase,
+                                    float a_forward_ms2,
+                                    float dt_s) {
   /* Detect stroke start: RECOVERY/RELEASE -> CATCH */
   bool new_stroke =
       (stroke_phase == STROKE_PHASE_CATCH && state->prev_phase != STROKE_PHASE_CATCH &&
@@ -153,12 +449,24 @@ void imu_power_update(imu_power_state_t* state,
   if (new_stroke) {
     state->stroke_delta_v_ms = 0.0f;
     state->stroke_dt_s = 0.0f;
+    state->stroke_dvdt_m = 0.0f;
+    state->speed_catch_ms = state->speed.v_ms;
+    curve_start(state);
   }
 
+  /* Speed estimate: mean step of speed_fusion's filter */
+  state->speed.v_ms += (a_forward_ms2 - state->speed.bias_ms2) * dt_s;
+  if (a_forward_ms2 < state->min_a_ms2)
+    state->min_a_ms2 = a_forward_ms2;
+
   /* Accumulate delta-v while paddle is in water */
   if (stroke_phase == STROKE_PHASE_CATCH || stroke_phase == STROKE_PHASE_PULL) {
     state->stroke_delta_v_ms += a_forward_ms2 * dt_s;
     state->stroke_dt_s += dt_s;
+    state->stroke_dvdt_m += state->stroke_delta_v_ms * dt_s;
+    int32_t t_us = (int32_t)(state->stroke_dt_s * 1e6f);
+    if (t_us >= state->curve_next_us)
+      curve_mark(state, t_us, state->stroke_delta_v_ms);
   }
 
   /* Compute power once at PULL->RELEASE transition.
@@ -173,26 +481,209 @@ void imu_power_update(imu_power_state_t* state,
    *   $\Delta t$ = duration of CATCH + PULL phases             (s)
    *   $m$        = total moving mass (paddler + boat + gear)   (kg)
    *
-   * Note: this omits the $m v_i \Delta v$ term (where $v_i$ is boat speed at
-   * catch) which dominates at cruising speed. GPS fusion (Phase 10) adds this
-   * correction via a running $\hat{v}$ estimate. */
+   * With a recent speed fix (speed_active) the boat's speed counts too. The
+   * paddler's force is $m a + D$ (the accelerometer sees the net of drag
+   * $D$), applied at speed $v_c + \Delta v(t)$ where $v_c$ is the fused
+   * estimate at the catch:
+   *
+   *   $E = \frac{1}{2} m \Delta v^2 + m v_c \Delta v + D (v_c \Delta t + \int \Delta v \, dt)$
+   *
+   * $m v_c \Delta v$ dominates at cruising speed. */
   bool stroke_ending =
       (stroke_phase == STROKE_PHASE_RELEASE && state->prev_phase != STROKE_PHASE_RELEASE);
   if (stroke_ending && state->stroke_dt_s > 0.0f) {
-    float dv = state->stroke_delta_v_ms;
-    state->avg_stroke_power_w = 0.5f * state->mass_kg * dv * dv / state->stroke_dt_s;
-    ESP_LOGI(TAG, "Stroke: delta_v=%.3f m/s  dur=%.2f s  power=%.1f W", dv, state->stroke_dt_s,
-             state->avg_stroke_power_w);
+    finish_stroke(state);
+    curve_finish(state, (int32_t)(state->stroke_dt_s * 1e6f), state->stroke_delta_v_ms);
   }
 
-  /* Drag estimation during recovery (kept for future GPS fusion) */
+  /* Drag force, smoothed over recovery. finish_stroke() and curve_finish()
+   * charge the drive with it while a speed estimate is active. */
   if (stroke_phase == STROKE_PHASE_RECOVERY && a_forward_ms2 < 0.0f) {
     float drag_estimate = -state->mass_kg * a_forward_ms2;
     state->drag_force_n = 0.9f * state->drag_force_n + 0.1f * drag_estimate;
   }
 
   state->prev_phase = stroke_phase;
+}
+
+#endif /* IMU_POWER_FIXED_POINT */
+
+void imu_power_update(imu_power_state_t* state,
+                      const imu_calibration_t* cal,
+                      const float accel_g[3],
+                      stroke_phase_t stroke_phase,
+                      float dt_s,
+                      float* out_power_w) {
+  *out_power_w = 0.0f;
+
+  if (!cal->calibrated || dt_s <= 0.0f)
+    return;
+
+  /* Signed forward acceleration with gravity removed, converted g -> m/s^2 */
+  float w[3];
+  forward_weights(state, cal, 9.81f, w);
+  float a_forward_ms2 = dot3(accel_g, w);
+
+#if IMU_POWER_VERBOSE
+  if (state->verbose) {
+    log_sample(state, accel_g[0], accel_g[1], accel_g[2], a_forward_ms2, stroke_phase);
+  }
+#endif
+
+#if IMU_POWER_FIXED_POINT
+  /* Compatibility path: callers with integer counts should use the block API */
+  integrate_sample(state, stroke_phase, (int32_t)(a_forward_ms2 / A_Q_TO_MS2),
+                   (int32_t)(dt_s * 1e6f));
+  state->speed.v_ms += state->speed_acc * DV_ACC_TO_MS;
+  state->speed_acc = 0;
+#else
+  integrate_sample(state, stroke_phase, a_forward_ms2, dt_s);
+#endif
 
   /* Always output last completed stroke power */
   *out_power_w = state->avg_stroke_power_w;
 }
+
+/* Lowest boat force since the last event, and restart the minimum */
+static inline float take_min_force(imu_power_state_t* state) {
+#if IMU_POWER_FIXED_POINT
+  float a_ms2 = state->min_a_q * A_Q_TO_MS2;
+  state->min_a_q = 0;
+#else
+  float a_ms2 = state->min_a_ms2;
+  state->min_a_ms2 = 0.0f;
+#endif
+  return state->mass_kg * a_ms2;
+}
+
+/* Report the current stroke power for every event confirmed at sample i */
+static inline void emit_events(imu_power_state_t* state,
+                               const stroke_event_t* events,
+                               int n_events,
+                               int* next_event,
+                               int i,
+                               float* event_power_w,
+                               float* event_dv_ms,
+                               imu_power_curve_t* event_curve,
+                               float* event_min_force_n) {
+  while (*next_event < n_events && events[*next_event].index == i) {
+    /* Between this stroke's release and the next catch the integrator holds
+     * its totals, so this is the confirmed stroke's delta-v and curve */
+    if (event_dv_ms)
+      event_dv_ms[*next_event] = live_delta_v(state);
+    if (event_curve)
+      event_curve[*next_event] = state->curve;
+    if (event_min_force_n)
+      event_min_force_n[*next_event] = take_min_force(state);
+    event_power_w[(*next_event)++] = state->avg_stroke_power_w;
+  }
+}
+
+void imu_power_update_block(imu_power_state_t* state,
+                            const imu_calibration_t* cal,
+                            imu_block_t* blk,
+                            const stroke_event_t* events,
+                            int n_events,
+                            float* event_power_w,
+                            float* event_dv_ms,
+                            imu_power_curve_t* event_curve,
+                            float* event_min_force_n) {
+  const int n = blk->count;
+  int next_event = 0;
+
+  if (cal->calibrated && n > 0) {
+    state->speed_active = speed_fusion_active(&state->speed, blk->ts_us[0]);
+#if IMU_POWER_FIXED_POINT
+    state->speed_bias_q = (int32_t)lrintf(state->speed.bias_ms2 / A_Q_TO_MS2);
+    /* Each sample's Q30 boat-forward vector, rounded to the weights'
+     * IMU_POWER_W_SHIFT bits; the projection and everything after it is
+     * integer. */
+    const int w_shift = AHRS_Q - IMU_POWER_W_SHIFT;
+    const int32_t w_round = 1 << (w_shift - 1);
+    int32_t a_fwd[IMU_BLOCK_MAX_SAMPLES];
+    for (int i = 0; i < n; i++) {
+      const int32_t wx = (blk->fwd_x[i] + w_round) >> w_shift;
+      const int32_t wy = (blk->fwd_y[i] + w_round) >> w_shift;
+      const int32_t wz = (blk->fwd_z[i] + w_round) >> w_shift;
+      a_fwd[i] = wx * blk->ax[i] + wy * blk->ay[i] + wz * blk->az[i];
+    }
+#define A_FWD_MS2(i) (a_fwd[i] * A_Q_TO_MS2)
+#define DT_ARG(i) (blk->dt_us[i])
+#else
+    const float scale = 9.81f / IMU_ACCEL_LSB_PER_G;
+
+    /* Pass 1: projection onto each sample's horizontal boat-forward vector,
+     * which is perpendicular to gravity, so this also removes it. No state is
+     * carried between samples: a plain multiply-accumulate loop. */
+    float a_fwd[IMU_BLOCK_MAX_SAMPLES];
+    for (int i = 0; i < n; i++) {
+      a_fwd[i] = scale * (blk->fwd_x[i] * blk->ax[i] + blk->fwd_y[i] * blk->ay[i] +
+                          blk->fwd_z[i] * blk->az[i]);
+    }
+#define A_FWD_MS2(i) (a_fwd[i])
+#define DT_ARG(i) (blk->dt_us[i] * 1e-6f)
+#endif
+
+    /* Pass 2: phase-driven integration. The verbose/trace choice is made
+     * once per block so the common path carries no diagnostic branch. */
+#if IMU_POWER_VERBOSE
+    if (state->verbose) {
+      const float inv_lsb = 1.0f / IMU_ACCEL_LSB_PER_G;
+      for (int i = 0; i < n; i++) {
+        log_sample(state, blk->ax[i] * inv_lsb, blk->ay[i] * inv_lsb, blk->az[i] * inv_lsb,
+                   A_FWD_MS2(i), blk->phase[i]);
+        if (blk->dt_us[i] > 0)
+          integrate_sample(state, blk->phase[i], a_fwd[i], DT_ARG(i));
+        if (state->trace) {
+          blk->a_fwd_ms2[i] = A_FWD_MS2(i);
+          blk->dv_ms[i] = live_delta_v(state);
+        }
+        emit_events(state, events, n_events, &next_event, i, event_power_w, event_dv_ms,
+                    event_curve, event_min_force_n);
+      }
+    } else
+#endif
+    if (state->trace) {
+      for (int i = 0; i < n; i++) {
+        if (blk->dt_us[i] > 0)
+          integrate_sample(state, blk->phase[i], a_fwd[i], DT_ARG(i));
+        blk->a_fwd_ms2[i] = A_FWD_MS2(i);
+        blk->dv_ms[i] = live_delta_v(state);
+        emit_events(state, events, n_events, &next_event, i, event_power_w, event_dv_ms,
+                    event_curve, event_min_force_n);
+      }
+    } else {
+      for (int i = 0; i < n; i++) {
+        if (blk->dt_us[i] > 0)
+          integrate_sample(state, blk->phase[i], a_fwd[i], DT_ARG(i));
+        emit_events(state, events, n_events, &next_event, i, event_power_w, event_dv_ms,
+                    event_curve, event_min_force_n);
+      }
+    }
+#undef A_FWD_MS2
+#undef DT_ARG
+
+    /* The covariance depends on elapsed time only: one step per block */
+    int64_t dt_sum_us = 0;
+    for (int i = 0; i < n; i++) {
+      if (blk->dt_us[i] > 0)
+        dt_sum_us += blk->dt_us[i];
+    }
+#if IMU_POWER_FIXED_POINT
+    state->speed.v_ms += state->speed_acc * DV_ACC_TO_MS;
+    state->speed_acc = 0;
+#endif
+    speed_fusion_predict(&state->speed, dt_sum_us * 1e-6f);
+  }
+
+  /* Not calibrated: still report something for every event */
+  while (next_event < n_events) {
+    if (event_dv_ms)
+      event_dv_ms[next_event] = live_delta_v(state);
+    if (event_curve)
+      event_curve[next_event] = state->curve;
+    if (event_min_force_n)
+      event_min_force_n[next_event] = 0.0f;
+    event_power_w[next_event++] = state->avg_stroke_power_w;
+  }
+}
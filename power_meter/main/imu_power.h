@@ -1,9 +1,23 @@
 #pragma once
 
 #include <stdbool.h>
-#include "mpu6050.h"
+#include <stdint.h>
+#include "imu_ahrs.h"
+#include "imu_block.h"
+#include "speed_fusion.h"
 #include "stroke_detector.h"
 
+/* 1 = per-sample logging (verbose:on) is built in. Production builds, with
+ * assertions disabled (NDEBUG), leave it out together with the branch that
+ * tests for it; override with -DIMU_POWER_VERBOSE=0/1. */
+#ifndef IMU_POWER_VERBOSE
+#ifdef NDEBUG
+#define IMU_POWER_VERBOSE 0
+#else
+#define IMU_POWER_VERBOSE 1
+#endif
+#endif
+
 /* Total moving mass: paddler + boat + gear (kg) */
 #define TOTAL_MASS_KG 100.0f
 
@@ -16,62 +30,211 @@
 /* Number of samples to average during gravity calibration (~2 seconds at 20Hz) */
 #define CALIBRATION_SAMPLES 40
 
+/* The tracked vector is worth persisting after GRAVITY_SAVE_STILL_SAMPLES
+ * consecutive recovery samples under GRAVITY_SAVE_STILL_G (2 s at the 100 Hz
+ * FIFO rate), if it has moved by more than ~2° since the last save */
+#define GRAVITY_SAVE_STILL_SAMPLES 200
+#define GRAVITY_SAVE_STILL_G 0.05f
+
+/* A stored gravity vector is reused at boot only if a still reading is within
+ * acos(CAL_STORED_MIN_COS) (~20°) of it */
+#define CAL_STORED_MIN_COS 0.94f
+
 /* Maximum |dot(gravity, forward)| before orientation is considered invalid.
  * 0.5 ≈ 30° — rejects face-up / face-down mounting. */
 #define ORIENTATION_MAX_FORWARD_G 0.5f
 
+#if IMU_POWER_FIXED_POINT
+/* Fractional bits of the forward-projection weights. |w| <= 1, so
+ * 3 * 32767 * 2^14 stays inside int32. */
+#define IMU_POWER_W_SHIFT 14
+/* stroke_dv_acc is ~1.4e13 per m/s; shifted down by this it stays well
+ * inside int64 when multiplied by dt_us and summed over a stroke */
+#define IMU_POWER_DVDT_SHIFT 20
+#endif
+
+/* Per-stroke power curve: instantaneous power over CATCH+PULL in at most
+ * IMU_CURVE_BINS bins. Bins start IMU_CURVE_BIN_US wide; when a stroke runs
+ * past the last one, neighbours merge in pairs and the width doubles, up to
+ * IMU_CURVE_BIN_MAX_US (32 x 160 ms covers STROKE_MAX_DURATION_US). Only
+ * the bin boundaries are kept, never the samples. */
+#define IMU_CURVE_BINS 32
+#define IMU_CURVE_BIN_US 20000
+#define IMU_CURVE_BIN_MAX_US 160000
+
+/* Instantaneous power is F * v = m * a * dv, the rate of change of the
+ * model's 0.5 * m * dv^2, so a bin's mean is its kinetic-energy change over
+ * its duration and the bins average to avg_stroke_power_w. Negative at the
+ * catch, while the boat is still slowing. With the speed estimate active the
+ * bins carry its m * v * dv and drag terms too (drag to within the
+ * trapezoid rule). */
+typedef struct {
+  uint16_t bin_ms; /* Bin width; the last bin ends at release and may be shorter */
+  uint8_t n_bins;  /* 0 until a stroke has finished */
+  int16_t power_w[IMU_CURVE_BINS]; /* Mean power per bin, W */
+} imu_power_curve_t;
+
+#if IMU_POWER_FIXED_POINT
+typedef int64_t imu_curve_dv_t; /* stroke_dv_acc units */
+#else
+typedef float imu_curve_dv_t; /* m/s */
+#endif
+
 typedef struct {
-  /* Gravity vector captured at calibration (magnitude ~1g, points down) */
+  /* Gravity unit vector in the sensor frame (at-rest accelerometer
+   * direction). Seeded by imu_calibrate() or storage, then follows the
+   * attitude filter (imu_orientation_track_block()). */
   float gravity[3];
   bool calibrated;
+  float gyro_bias[3]; /* Raw counts; seeded by imu_calibrate(), then learned */
+
+  /* imu_orientation_track_block() state */
+  imu_ahrs_t ahrs;    /* Re-levelled from gravity when !ahrs.ready */
+  float saved[3];     /* Last vector handed to storage; set by the caller */
+  int still_count;
 } imu_calibration_t;
 
 typedef struct {
-  /* Settings — owned exclusively by the IMU task, updated via settings queue */
+  /* Settings — owned exclusively by the IMU task, updated from s_config (main.c) */
   float mass_kg;    /* Total moving mass: paddler + boat + gear (kg) */
   float forward[3]; /* Forward direction unit vector */
+#if IMU_POWER_VERBOSE
   bool verbose;     /* Per-sample accel logging enabled */
+#endif
+  bool trace;       /* Fill per-sample a_fwd_ms2/dv_ms in blocks (telemetry) */
 
-  /* Drag force estimate, smoothed during recovery (N).
-   * Reserved for future GPS-fusion work; not used in power calculation yet. */
+  /* Drag force estimate, smoothed during recovery (N). Used in stroke power
+   * while the speed estimate is active. Fixed-point builds refresh it from
+   * drag_accel_q once per stroke. */
   float drag_force_n;
 
+  /* Boat speed (speed_fusion.h). The integrator advances the mean every
+   * sample; the caller applies fixes between blocks. */
+  speed_fusion_t speed;
+  bool speed_active;    /* A recent fix, as of the block's first sample */
+  float speed_catch_ms; /* Speed estimate at the stroke's catch */
+  /* Integral of delta-v over CATCH+PULL (m): distance covered beyond
+   * speed_catch_ms * stroke_dt_s. Fixed-point builds convert from
+   * stroke_dvdt_acc at stroke end. */
+  float stroke_dvdt_m;
+
   /* Per-stroke velocity change: integral of a_forward over CATCH+PULL only.
-   * Reset at RECOVERY->CATCH transition. Drift bounded to one stroke (~1s). */
+   * Reset at RECOVERY->CATCH transition. Drift bounded to one stroke (~1s).
+   * Fixed-point builds integrate into stroke_dv_acc and convert at stroke end. */
   float stroke_delta_v_ms;
 
   /* Elapsed time within the active stroke (s), reset with delta_v. */
   float stroke_dt_s;
 
+#if IMU_POWER_FIXED_POINT
+  /* Integer integrator state. Forward acceleration a_q is carried as raw
+   * counts scaled by 2^IMU_POWER_W_SHIFT. */
+  int64_t stroke_dv_acc; /* sum(a_q * dt_us) over CATCH+PULL */
+  int64_t stroke_dt_us;  /* CATCH+PULL duration */
+  int32_t drag_accel_q;  /* EMA of -a_q during recovery */
+  int64_t stroke_dvdt_acc; /* sum((stroke_dv_acc >> IMU_POWER_DVDT_SHIFT) * dt_us) */
+  int64_t speed_acc;     /* sum((a_q - speed_bias_q) * dt_us) this block */
+  int32_t speed_bias_q;  /* speed.bias_ms2 in a_q units, per block */
+  int32_t min_a_q;       /* min_a_ms2 in a_q units */
+#else
+  /* Lowest forward acceleration since the last reported stroke, capped at 0:
+   * the boat slows through the recovery and into the catch */
+  float min_a_ms2;
+#endif
+
+  /* Power curve of the stroke in progress: elapsed time and delta-v at each
+   * bin boundary (curve_n of them, boundary 0 at the catch) */
+  int32_t curve_t_us[IMU_CURVE_BINS + 1];
+  imu_curve_dv_t curve_dv[IMU_CURVE_BINS + 1];
+  int curve_n;
+  int32_t curve_bin_us;
+  int32_t curve_next_us; /* Elapsed time at which the next boundary is due */
+
   /* Previous phase. Used to detect transitions, not the phase value itself. */
   stroke_phase_t prev_phase;
 
   /* Power of last completed stroke (W).
-   * P = 0.5 * mass * delta_v^2 / stroke_dt
+   * P = 0.5 * mass * delta_v^2 / stroke_dt, plus the speed and drag terms
+   * while speed_active (see integrate_sample()).
    * Updated once per stroke at PULL->RELEASE transition. */
   float avg_stroke_power_w;
+  /* Power curve of the same stroke, updated with it */
+  imu_power_curve_t curve;
 } imu_power_state_t;
 
-/* Run stationary gravity calibration. Hold device still for CALIBRATION_SAMPLES.
- * Logs progress to serial. Must complete before imu_power_update() is called. */
-void imu_calibrate(imu_calibration_t* cal, mpu6050_handle_t mpu);
+/* Run stationary gravity calibration. Hold device still for CALIBRATION_SAMPLES
+ * (imu_sensor_read_sample()). Also seeds the gyro bias. Logs progress to serial. Must complete before
+ * imu_power_update() is called. */
+void imu_calibrate(imu_calibration_t* cal);
 
 /* Returns true if the calibrated gravity vector is sufficiently perpendicular
  * to the forward axis (device is not face-up or face-down).
  * forward must be a unit vector (same as imu_power_state_t.forward). */
 bool imu_orientation_ok(const imu_calibration_t* cal, const float forward[3]);
 
+/* Check a gravity vector restored from storage against a quick reading
+ * (~50 ms). Returns false only if the device is still and clearly oriented
+ * differently (e.g. remounted); if it is moving, the stored vector is kept and
+ * left to imu_orientation_track_block(). */
+bool imu_calibration_matches(const imu_calibration_t* cal);
+
+/* Run the attitude filter (imu_ahrs.h) through a block (dynamic_g and phase
+ * filled) and write the boat-forward vector at each sample to
+ * blk->fwd_x/y/z. forward is the configured sensor-frame axis
+ * (imu_power_state_t.forward); a change re-aims the heading. The filter
+ * steps per sample; with IMU_POWER_FIXED_POINT it is the integer step on the
+ * raw counts. cal->gravity and cal->gyro_bias follow the filter. Returns true at the end of a still stretch when gravity has moved
+ * away from cal->saved, i.e. it is worth persisting (cal->saved is then
+ * updated). No-op until calibrated. */
+bool imu_orientation_track_block(imu_calibration_t* cal,
+                                 imu_block_t* blk,
+                                 const float forward[3]);
+
 void imu_power_init(imu_power_state_t* state);
 
-/* Feed one accelerometer sample into the power estimator.
- *   acce        - raw reading from mpu6050_get_acce()
+/* Feed one accelerometer sample into the power estimator. Uses cal->gravity
+ * and the fixed sensor-frame forward axis; attitude tracking is only done by
+ * the block path.
+ *   accel_g     - accelerometer reading (g), sensor frame
  *   stroke_phase - current phase from stroke_detector
  *   dt_s        - seconds since last call
  *   out_power_w - estimated power (W)
  */
 void imu_power_update(imu_power_state_t* state,
                       const imu_calibration_t* cal,
-                      const mpu6050_acce_value_t* acce,
+                      const float accel_g[3],
                       stroke_phase_t stroke_phase,
                       float dt_s,
                       float* out_power_w);
+
+/* Feed a block of samples prepared by imu_block_prepare() with phases from
+ * stroke_detector_update_block() and boat-forward vectors from
+ * imu_orientation_track_block(). Forward acceleration is the projection onto
+ * that horizontal vector, so gravity drops out without a separate removal
+ * step; projection runs as one pass over the block and the
+ * calibration/verbose checks happen once per block (verbose only with
+ * IMU_POWER_VERBOSE).
+ * With IMU_POWER_FIXED_POINT the projection and integration are
+ * integer-only on the raw counts and the Q30 forward vectors; float is used
+ * once per block (speed bias) and once per stroke (power).
+ *   events/n_events - strokes confirmed in this block
+ *   event_power_w   - power reported for each event (n_events entries), as
+ *                     of the sample that confirmed it
+ *   event_dv_ms     - that stroke's delta-v (m/s), same layout; may be NULL
+ *   event_curve     - that stroke's power curve, same layout; may be NULL
+ *   event_min_force_n - lowest boat force (N, <= 0) since the previous event,
+ *                     same layout; may be NULL
+ * With state->trace set, blk->a_fwd_ms2 and blk->dv_ms are filled too;
+ * otherwise they are left untouched.
+ * state->speed is advanced through the block; apply speed fixes
+ * (speed_fusion_correct()) before the call.
+ */
+void imu_power_update_block(imu_power_state_t* state,
+                            const imu_calibration_t* cal,
+                            imu_block_t* blk,
+                            const stroke_event_t* events,
+                            int n_events,
+                            float* event_power_w,
+                            float* event_dv_ms,
+                            imu_power_curve_t* event_curve,
+                            float* event_min_force_n);
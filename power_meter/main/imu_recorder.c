@@ -0,0 +1,319 @@
+#include "imu_recorder.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "perf_stats.h"
+#include "spsc_ring.h"
+#include "task_plan.h"
+#include "wear_levelling.h"
+#include "wifi_log_server.h"
+
+#define TAG "IMU_REC"
+#define PARTITION_LABEL "imu_rec"
+
+/* 1024 records = ~10 s at 100 Hz: covers a sector erase or a slow WL
+ * housekeeping cycle with plenty of margin. */
+#define RING_CAPACITY 1024
+#define WRITER_PERIOD_MS 100
+/* Rewrite the header every N data sectors so a brown-out loses at most that
+ * many sectors of an otherwise intact session (~55 s at 100 Hz). */
+#define HEADER_REFRESH_SECTORS 16
+#define SECTOR_BUF_SIZE 4096
+
+_Static_assert(sizeof(imu_record_t) == 18, "imu_record_t must stay 18 bytes");
+_Static_assert(sizeof(imu_record_header_t) <= IMU_RECORDER_HEADER_SIZE, "header too large");
+
+typedef enum {
+  REC_IDLE,
+  REC_RUNNING,  /* Producer pushing */
+  REC_STOPPING, /* Producer stopped, writer draining */
+} rec_state_t;
+
+static spsc_ring_t s_ring;
+static imu_record_t s_ring_storage[RING_CAPACITY];
+static _Atomic int s_state = REC_IDLE;
+static imu_record_header_t s_pending; /* Written by start(), read by the writer on open */
+
+/* ---- writer-owned state ---- */
+static wl_handle_t s_wl = WL_INVALID_HANDLE;
+static size_t s_sector_size;
+static size_t s_data_end; /* End of the data area (sectors after the header) */
+static bool s_open;
+static imu_record_header_t s_header;
+static uint8_t s_sector_buf[SECTOR_BUF_SIZE];
+static size_t s_buf_len;   /* Bytes pending in s_sector_buf */
+static size_t s_data_addr; /* Flash address s_sector_buf will be written to */
+static int s_sectors_since_header;
+
+/* ---- flash helpers ---- */
+
+static esp_err_t write_header(void) {
+  uint8_t buf[IMU_RECORDER_HEADER_SIZE];
+  memset(buf, 0xFF, sizeof(buf));
+  memcpy(buf, &s_header, sizeof(s_header));
+  esp_err_t err = wl_erase_range(s_wl, 0, s_sector_size);
+  if (err == ESP_OK)
+    err = wl_write(s_wl, 0, buf, sizeof(buf));
+  return err;
+}
+
+/* Write the pending buffer at s_data_addr. A full sector advances the write
+ * position; a partial one (session end) is written in place. */
+static esp_err_t flush_sector(void) {
+  esp_err_t err = wl_erase_range(s_wl, s_data_addr, s_sector_size);
+  if (err == ESP_OK && s_buf_len > 0)
+    err = wl_write(s_wl, s_data_addr, s_sector_buf, s_buf_len);
+  if (err != ESP_OK)
+    return err;
+
+  if (s_buf_len == s_sector_size) {
+    s_data_addr += s_sector_size;
+    s_buf_len = 0;
+    if (++s_sectors_since_header >= HEADER_REFRESH_SECTORS) {
+      s_sectors_since_header = 0;
+      err = write_header();
+    }
+  }
+  return err;
+}
+
+static size_t records_per_sector(void) {
+  return s_sector_size / sizeof(imu_record_t);
+}
+
+static size_t max_records(void) {
+  return (s_data_end / s_sector_size - 1) * records_per_sector();
+}
+
+static void open_session(void) {
+  s_header = s_pending;
+  s_buf_len = 0;
+  s_data_addr = s_sector_size;
+  s_sectors_since_header = 0;
+  s_open = true;
+  if (write_header() != ESP_OK)
+    ESP_LOGE(TAG, "Header write failed");
+  ESP_LOGI(TAG, "Recording started (%u records max)", (unsigned)max_records());
+}
+
+static void close_session(void) {
+  s_header.dropped = atomic_load_explicit(&s_ring.dropped, memory_order_relaxed);
+  if (s_buf_len > 0 && flush_sector() != ESP_OK)
+    ESP_LOGE(TAG, "Final sector write failed");
+  if (write_header() != ESP_OK)
+    ESP_LOGE(TAG, "Header write failed");
+  s_open = false;
+  ESP_LOGI(TAG, "Recording stopped: %u records, %u dropped", (unsigned)s_header.record_count,
+           (unsigned)s_header.dropped);
+}
+
+/* Move everything queued into the sector buffer, writing sectors as they
+ * fill. Returns false once the partition is full or a write failed. */
+static bool drain_ring(void) {
+  while (1) {
+    if (s_data_addr >= s_data_end)
+      return false;
+
+    size_t room = (s_sector_size - s_buf_len) / sizeof(imu_record_t);
+    size_t n = spsc_ring_pop(&s_ring, s_sector_buf + s_buf_len, room);
+    if (n == 0)
+      return true;
+    s_buf_len += n * sizeof(imu_record_t);
+    s_header.record_count += (uint32_t)n;
+
+    /* Records never straddle sectors: pad the tail so the next sector starts
+     * on a record boundary. The pad is 0xFF and skipped on download. */
+    if (s_sector_size - s_buf_len < sizeof(imu_record_t)) {
+      memset(s_sector_buf + s_buf_len, 0xFF, s_sector_size - s_buf_len);
+      s_buf_len = s_sector_size;
+      if (flush_sector() != ESP_OK) {
+        ESP_LOGE(TAG, "Sector write failed at 0x%x", (unsigned)s_data_addr);
+        return false;
+      }
+    }
+  }
+}
+
+static void writer_task(void* arg) {
+  while (1) {
+    vTaskDelay(pdMS_TO_TICKS(WRITER_PERIOD_MS));
+
+    int state = atomic_load_explicit(&s_state, memory_order_acquire);
+    if (state == REC_IDLE)
+      continue;
+    if (!s_open)
+      open_session();
+
+    if (!drain_ring()) {
+      /* Nowhere to put the rest: discard it and end the session */
+      spsc_ring_clear(&s_ring);
+      if (state == REC_RUNNING) {
+        ESP_LOGW(TAG, "Partition full, stopping");
+        imu_recorder_stop();
+      }
+    }
+
+    /* The producer stopped pushing before setting STOPPING, so once the ring
+     * is empty here nothing else will arrive. */
+    if (state == REC_STOPPING && spsc_ring_count(&s_ring) == 0) {
+      close_session();
+      atomic_store_explicit(&s_state, REC_IDLE, memory_order_release);
+    }
+  }
+}
+
+/* ---- download ---- */
+
+static esp_err_t record_get_handler(httpd_req_t* req) {
+  if (atomic_load_explicit(&s_state, memory_order_acquire) != REC_IDLE) {
+    httpd_resp_set_status(req, "409 Conflict");
+    return httpd_resp_sendstr(req, "Recording in progress; stop it first\n");
+  }
+
+  imu_record_header_t hdr;
+  if (wl_read(s_wl, 0, &hdr, sizeof(hdr)) != ESP_OK || hdr.magic != IMU_RECORDER_MAGIC ||
+      hdr.version != IMU_RECORDER_VERSION) {
+    return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No recorded session");
+  }
+
+  uint8_t* buf = malloc(s_sector_size);
+  if (!buf)
+    return httpd_resp_send_500(req);
+
+  httpd_resp_set_type(req, "application/octet-stream");
+  httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"session.imr\"");
+
+  uint8_t hbuf[IMU_RECORDER_HEADER_SIZE];
+  memset(hbuf, 0, sizeof(hbuf));
+  memcpy(hbuf, &hdr, sizeof(hdr));
+  esp_err_t err = httpd_resp_send_chunk(req, (const char*)hbuf, sizeof(hbuf));
+
+  /* One sector per chunk, dropping the per-sector pad */
+  size_t addr = s_sector_size;
+  uint32_t remaining = hdr.record_count;
+  while (err == ESP_OK && remaining > 0) {
+    size_t n = records_per_sector();
+    if (n > remaining)
+      n = remaining;
+    size_t len = n * sizeof(imu_record_t);
+    err = wl_read(s_wl, addr, buf, len);
+    if (err == ESP_OK)
+      err = httpd_resp_send_chunk(req, (const char*)buf, len);
+    addr += s_sector_size;
+    remaining -= (uint32_t)n;
+  }
+  free(buf);
+
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Download aborted: %s", esp_err_to_name(err));
+    return err;
+  }
+  return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* ---- public API ---- */
+
+esp_err_t imu_recorder_init(void) {
+  spsc_ring_init(&s_ring, s_ring_storage, sizeof(imu_record_t), RING_CAPACITY);
+
+  const esp_partition_t* part =
+      esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, PARTITION_LABEL);
+  if (!part) {
+    ESP_LOGW(TAG, "No '%s' partition, recorder disabled", PARTITION_LABEL);
+    return ESP_ERR_NOT_FOUND;
+  }
+  esp_err_t err = wl_mount(part, &s_wl);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "wl_mount failed: %s", esp_err_to_name(err));
+    return err;
+  }
+  s_sector_size = wl_sector_size(s_wl);
+  if (s_sector_size > SECTOR_BUF_SIZE) {
+    ESP_LOGE(TAG, "Sector size %u unsupported", (unsigned)s_sector_size);
+    wl_unmount(s_wl);
+    s_wl = WL_INVALID_HANDLE;
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  s_data_end = wl_size(s_wl) / s_sector_size * s_sector_size;
+
+  /* Lowest application priority: flash erases can take tens of ms */
+  TaskHandle_t task;
+  xTaskCreatePinnedToCore(writer_task, "imu_rec", 3 * 1024, NULL, TASK_PRIO_RECORDER, &task,
+                          TASK_CORE_RADIO);
+  perf_stats_register_task(task);
+
+  static const httpd_uri_t record_uri = {
+      .uri = "/record",
+      .method = HTTP_GET,
+      .handler = record_get_handler,
+  };
+  wifi_log_server_register_uri(&record_uri);
+
+  ESP_LOGI(TAG, "Recorder ready: %u records (~%u min at 100 Hz)", (unsigned)max_records(),
+           (unsigned)(max_records() / 6000));
+  return ESP_OK;
+}
+
+esp_err_t imu_recorder_start(const imu_record_header_t* header) {
+  if (s_wl == WL_INVALID_HANDLE)
+    return ESP_ERR_INVALID_STATE;
+  if (atomic_load_explicit(&s_state, memory_order_acquire) != REC_IDLE) {
+    ESP_LOGW(TAG, "Previous session still closing");
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  s_pending = *header;
+  s_pending.magic = IMU_RECORDER_MAGIC;
+  s_pending.version = IMU_RECORDER_VERSION;
+  s_pending.record_size = sizeof(imu_record_t);
+  s_pending.record_count = 0;
+  s_pending.dropped = 0;
+  s_pending.accel_lsb_per_g = IMU_ACCEL_LSB_PER_G;
+  s_pending.start_us = esp_timer_get_time();
+
+  /* The writer is idle, so the ring is ours to reset. Release publishes
+   * s_pending before the writer can observe RUNNING. */
+  spsc_ring_clear(&s_ring);
+  atomic_store_explicit(&s_ring.dropped, 0, memory_order_relaxed);
+  atomic_store_explicit(&s_state, REC_RUNNING, memory_order_release);
+  return ESP_OK;
+}
+
+void imu_recorder_stop(void) {
+  int expected = REC_RUNNING;
+  atomic_compare_exchange_strong(&s_state, &expected, REC_STOPPING);
+}
+
+bool imu_recorder_active(void) {
+  return atomic_load_explicit(&s_state, memory_order_relaxed) == REC_RUNNING;
+}
+
+void imu_recorder_push_block(const imu_block_t* blk, const stroke_event_t* events, int n_events) {
+  if (!imu_recorder_active())
+    return;
+
+  int next_event = 0;
+  for (int i = 0; i < blk->count; i++) {
+    imu_record_t rec = {
+        .t_us = (uint32_t)blk->ts_us[i],
+        .ax = blk->ax[i],
+        .ay = blk->ay[i],
+        .az = blk->az[i],
+        .gx = blk->gx[i],
+        .gy = blk->gy[i],
+        .gz = blk->gz[i],
+        .phase = (uint8_t)blk->phase[i],
+    };
+    if (next_event < n_events && events[next_event].index == i) {
+      rec.flags |= IMU_RECORD_FLAG_STROKE;
+      next_event++;
+    }
+    spsc_ring_push(&s_ring, &rec);
+  }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "imu_block.h"
+#include "stroke_detector.h"
+
+/* Binary session recorder for raw IMU samples.
+ *
+ * power_update_task pushes one record per sample into a lock-free SPSC ring;
+ * a low-priority writer task drains it into the "imu_rec" wear-levelled data
+ * partition. The last session is served as a single file at GET /record.
+ *
+ * File layout (little-endian):
+ *   imu_record_header_t, padded to IMU_RECORDER_HEADER_SIZE bytes
+ *   record_count x imu_record_t
+ */
+
+#define IMU_RECORDER_MAGIC 0x52554D49 /* "IMUR" */
+#define IMU_RECORDER_VERSION 2
+#define IMU_RECORDER_HEADER_SIZE 64
+
+/* Record flags */
+#define IMU_RECORD_FLAG_STROKE 0x01 /* A stroke was confirmed at this sample */
+
+/* One sample, 18 bytes. Acceleration and rate are kept in raw counts
+ * (header.accel_lsb_per_g per g, IMU_GYRO_LSB_PER_DPS per deg/s) rather than
+ * float: half the size and exactly what the estimator saw. t_us is the low 32 bits of the
+ * esp_timer timestamp; it wraps every ~71 minutes. The decoder anchors the
+ * first record against header.start_us (a FIFO burst may predate it by a few
+ * ms, so use a signed difference) and unwraps each record against the
+ * previous one. */
+typedef struct __attribute__((packed)) {
+  uint32_t t_us;
+  int16_t ax, ay, az;
+  int16_t gx, gy, gz;
+  uint8_t phase; /* stroke_phase_t after this sample */
+  uint8_t flags; /* IMU_RECORD_FLAG_* */
+} imu_record_t;
+
+/* Session header: everything needed to replay the session offline. */
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;
+  uint32_t record_count; /* Final count; updated periodically while recording */
+  uint32_t dropped;      /* Samples lost to a full ring */
+  int64_t start_us;      /* esp_timer time when recording started */
+  float accel_lsb_per_g;
+  float gravity[3]; /* Tracked gravity vector at start (g), sensor frame */
+  float forward[3];
+  float mass_kg;
+  float catch_g;
+  float recovery_g;
+} imu_record_header_t;
+
+/* Mount the partition, start the writer task and register GET /record with
+ * wifi_log_server. Recording is unavailable (but harmless to call) if the
+ * partition is missing. */
+esp_err_t imu_recorder_init(void);
+
+/* Begin a new session, overwriting the previous one. header supplies the
+ * calibration and settings fields; the rest is filled in here. Call from the
+ * producer task. */
+esp_err_t imu_recorder_start(const imu_record_header_t* header);
+
+/* End the session. Queued records are still written out. */
+void imu_recorder_stop(void);
+
+bool imu_recorder_active(void);
+
+/* Producer side: queue every sample of a processed block. Never blocks;
+ * samples that don't fit are counted in header.dropped. */
+void imu_recorder_push_block(const imu_block_t* blk, const stroke_event_t* events, int n_events);
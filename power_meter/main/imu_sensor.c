@@ -0,0 +1,394 @@
+#include "imu_sensor.h"
+#include "driver/i2c_master.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "perf_stats.h"
+
+#define TAG "IMU_SENSOR"
+
+#define I2C_TIMEOUT_MS 100
+
+/* FIFO is 1024 bytes; one sample is 12 bytes, accel then gyro, each
+ * XH XL YH YL ZH ZL (the sensor orders FIFO data by register address) */
+#define FIFO_SIZE_BYTES 1024
+#define FIFO_SAMPLE_BYTES 12
+
+#define FIFO_EN_GYRO 0x70 /* XG | YG | ZG */
+#define FIFO_EN_ACCEL 0x08
+#define USER_CTRL_FIFO_EN 0x40
+#define USER_CTRL_FIFO_RESET 0x04
+#define INT_ENABLE_DATA_RDY 0x01
+#define INT_ENABLE_MOT 0x40
+#define INT_PIN_CFG_LATCH 0x20
+#define ACCEL_CONFIG_FS_4G 0x08
+#define GYRO_CONFIG_FS_500DPS 0x08
+#define PWR1_CLKSEL_PLL_XGYRO 0x01
+#define WHO_AM_I_MPU6050 0x68 /* Whatever AD0 selects */
+#define ACCEL_CONFIG_FS_MASK 0x18
+#define ACCEL_HPF_5HZ 0x01
+#define PWR1_CYCLE 0x20
+#define PWR1_TEMP_DIS 0x08
+#define PWR2_LP_WAKE_5HZ 0x40
+#define PWR2_STBY_GYRO 0x07
+
+/* DLPF_CFG 1..6 accel bandwidth (Hz); 0 and 7 switch the gyro to an 8 kHz
+ * clock, which the ODR arithmetic doesn't allow for */
+static const uint16_t DLPF_BANDWIDTH_HZ[] = {0, 184, 94, 44, 21, 10, 5};
+
+static i2c_master_bus_handle_t s_bus;
+static i2c_master_dev_handle_t s_dev;
+static TaskHandle_t s_task;
+static gpio_num_t s_int_pin = GPIO_NUM_NC;
+
+/* Selected by imu_sensor_set_odr(); the defaults are its choice for
+ * IMU_FIFO_ODR_HZ */
+static uint8_t s_smplrt_div = (1000 / IMU_FIFO_ODR_HZ) - 1;
+static uint8_t s_dlpf_cfg = 0x04;
+static uint32_t s_period_us = 1000000 / IMU_FIFO_ODR_HZ;
+
+/* Written by the data-ready ISR, read by the IMU task under s_drdy_lock.
+ * s_drdy_seq counts samples the sensor has produced since the last FIFO reset;
+ * s_drdy_first_us and s_drdy_us are the esp_timer times of the first and the
+ * most recent one. */
+static portMUX_TYPE s_drdy_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_drdy_seq;
+static int64_t s_drdy_first_us;
+static int64_t s_drdy_us;
+static uint32_t s_drdy_pending;
+static uint32_t s_burst = IMU_FIFO_ODR_HZ / IMU_FIFO_BURSTS_PER_S;
+
+/* Samples drained from the FIFO since the last reset (IMU task only) */
+static uint32_t s_read_seq;
+
+esp_err_t imu_sensor_init(gpio_num_t sda, gpio_num_t scl, uint32_t scl_hz, uint8_t addr) {
+  const i2c_master_bus_config_t bus_cfg = {
+      .i2c_port = -1,
+      .sda_io_num = sda,
+      .scl_io_num = scl,
+      .clk_source = I2C_CLK_SRC_DEFAULT,
+      .glitch_ignore_cnt = 7,
+      .flags.enable_internal_pullup = true,
+  };
+  esp_err_t err = i2c_new_master_bus(&bus_cfg, &s_bus);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "I2C bus setup failed: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  const i2c_device_config_t dev_cfg = {
+      .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+      .device_address = addr,
+      .scl_speed_hz = scl_hz,
+  };
+  err = i2c_master_bus_add_device(s_bus, &dev_cfg, &s_dev);
+  if (err != ESP_OK)
+    ESP_LOGE(TAG, "I2C device setup failed: %s", esp_err_to_name(err));
+  return err;
+}
+
+esp_err_t imu_sensor_write_reg(uint8_t reg, uint8_t val) {
+  const uint8_t buf[2] = {reg, val};
+  return i2c_master_transmit(s_dev, buf, sizeof(buf), I2C_TIMEOUT_MS);
+}
+
+esp_err_t imu_sensor_read_regs(uint8_t reg, uint8_t* buf, size_t len) {
+  return i2c_master_transmit_receive(s_dev, &reg, 1, buf, len, I2C_TIMEOUT_MS);
+}
+
+esp_err_t imu_sensor_configure(void) {
+  uint8_t who = 0;
+  esp_err_t err = imu_sensor_read_regs(IMU_REG_WHO_AM_I, &who, 1);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "No answer at the MPU6050 address: %s", esp_err_to_name(err));
+    return err;
+  }
+  /* Clones and the MPU6500 family answer differently but share the map */
+  if (who != WHO_AM_I_MPU6050)
+    ESP_LOGW(TAG, "WHO_AM_I 0x%02x, expected 0x%02x", who, WHO_AM_I_MPU6050);
+
+  err = imu_sensor_write_reg(IMU_REG_PWR_MGMT_1, PWR1_CLKSEL_PLL_XGYRO);
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_ACCEL_CONFIG, ACCEL_CONFIG_FS_4G);
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_GYRO_CONFIG, GYRO_CONFIG_FS_500DPS);
+  if (err != ESP_OK)
+    ESP_LOGE(TAG, "Sensor setup failed: %s", esp_err_to_name(err));
+  return err;
+}
+
+esp_err_t imu_sensor_read_sample(imu_raw_sample_t* sample) {
+  uint8_t p[14];
+  esp_err_t err = imu_sensor_read_regs(IMU_REG_ACCEL_XOUT_H, p, sizeof(p));
+  if (err != ESP_OK)
+    return err;
+  sample->ax = (int16_t)((p[0] << 8) | p[1]);
+  sample->ay = (int16_t)((p[2] << 8) | p[3]);
+  sample->az = (int16_t)((p[4] << 8) | p[5]);
+  sample->temp = (int16_t)((p[6] << 8) | p[7]);
+  sample->gx = (int16_t)((p[8] << 8) | p[9]);
+  sample->gy = (int16_t)((p[10] << 8) | p[11]);
+  sample->gz = (int16_t)((p[12] << 8) | p[13]);
+  return ESP_OK;
+}
+
+esp_err_t imu_sensor_set_dlpf(uint8_t dlpf_cfg) {
+  return imu_sensor_write_reg(IMU_REG_CONFIG, dlpf_cfg & 0x07);
+}
+
+static void IRAM_ATTR drdy_isr(void* arg) {
+  BaseType_t woken = pdFALSE;
+  int64_t now = esp_timer_get_time();
+
+  portENTER_CRITICAL_ISR(&s_drdy_lock);
+  if (++s_drdy_seq == 1)
+    s_drdy_first_us = now;
+  s_drdy_us = now;
+  bool notify = ++s_drdy_pending >= s_burst;
+  if (notify)
+    s_drdy_pending = 0;
+  portEXIT_CRITICAL_ISR(&s_drdy_lock);
+
+  if (notify && s_task)
+    vTaskNotifyGiveFromISR(s_task, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+void imu_sensor_fifo_reset(void) {
+  /* Mask data-ready and stop the FIFO before zeroing the counters, so no
+   * sample lands in the FIFO while the ISR count restarts: one missed would
+   * shift every timestamp derived from s_drdy_first_us by a period */
+  imu_sensor_write_reg(IMU_REG_INT_ENABLE, 0);
+  imu_sensor_write_reg(IMU_REG_USER_CTRL, USER_CTRL_FIFO_RESET);
+
+  portENTER_CRITICAL(&s_drdy_lock);
+  s_drdy_seq = 0;
+  s_drdy_pending = 0;
+  portEXIT_CRITICAL(&s_drdy_lock);
+  s_read_seq = 0;
+
+  /* Drop any notification raised for samples that were just discarded */
+  ulTaskNotifyTake(pdTRUE, 0);
+
+  imu_sensor_write_reg(IMU_REG_USER_CTRL, USER_CTRL_FIFO_EN);
+  imu_sensor_write_reg(IMU_REG_INT_ENABLE, INT_ENABLE_DATA_RDY);
+}
+
+/* SMPLRT_DIV relative to the 1 kHz internal clock (DLPF enabled) */
+static esp_err_t write_rate_regs(void) {
+  esp_err_t err = imu_sensor_write_reg(IMU_REG_SMPLRT_DIV, s_smplrt_div);
+  if (err == ESP_OK)
+    err = imu_sensor_set_dlpf(s_dlpf_cfg);
+  return err;
+}
+
+uint32_t imu_sensor_set_odr(uint32_t hz) {
+  if (hz < IMU_FIFO_ODR_MIN_HZ)
+    hz = IMU_FIFO_ODR_MIN_HZ;
+  if (hz > IMU_FIFO_ODR_MAX_HZ)
+    hz = IMU_FIFO_ODR_MAX_HZ;
+  uint32_t div = (1000 + hz / 2) / hz - 1;
+  uint32_t odr = (1000 + (div + 1) / 2) / (div + 1);
+
+  /* Widest bandwidth that still leaves the cutoff a factor 2 under Nyquist */
+  uint8_t dlpf = 6;
+  while (dlpf > 1 && DLPF_BANDWIDTH_HZ[dlpf - 1] * 4 <= odr) dlpf--;
+  uint32_t burst = odr / IMU_FIFO_BURSTS_PER_S;
+  bool changed = div != s_smplrt_div;
+
+  s_smplrt_div = (uint8_t)div;
+  s_dlpf_cfg = dlpf;
+  s_period_us = (div + 1) * 1000;
+  portENTER_CRITICAL(&s_drdy_lock);
+  s_burst = burst < 1 ? 1 : burst;
+  portEXIT_CRITICAL(&s_drdy_lock);
+
+  if (s_task && changed) {
+    if (write_rate_regs() != ESP_OK)
+      ESP_LOGW(TAG, "ODR register write failed");
+    /* Queued samples are at the old rate */
+    imu_sensor_fifo_reset();
+  }
+  ESP_LOGI(TAG, "ODR %u Hz (SMPLRT_DIV %u, DLPF_CFG %u), %u samples per burst", (unsigned)odr,
+           (unsigned)div, dlpf, (unsigned)s_burst);
+  return odr;
+}
+
+uint32_t imu_sensor_period_us(void) {
+  return s_period_us;
+}
+
+uint32_t imu_sensor_burst_samples(void) {
+  return s_burst;
+}
+
+esp_err_t imu_sensor_fifo_start(gpio_num_t int_pin, TaskHandle_t task) {
+  s_task = task;
+  s_int_pin = int_pin;
+
+  esp_err_t err = write_rate_regs();
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_FIFO_EN, FIFO_EN_ACCEL | FIFO_EN_GYRO);
+  /* INT pin: active high, push-pull, 50 us pulse per sample */
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_INT_PIN_CFG, 0x00);
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_INT_ENABLE, INT_ENABLE_DATA_RDY);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "FIFO register setup failed: %s", esp_err_to_name(err));
+    return err;
+  }
+
+  const gpio_config_t io = {
+      .pin_bit_mask = 1ULL << int_pin,
+      .mode = GPIO_MODE_INPUT,
+      .pull_down_en = GPIO_PULLDOWN_ENABLE,
+      .intr_type = GPIO_INTR_POSEDGE,
+  };
+  err = gpio_config(&io);
+  if (err != ESP_OK)
+    return err;
+
+  /* app_main normally installed it already, on this core and in IRAM */
+  err = gpio_install_isr_service(0);
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+    return err;
+  err = gpio_isr_handler_add(int_pin, drdy_isr, NULL);
+  if (err != ESP_OK)
+    return err;
+
+  imu_sensor_fifo_reset();
+  ESP_LOGI(TAG, "FIFO sampling every %u us, INT on GPIO %d, %u samples per burst",
+           (unsigned)s_period_us, int_pin, (unsigned)s_burst);
+  return ESP_OK;
+}
+
+int imu_sensor_fifo_read(imu_block_t* blk, TickType_t timeout) {
+  blk->count = 0;
+  if (ulTaskNotifyTake(pdTRUE, timeout) == 0)
+    return 0;
+
+  int64_t t_start = esp_timer_get_time();
+  uint8_t count_buf[2];
+  if (imu_sensor_read_regs(IMU_REG_FIFO_COUNTH, count_buf, sizeof(count_buf)) != ESP_OK)
+    return 0;
+
+  int bytes = (count_buf[0] << 8) | count_buf[1];
+  if (bytes >= FIFO_SIZE_BYTES) {
+    /* Overflowed: the oldest samples were overwritten and the stream is no
+     * longer aligned to 12-byte frames. Start over. */
+    ESP_LOGW(TAG, "FIFO overflow — resetting");
+    perf_count(&g_perf_stats.fifo_overflows);
+    imu_sensor_fifo_reset();
+    return 0;
+  }
+
+  int n = bytes / FIFO_SAMPLE_BYTES;
+  if (n > IMU_BLOCK_MAX_SAMPLES)
+    n = IMU_BLOCK_MAX_SAMPLES;
+  if (n == 0)
+    return 0;
+
+  uint8_t raw[IMU_BLOCK_MAX_SAMPLES * FIFO_SAMPLE_BYTES];
+  if (imu_sensor_read_regs(IMU_REG_FIFO_R_W, raw, n * FIFO_SAMPLE_BYTES) != ESP_OK)
+    return 0;
+
+  portENTER_CRITICAL(&s_drdy_lock);
+  uint32_t last_seq = s_drdy_seq;
+  int64_t first_us = s_drdy_first_us;
+  int64_t last_us = s_drdy_us;
+  portEXIT_CRITICAL(&s_drdy_lock);
+
+  /* Sample k (1-based since reset) was latched at data-ready interrupt k.
+   * Each interrupt time carries its own ISR latency; the line through the
+   * first and newest carries it divided by the count. Samples go on that
+   * line, a uniform grid at the sensor's measured period (Q16 us), so
+   * neither latency, read time nor task scheduling leak into dt, and it
+   * doesn't step at burst boundaries when the sensor clock is off nominal. */
+  uint32_t period_q16 = s_period_us << 16;
+  if (last_seq >= 2)
+    period_q16 = (uint32_t)(((last_us - first_us) << 16) / (last_seq - 1));
+  for (int i = 0; i < n; i++) {
+    const uint8_t* p = &raw[i * FIFO_SAMPLE_BYTES];
+    blk->ax[i] = (int16_t)((p[0] << 8) | p[1]);
+    blk->ay[i] = (int16_t)((p[2] << 8) | p[3]);
+    blk->az[i] = (int16_t)((p[4] << 8) | p[5]);
+    blk->gx[i] = (int16_t)((p[6] << 8) | p[7]);
+    blk->gy[i] = (int16_t)((p[8] << 8) | p[9]);
+    blk->gz[i] = (int16_t)((p[10] << 8) | p[11]);
+
+    uint32_t seq = s_read_seq + 1 + i;
+    blk->ts_us[i] = first_us + (((int64_t)(seq - 1) * period_q16) >> 16);
+  }
+  s_read_seq += n;
+
+  int64_t t_done = esp_timer_get_time();
+  perf_hist_record(&g_perf_stats.imu_read_us, (uint32_t)(t_done - t_start));
+  perf_hist_record(&g_perf_stats.imu_wake_us, (uint32_t)(t_done - last_us));
+
+  blk->count = n;
+  return n;
+}
+
+esp_err_t imu_sensor_wake_on_motion(uint16_t threshold_mg) {
+  if (s_int_pin != GPIO_NUM_NC) {
+    gpio_isr_handler_remove(s_int_pin);
+    s_task = NULL;
+  }
+
+  /* MOT_THR: 2 mg per LSB, 0 would trigger on noise */
+  uint32_t thr = threshold_mg / 2;
+  uint8_t mot_thr = thr < 1 ? 1 : thr > 255 ? 255 : (uint8_t)thr;
+
+  uint8_t accel_cfg = 0;
+  esp_err_t err = imu_sensor_read_regs(IMU_REG_ACCEL_CONFIG, &accel_cfg, 1);
+  /* Quiesce: no FIFO, no interrupts, gyro off */
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_INT_ENABLE, 0);
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_USER_CTRL, 0);
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_FIFO_EN, 0);
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_PWR_MGMT_2, PWR2_STBY_GYRO);
+  /* Motion compares the high-passed signal, so gravity never triggers it */
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_ACCEL_CONFIG,
+                               (accel_cfg & ACCEL_CONFIG_FS_MASK) | ACCEL_HPF_5HZ);
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_MOT_THR, mot_thr);
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_MOT_DUR, 1);
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_MOT_DETECT_CTRL, 0x15);
+  /* Latched level, cleared by reading INT_STATUS (exit_low_power) */
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_INT_PIN_CFG, INT_PIN_CFG_LATCH);
+  uint8_t status;
+  if (err == ESP_OK)
+    err = imu_sensor_read_regs(IMU_REG_INT_STATUS, &status, 1);
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_INT_ENABLE, INT_ENABLE_MOT);
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_PWR_MGMT_2, PWR2_LP_WAKE_5HZ | PWR2_STBY_GYRO);
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_PWR_MGMT_1, PWR1_CYCLE | PWR1_TEMP_DIS);
+
+  if (err != ESP_OK)
+    ESP_LOGE(TAG, "wake-on-motion setup failed: %s", esp_err_to_name(err));
+  return err;
+}
+
+esp_err_t imu_sensor_exit_low_power(void) {
+  esp_err_t err = imu_sensor_write_reg(IMU_REG_PWR_MGMT_1, 0);
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_PWR_MGMT_2, 0);
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_INT_ENABLE, 0);
+  uint8_t status;
+  if (err == ESP_OK)
+    err = imu_sensor_read_regs(IMU_REG_INT_STATUS, &status, 1);
+  if (err == ESP_OK)
+    err = imu_sensor_write_reg(IMU_REG_INT_PIN_CFG, 0);
+  return err;
+}
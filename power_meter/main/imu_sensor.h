@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "imu_block.h"
+
+/* MPU6050 driver on the i2c_master bus/device API: setup, burst sample
+ * reads, DLPF, and the hardware FIFO + data-ready interrupt path. */
+
+/* 7-bit address with AD0 low (0x69 with AD0 high) */
+#define IMU_I2C_ADDRESS 0x68
+
+/* Output data rate in FIFO mode (Hz), default and settable range. With the
+ * DLPF enabled the internal sample clock is 1 kHz, so ODR = 1000 / (1 +
+ * SMPLRT_DIV): 100, 111, 125, 143, 167, 200 or 250 Hz. The floor keeps a
+ * full IMU_BLOCK_MAX_SAMPLES block under two strokes (MAX_STROKES_PER_BLOCK),
+ * the ceiling keeps a burst inside one block. */
+#define IMU_FIFO_ODR_HZ 100
+#define IMU_FIFO_ODR_MIN_HZ 100
+#define IMU_FIFO_ODR_MAX_HZ 250
+/* Task wakeups per second; the burst size follows the ODR (10 samples at
+ * 100 Hz, 25 at 250 Hz). */
+#define IMU_FIFO_BURSTS_PER_S 10
+
+/* Register map (subset) */
+#define IMU_REG_SMPLRT_DIV 0x19
+#define IMU_REG_CONFIG 0x1A
+#define IMU_REG_GYRO_CONFIG 0x1B
+#define IMU_REG_ACCEL_CONFIG 0x1C
+#define IMU_REG_MOT_THR 0x1F
+#define IMU_REG_MOT_DUR 0x20
+#define IMU_REG_FIFO_EN 0x23
+#define IMU_REG_INT_PIN_CFG 0x37
+#define IMU_REG_INT_ENABLE 0x38
+#define IMU_REG_INT_STATUS 0x3A
+#define IMU_REG_ACCEL_XOUT_H 0x3B
+#define IMU_REG_USER_CTRL 0x6A
+#define IMU_REG_MOT_DETECT_CTRL 0x69
+#define IMU_REG_PWR_MGMT_1 0x6B
+#define IMU_REG_PWR_MGMT_2 0x6C
+#define IMU_REG_FIFO_COUNTH 0x72
+#define IMU_REG_FIFO_R_W 0x74
+#define IMU_REG_WHO_AM_I 0x75
+
+/* One ACCEL_XOUT_H..GYRO_ZOUT_L burst, raw counts */
+typedef struct {
+  int16_t ax, ay, az;
+  int16_t temp;
+  int16_t gx, gy, gz;
+} imu_raw_sample_t;
+
+/* Create the I2C master bus (first free port, internal pull-ups on top of
+ * the board's) and add the sensor at addr, clocked at scl_hz. */
+esp_err_t imu_sensor_init(gpio_num_t sda, gpio_num_t scl, uint32_t scl_hz, uint8_t addr);
+
+/* Check WHO_AM_I, wake the sensor on the gyro PLL clock and set the ranges
+ * the pipeline's scale factors assume: +-4 g (IMU_ACCEL_LSB_PER_G) and
+ * +-500 deg/s (IMU_GYRO_LSB_PER_DPS). */
+esp_err_t imu_sensor_configure(void);
+
+esp_err_t imu_sensor_write_reg(uint8_t reg, uint8_t val);
+esp_err_t imu_sensor_read_regs(uint8_t reg, uint8_t* buf, size_t len);
+
+/* Set the digital low-pass filter (CONFIG register, DLPF_CFG bits 2:0). */
+esp_err_t imu_sensor_set_dlpf(uint8_t dlpf_cfg);
+
+/* Latest accel, temperature and gyro in one 14-byte transaction, so the
+ * axes all come from the same sample. Polled mode and calibration. */
+esp_err_t imu_sensor_read_sample(imu_raw_sample_t* sample);
+
+/* Select the FIFO output data rate, rounded to the nearest divider and
+ * clamped to IMU_FIFO_ODR_MIN_HZ..IMU_FIFO_ODR_MAX_HZ. Also sets the DLPF to
+ * the widest bandwidth under ODR / 4 and the burst size. Before
+ * imu_sensor_fifo_start() it only records the choice; afterwards a new rate
+ * reprograms the sensor and resets the FIFO, so call it from the task that
+ * drains it. Returns the rate actually selected (Hz, rounded). */
+uint32_t imu_sensor_set_odr(uint32_t hz);
+
+/* Nominal sample period of the selected ODR (us, exact) */
+uint32_t imu_sensor_period_us(void);
+
+/* Samples per data-ready notification at the selected ODR */
+uint32_t imu_sensor_burst_samples(void);
+
+/* Configure the FIFO (accel + gyro) at the selected ODR and arm the data-ready
+ * interrupt on int_pin. task is notified once every imu_sensor_burst_samples()
+ * samples; it must be the task that calls imu_sensor_fifo_read(). */
+esp_err_t imu_sensor_fifo_start(gpio_num_t int_pin, TaskHandle_t task);
+
+/* Discard queued FIFO contents and resynchronise timestamps. Call after any
+ * pause in draining (e.g. a blocking recalibration) so stale samples are not
+ * fed into the integrator. */
+void imu_sensor_fifo_reset(void);
+
+/* Block up to timeout for the next burst, then drain it into blk (raw counts
+ * in ax/ay/az and gx/gy/gz, oldest first). ts_us is on a uniform grid at the
+ * sensor's own sample period, measured from the data-ready interrupts since
+ * the last reset, so dt is constant even though the MPU6050's oscillator is
+ * a percent or so off nominal. Sets and returns blk->count: 0 on timeout or
+ * read error. */
+int imu_sensor_fifo_read(imu_block_t* blk, TickType_t timeout);
+
+/* Stop FIFO sampling, detach the data-ready ISR and put the sensor into
+ * accel-only low-power cycling (5 Hz, ~10 uA typ.) with the motion interrupt
+ * armed on the INT pin: latched, active high, so it can drive an ext0 wakeup.
+ * threshold_mg is the high-passed acceleration that counts as motion
+ * (2 mg resolution). */
+esp_err_t imu_sensor_wake_on_motion(uint16_t threshold_mg);
+
+/* Leave low-power cycling, disable interrupts and clear any latched one.
+ * Safe on a cold boot; call before imu_sensor_configure(), since a
+ * deep-sleep wake finds the sensor still in cycle mode. */
+esp_err_t imu_sensor_exit_low_power(void);
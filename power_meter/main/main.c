@@ -7,14 +7,17 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <stdatomic.h>
 
+#include "driver/gpio.h"
+#include "esp_intr_alloc.h"
+#include "esp_ipc.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
 #include "freertos/task.h"
 #include "nvs_flash.h"
 
@@ -23,23 +26,46 @@
 #include "nimble/nimble_port.h"
 #include "nimble/nimble_port_freertos.h"
 
+#include "ble_control_service.h"
+#include "ble_imu_stream_service.h"
 #include "ble_power_service.h"
+#include "conn_policy.h"
+#include "crew.h"
 #include "gap.h"
+#include "perf_stats.h"
+#include "seqlock.h"
+#include "task_plan.h"
+#include "wifi_control.h"
 #include "wifi_log_server.h"
 
 /* 0 = sine wave demo, 1 = IMU-based stroke detection */
 #define USE_IMU_POWER 1
 
+/* WiFi log server starts on demand (wifi_control.h). BOOT button on DevKits.
+ * Set WIFI_START_AT_BOOT to 1 on the bench to have logs from power-up. */
+#define WIFI_BUTTON_PIN GPIO_NUM_0
+#define WIFI_START_AT_BOOT 0
+
 #if USE_IMU_POWER
-#include "driver/i2c.h"
 #include "imu_power.h"
-#include "mpu6050.h"
+#include "imu_recorder.h"
+#include "imu_sensor.h"
+#include "power_manager.h"
+#include "settings_store.h"
 #include "stroke_detector.h"
+#include "session.h"
+#include "stroke_history.h"
+#include "telemetry.h"
 #define I2C_SDA_PIN 21
 #define I2C_SCL_PIN 22
-#define I2C_PORT I2C_NUM_0
 #define I2C_FREQ_HZ 400000
-#define IMU_SAMPLE_MS 50 /* 20 Hz IMU sampling */
+
+/* 1 = drain the MPU6050 FIFO on its data-ready interrupt (IMU_INT_PIN wired),
+ * 0 = poll imu_sensor_read_sample() every IMU_SAMPLE_MS */
+#define IMU_USE_FIFO 1
+#define IMU_INT_PIN GPIO_NUM_4
+#define IMU_SAMPLE_MS 50 /* 20 Hz IMU sampling (polled mode, esp_timer tick) */
+#define MAX_STROKES_PER_BLOCK 2
 #endif
 
 /* BLE notification rate */
@@ -63,6 +89,7 @@ static void on_stack_reset(int reason) {
 static void on_stack_sync(void) {
   ESP_LOGI(TAG, "NimBLE stack synced, starting advertising");
   adv_init();
+  crew_on_sync();
 }
 
 static void nimble_host_config_init(void) {
@@ -70,6 +97,15 @@ static void nimble_host_config_init(void) {
   ble_hs_cfg.sync_cb = on_stack_sync;
   ble_hs_cfg.gatts_register_cb = gatt_svr_register_cb;
   ble_hs_cfg.store_status_cb = ble_store_util_status_rr;
+
+  /* Just Works bonding (no display or keypad). The control service's WiFi
+   * and boat speed writes need an encrypted link, so a central pairs on its
+   * first write to them; reading power needs no pairing. */
+  ble_hs_cfg.sm_io_cap = BLE_HS_IO_NO_INPUT_OUTPUT;
+  ble_hs_cfg.sm_bonding = 1;
+  ble_hs_cfg.sm_sc = 1;
+  ble_hs_cfg.sm_our_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+  ble_hs_cfg.sm_their_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
   ble_store_config_init();
 }
 
@@ -81,71 +117,171 @@ static void nimble_host_task(void* param) {
 
 #if USE_IMU_POWER
 
-/* ── Inter-task message types ────────────────────────────────────────────── */
-
-typedef enum {
-  SETTING_MASS,
-  SETTING_FORWARD_AXIS,
-  SETTING_CATCH_G,
-  SETTING_RECOVERY_G,
-  SETTING_VERBOSE,
-  SETTING_CALIBRATE,
-  SETTING_SMOOTH_STROKES,
-} settings_type_t;
+/* ── Cross-task state (seqlock.h) ────────────────────────────────────────── */
 
+/* Everything the browser sets that the IMU and BLE notify tasks act on.
+ * Written field by field by the httpd task (on_ws_command); the IMU task
+ * checks the version once per block, the notify task once per wakeup. */
 typedef struct {
-  settings_type_t type;
-  union {
-    float f;     /* MASS, CATCH_G, RECOVERY_G */
-    bool b;      /* VERBOSE */
-    int i;       /* SMOOTH_STROKES */
-    float v3[3]; /* FORWARD_AXIS */
-  };
-} settings_msg_t;
+  float mass_kg;
+  float forward[3];
+  float catch_g;
+  float recovery_g;
+  bool adaptive;
+  int smooth_strokes;
+  bool verbose;
+  bool telemetry;
+  uint32_t odr_hz;
+  bool record;         /* Recorder state last asked for */
+  uint32_t record_req; /* Bumped by every record:start/stop, so a repeat still acts */
+  /* Seconds of no stroke before BLE output zeros out. 0 = never zero. */
+  float power_timeout_s;
+  /* Longest gap between BLE notifications when no stroke arrives. After a
+   * stroke the repeat interval starts at KEEPALIVE_FIRST_MS and doubles up
+   * to this. */
+  uint32_t keepalive_ms;
+} pipeline_config_t;
 
 typedef struct {
   float power_w;
   float stroke_rate_spm;
   uint32_t stroke_count;
+  int64_t release_us; /* RELEASE transition of the stroke, for notify latency */
+  int64_t catch_us;   /* stroke_event_t.catch_exact_us; 0 for a crew stroke */
+  imu_power_curve_t curve;
 } power_reading_t;
 
-static QueueHandle_t s_settings_queue;
-static QueueHandle_t s_power_queue;
+/* A boat speed fix from a central (control service) */
+typedef struct {
+  float speed_ms;
+  int64_t t_us; /* esp_timer time it arrived */
+} speed_fix_t;
+
+#define KEEPALIVE_FIRST_MS 1000
+/* pipeline_config_t.power_timeout_s and keepalive_ms until changed */
+#define POWER_TIMEOUT_DEFAULT_S 5.0f
+#define KEEPALIVE_DEFAULT_MS 2000
+
+static pipeline_config_t s_config;
+static seqlock_t s_config_lock = SEQLOCK_INITIALIZER;
+
+/* Latest stroke for the BLE notify task, from the IMU task or, in crew mode,
+ * the crew publisher. Each write wakes the notify task; a stroke it has not
+ * picked up yet is replaced by the next one. */
+static power_reading_t s_reading;
+static seqlock_t s_reading_lock = SEQLOCK_INITIALIZER;
+static TaskHandle_t s_notify_task;
+
+/* Latest boat speed fix, from the NimBLE host task; the IMU task takes it
+ * per block */
+static speed_fix_t s_speed_fix;
+static seqlock_t s_speed_lock = SEQLOCK_INITIALIZER;
+
+/* Update one field of s_config (httpd task) */
+#define CONFIG_SET(field, value)         \
+  do {                                   \
+    seqlock_write_begin(&s_config_lock); \
+    s_config.field = (value);            \
+    seqlock_write_end(&s_config_lock);   \
+  } while (0)
+
+/* Consistent copy of s_config; returns its version */
+static uint32_t read_config(pipeline_config_t* out) {
+  uint32_t v;
+  do {
+    v = seqlock_read_begin(&s_config_lock);
+    *out = s_config;
+  } while (seqlock_read_retry(&s_config_lock, v));
+  return v;
+}
 
-/* Seconds of no stroke before BLE output zeros out. 0 = never zero.
- * Written by the WebSocket task, read by the BLE task at ~1 Hz.
- * _Atomic with memory_order_relaxed: we need atomicity but not ordering —
- * the BLE task just needs to eventually see the new value within ~1 s. */
-static _Atomic float s_power_timeout_s = 5.0f;
+/* Hand a stroke to the notify task without blocking. Any task. */
+static void publish_reading(const power_reading_t* reading) {
+  seqlock_write_begin(&s_reading_lock);
+  s_reading = *reading;
+  seqlock_write_end(&s_reading_lock);
+  xTaskNotifyGive(s_notify_task);
+}
 
-static void enqueue_setting(const settings_msg_t* msg) {
-  if (xQueueSend(s_settings_queue, msg, pdMS_TO_TICKS(10)) != pdTRUE) {
-    ESP_LOGW(TAG, "Settings queue full — message dropped");
+/* A crew stroke (crew.h), from the IMU, NimBLE host or esp_timer task */
+static void on_crew_stroke(const crew_stroke_t* s) {
+  char seats[8 * CREW_MAX_SEATS] = "";
+  for (int i = 0, o = 0; i < CREW_MAX_SEATS && o < (int)sizeof(seats); i++) {
+    if (s->seat_mask & (1u << i))
+      o += snprintf(seats + o, sizeof(seats) - o, " %d:%.0f", i, s->seat_power_w[i]);
   }
+  ESP_LOGI(TAG, "Crew stroke #%lu  %.0f W  seats%s", (unsigned long)s->stroke_count, s->power_w,
+           seats);
+
+  power_service_set_balance(s->balance);
+  const power_reading_t reading = {
+      .power_w = s->power_w,
+      .stroke_rate_spm = s->stroke_rate_spm,
+      .stroke_count = s->stroke_count,
+  };
+  publish_reading(&reading);
 }
 
-static void on_ws_command(const char* cmd) {
-  settings_msg_t msg = {0};
+/* NimBLE host task: hand the fix to the IMU task without blocking */
+static void on_boat_speed(float speed_ms) {
+  const speed_fix_t fix = {.speed_ms = speed_ms, .t_us = esp_timer_get_time()};
+  seqlock_write_begin(&s_speed_lock);
+  s_speed_fix = fix;
+  seqlock_write_end(&s_speed_lock);
+}
 
-  if (strcmp(cmd, "recalibrate") == 0) {
-    msg.type = SETTING_CALIBRATE;
-    enqueue_setting(&msg);
-    ESP_LOGI(TAG, "Recalibration requested via browser");
+/* Start or stop the recorder (IMU task, via s_config) */
+static void request_recording(bool on) {
+  seqlock_write_begin(&s_config_lock);
+  s_config.record = on;
+  s_config.record_req++;
+  seqlock_write_end(&s_config_lock);
+}
+
+static void on_ws_command(const char* cmd) {
+  if (strcmp(cmd, "wifi:off") == 0) {
+    /* Stopping httpd from its own task would deadlock; wifi_ctl does it */
+    ESP_LOGI(TAG, "WiFi off requested via browser");
+    wifi_control_request(false);
 
   } else if (strcmp(cmd, "verbose:on") == 0) {
-    msg.type = SETTING_VERBOSE;
-    msg.b = true;
-    enqueue_setting(&msg);
+#if IMU_POWER_VERBOSE
+    CONFIG_SET(verbose, true);
     wifi_log_server_set_status("!verbose:on");
     ESP_LOGI(TAG, "Verbose IMU logging ON");
+#else
+    wifi_log_server_set_status("!verbose:off");
+    ESP_LOGW(TAG, "Verbose IMU logging not built in (IMU_POWER_VERBOSE=0)");
+#endif
 
   } else if (strcmp(cmd, "verbose:off") == 0) {
-    msg.type = SETTING_VERBOSE;
-    msg.b = false;
-    enqueue_setting(&msg);
+    CONFIG_SET(verbose, false);
     wifi_log_server_set_status("!verbose:off");
     ESP_LOGI(TAG, "Verbose IMU logging OFF");
 
+  } else if (strcmp(cmd, "telemetry:on") == 0) {
+    CONFIG_SET(telemetry, true);
+    wifi_log_server_set_status("!telemetry:on");
+    ESP_LOGI(TAG, "Binary telemetry ON");
+
+  } else if (strcmp(cmd, "telemetry:off") == 0) {
+    CONFIG_SET(telemetry, false);
+    wifi_log_server_set_status("!telemetry:off");
+    ESP_LOGI(TAG, "Binary telemetry OFF");
+
+  } else if (strcmp(cmd, "record:start") == 0) {
+    request_recording(true);
+    wifi_log_server_set_status("!record:on");
+    ESP_LOGI(TAG, "Recording requested via browser");
+
+  } else if (strcmp(cmd, "record:stop") == 0) {
+    request_recording(false);
+    wifi_log_server_set_status("!record:off");
+    ESP_LOGI(TAG, "Recording stop requested via browser");
+
+  } else if (strcmp(cmd, "session:reset") == 0) {
+    session_reset();
+
   } else if (strncmp(cmd, "set:mass:", 9) == 0) {
     float kg;
     if (sscanf(cmd + 9, "%f", &kg) == 1) {
@@ -153,32 +289,36 @@ static void on_ws_command(const char* cmd) {
         ESP_LOGW(TAG, "Mass %.1f kg out of range [10, 500], clamped", kg);
         kg = kg < 10.0f ? 10.0f : 500.0f;
       }
-      msg.type = SETTING_MASS;
-      msg.f = kg;
-      enqueue_setting(&msg);
+      CONFIG_SET(mass_kg, kg);
+      settings_store_begin()->mass_kg = kg;
+      settings_store_commit();
       ESP_LOGI(TAG, "Mass set to %.1f kg", kg);
     }
 
   } else if (strncmp(cmd, "set:axis:", 9) == 0) {
     const char* ax = cmd + 9;
-    msg.type = SETTING_FORWARD_AXIS;
+    float fwd[3] = {0};
     if (strcmp(ax, "+X") == 0)
-      msg.v3[0] = 1.0f;
+      fwd[0] = 1.0f;
     else if (strcmp(ax, "-X") == 0)
-      msg.v3[0] = -1.0f;
+      fwd[0] = -1.0f;
     else if (strcmp(ax, "+Y") == 0)
-      msg.v3[1] = 1.0f;
+      fwd[1] = 1.0f;
     else if (strcmp(ax, "-Y") == 0)
-      msg.v3[1] = -1.0f;
+      fwd[1] = -1.0f;
     else if (strcmp(ax, "+Z") == 0)
-      msg.v3[2] = 1.0f;
+      fwd[2] = 1.0f;
     else if (strcmp(ax, "-Z") == 0)
-      msg.v3[2] = -1.0f;
+      fwd[2] = -1.0f;
     else {
       ESP_LOGW(TAG, "Unknown axis: %s", ax);
       return;
     }
-    enqueue_setting(&msg);
+    seqlock_write_begin(&s_config_lock);
+    memcpy(s_config.forward, fwd, sizeof(fwd));
+    seqlock_write_end(&s_config_lock);
+    memcpy(settings_store_begin()->forward, fwd, sizeof(fwd));
+    settings_store_commit();
     ESP_LOGI(TAG, "Forward axis set to %s", ax);
 
   } else if (strncmp(cmd, "set:catch:", 10) == 0) {
@@ -188,9 +328,9 @@ static void on_ws_command(const char* cmd) {
         ESP_LOGW(TAG, "Catch threshold %.3f g out of range [0.05, 5.0], clamped", g);
         g = g < 0.05f ? 0.05f : 5.0f;
       }
-      msg.type = SETTING_CATCH_G;
-      msg.f = g;
-      enqueue_setting(&msg);
+      CONFIG_SET(catch_g, g);
+      settings_store_begin()->catch_g = g;
+      settings_store_commit();
       ESP_LOGI(TAG, "Catch threshold set to %.3f g", g);
     }
 
@@ -201,12 +341,19 @@ static void on_ws_command(const char* cmd) {
         ESP_LOGW(TAG, "Recovery threshold %.3f g out of range [0.05, 5.0], clamped", g);
         g = g < 0.05f ? 0.05f : 5.0f;
       }
-      msg.type = SETTING_RECOVERY_G;
-      msg.f = g;
-      enqueue_setting(&msg);
+      CONFIG_SET(recovery_g, g);
+      settings_store_begin()->recovery_g = g;
+      settings_store_commit();
       ESP_LOGI(TAG, "Recovery threshold set to %.3f g", g);
     }
 
+  } else if (strncmp(cmd, "set:adaptive:", 13) == 0) {
+    bool on = atoi(cmd + 13) != 0;
+    CONFIG_SET(adaptive, on);
+    settings_store_begin()->adaptive = on;
+    settings_store_commit();
+    ESP_LOGI(TAG, "Adaptive stroke thresholds %s", on ? "ON" : "OFF");
+
   } else if (strncmp(cmd, "set:smooth:", 11) == 0) {
     int n;
     if (sscanf(cmd + 11, "%d", &n) == 1) {
@@ -214,9 +361,9 @@ static void on_ws_command(const char* cmd) {
         n = 1;
       if (n > STROKE_RATE_MAX_SMOOTH)
         n = STROKE_RATE_MAX_SMOOTH;
-      msg.type = SETTING_SMOOTH_STROKES;
-      msg.i = n;
-      enqueue_setting(&msg);
+      CONFIG_SET(smooth_strokes, n);
+      settings_store_begin()->smooth_strokes = n;
+      settings_store_commit();
       ESP_LOGI(TAG, "Stroke rate smoothing window set to %d strokes", n);
     }
 
@@ -227,35 +374,147 @@ static void on_ws_command(const char* cmd) {
         s = 0.0f;
       if (s > 30.0f)
         s = 30.0f;
-      atomic_store_explicit(&s_power_timeout_s, s, memory_order_relaxed);
+      CONFIG_SET(power_timeout_s, s);
+      settings_store_begin()->power_timeout_s = s;
+      settings_store_commit();
       ESP_LOGI(TAG, "Power zero timeout set to %.0f s (0=disabled)", s);
     }
+
+  } else if (strncmp(cmd, "set:keepalive:", 14) == 0) {
+    float s;
+    if (sscanf(cmd + 14, "%f", &s) == 1) {
+      if (s < 1.0f)
+        s = 1.0f;
+      if (s > 30.0f)
+        s = 30.0f;
+      CONFIG_SET(keepalive_ms, (uint32_t)(s * 1000.0f));
+      settings_store_begin()->keepalive_ms = (uint32_t)(s * 1000.0f);
+      settings_store_commit();
+      ESP_LOGI(TAG, "BLE keepalive set to %.1f s", s);
+    }
+
+  } else if (strncmp(cmd, "set:crank:", 10) == 0) {
+    int n = atoi(cmd + 10) == 2 ? 2 : 1;
+    power_service_set_strokes_per_rev(n);
+    settings_store_begin()->strokes_per_rev = n;
+    settings_store_commit();
+    ESP_LOGI(TAG, "Crank revolution = %s", n == 2 ? "left + right stroke" : "one stroke");
+
+  } else if (strncmp(cmd, "set:sleep:", 10) == 0) {
+    int min;
+    if (sscanf(cmd + 10, "%d", &min) == 1) {
+      if (min < 0)
+        min = 0;
+      if (min > 120)
+        min = 120;
+      power_manager_set_idle_timeout((uint32_t)min * 60);
+      settings_store_begin()->sleep_s = (uint32_t)min * 60;
+      settings_store_commit();
+      ESP_LOGI(TAG, "Idle sleep after %d min (0=disabled)", min);
+    }
+
+  } else if (strncmp(cmd, "set:crew:", 9) == 0) {
+    bool on = atoi(cmd + 9) != 0;
+    crew_set_enabled(on);
+    settings_store_begin()->crew = on;
+    settings_store_commit();
+
+  } else if (strncmp(cmd, "set:odr:", 8) == 0) {
+    int hz;
+    if (sscanf(cmd + 8, "%d", &hz) == 1) {
+#if IMU_USE_FIFO
+      if (hz < IMU_FIFO_ODR_MIN_HZ)
+        hz = IMU_FIFO_ODR_MIN_HZ;
+      if (hz > IMU_FIFO_ODR_MAX_HZ)
+        hz = IMU_FIFO_ODR_MAX_HZ;
+      CONFIG_SET(odr_hz, (uint32_t)hz);
+      settings_store_begin()->odr_hz = (uint32_t)hz;
+      settings_store_commit();
+      ESP_LOGI(TAG, "Sample rate change to %d Hz requested", hz);
+#else
+      ESP_LOGW(TAG, "Sample rate is fixed at %d Hz in polled mode", 1000 / IMU_SAMPLE_MS);
+#endif
+    }
   }
 }
 
+/* Notification scheduler: a stroke is sent as soon as it is confirmed. Between
+ * strokes the last value is repeated with a backoff (KEEPALIVE_FIRST_MS,
+ * doubling to keepalive_ms) so the watch keeps the sensor alive without a
+ * stream of duplicates. When the zero timeout expires a 0 W notification goes
+ * out at once instead of waiting for the next keepalive. */
 static void ble_notify_task(void* param) {
   power_reading_t reading = {0};
+  uint32_t reading_version = seqlock_version(&s_reading_lock);
+  pipeline_config_t config;
+  uint32_t config_version = read_config(&config);
   int64_t last_stroke_us = 0;
-  ESP_LOGI(TAG, "BLE notify task running (1 Hz keepalive)");
+  int64_t last_tx_us = 0;
+  uint32_t backoff_ms = KEEPALIVE_FIRST_MS;
+  bool zero_sent = false;
+  ESP_LOGI(TAG, "BLE notify task running (stroke-synchronous)");
   while (1) {
-    bool new_stroke = xQueueReceive(s_power_queue, &reading, pdMS_TO_TICKS(1000)) == pdTRUE;
-    if (new_stroke) {
-      last_stroke_us = esp_timer_get_time();
+    if (seqlock_version(&s_config_lock) != config_version)
+      config_version = read_config(&config);
+    uint32_t keepalive_ms = config.keepalive_ms;
+    float timeout_s = config.power_timeout_s;
+    int64_t timeout_us = (int64_t)(timeout_s * 1e6f);
+
+    uint32_t interval_ms = backoff_ms < keepalive_ms ? backoff_ms : keepalive_ms;
+    int64_t due_us = last_tx_us + (int64_t)interval_ms * 1000;
+    if (timeout_s > 0.0f && last_stroke_us > 0 && !zero_sent &&
+        last_stroke_us + timeout_us < due_us) {
+      due_us = last_stroke_us + timeout_us;
+    }
+    int64_t now = esp_timer_get_time();
+    /* Round up so we never wake a tick early and spin */
+    TickType_t wait = 0;
+    if (due_us > now)
+      wait = (TickType_t)((due_us - now + portTICK_PERIOD_MS * 1000 - 1) /
+                          (portTICK_PERIOD_MS * 1000));
+
+    ulTaskNotifyTake(pdTRUE, wait);
+    if (seqlock_version(&s_reading_lock) != reading_version) {
+      do {
+        reading_version = seqlock_read_begin(&s_reading_lock);
+        reading = s_reading;
+      } while (seqlock_read_retry(&s_reading_lock, reading_version));
+      conn_policy_set_active(true);
+      power_service_notify_stroke((int16_t)reading.power_w, reading.release_us);
+      control_service_notify_curve(&reading.curve);
+      if (reading.catch_us != 0)
+        control_service_notify_stroke((uint16_t)reading.stroke_count, reading.power_w,
+                                      reading.stroke_rate_spm, reading.catch_us,
+                                      reading.release_us);
+      last_stroke_us = last_tx_us = esp_timer_get_time();
+      backoff_ms = KEEPALIVE_FIRST_MS;
+      zero_sent = false;
+      continue;
     }
 
-    float timeout_s = atomic_load_explicit(&s_power_timeout_s, memory_order_relaxed);
-    bool timed_out = (timeout_s > 0.0f) && (last_stroke_us > 0) &&
-                     ((esp_timer_get_time() - last_stroke_us) >= (int64_t)(timeout_s * 1e6f));
-
+    now = esp_timer_get_time();
+    if (now < due_us)
+      continue; /* Woken for a stroke already sent */
+    bool timed_out = timeout_s > 0.0f && last_stroke_us > 0 && now - last_stroke_us >= timeout_us;
     send_power_notification(timed_out ? 0 : (int16_t)reading.power_w);
+    perf_count(&g_perf_stats.ble_keepalives);
+    last_tx_us = now;
+    if (timed_out && !zero_sent) {
+      /* Stopped paddling: slow the link down, and restart the backoff so the
+       * 0 W is repeated promptly once */
+      conn_policy_set_active(false);
+      zero_sent = true;
+      backoff_ms = KEEPALIVE_FIRST_MS;
+    } else if (backoff_ms < keepalive_ms) {
+      backoff_ms *= 2;
+    }
   }
   vTaskDelete(NULL);
 }
 
-static void calibrate_until_oriented(imu_calibration_t* cal, mpu6050_handle_t mpu,
-                                      const float forward[3]) {
+static void calibrate_until_oriented(imu_calibration_t* cal, const float forward[3]) {
   do {
-    imu_calibrate(cal, mpu);
+    imu_calibrate(cal);
     if (!imu_orientation_ok(cal, forward)) {
       ESP_LOGW(TAG, "Waiting for correct orientation — retrying in 1 s...");
       cal->calibrated = false;
@@ -264,81 +523,268 @@ static void calibrate_until_oriented(imu_calibration_t* cal, mpu6050_handle_t mp
   } while (!cal->calibrated);
 }
 
-static void power_update_task(void* param) {
-  mpu6050_handle_t mpu = (mpu6050_handle_t)param;
-  stroke_state_t stroke = {0};
-  imu_calibration_t cal = {0};
-  imu_power_state_t power = {0};
-
-  stroke_detector_init(&stroke);
-  imu_power_init(&power);
-  calibrate_until_oriented(&cal, mpu, power.forward);
+typedef struct {
+  stroke_state_t stroke;
+  imu_calibration_t cal;
+  imu_power_state_t power;
+  int64_t last_sample_us;
+  uint32_t period_us; /* Nominal sample spacing, for the jitter histogram */
+  int64_t busy_us; /* Last time a recording, log client or stream kept us awake */
+  pipeline_config_t config; /* Last applied s_config */
+  uint32_t config_version;
+  uint32_t speed_version;   /* Of the last boat speed fix applied */
+} imu_pipeline_t;
+
+/* Remember a good gravity vector for the next boot */
+static void save_gravity(imu_calibration_t* cal) {
+  memcpy(cal->saved, cal->gravity, sizeof(cal->saved));
+  persisted_settings_t* st = settings_store_begin();
+  memcpy(st->gravity, cal->gravity, sizeof(st->gravity));
+  st->gravity_valid = true;
+  settings_store_commit();
+}
 
-  int64_t last_sample_us = esp_timer_get_time();
-  ESP_LOGI(TAG, "IMU power task running at %d Hz", 1000 / IMU_SAMPLE_MS);
+/* Snapshot the calibration and settings the session will be replayed with */
+static void start_recording(const imu_pipeline_t* p) {
+  imu_record_header_t hdr = {
+      .mass_kg = p->power.mass_kg,
+      .catch_g = p->stroke.catch_g,
+      .recovery_g = p->stroke.recovery_g,
+  };
+  memcpy(hdr.gravity, p->cal.gravity, sizeof(hdr.gravity));
+  memcpy(hdr.forward, p->power.forward, sizeof(hdr.forward));
+  if (imu_recorder_start(&hdr) != ESP_OK) {
+    ESP_LOGW(TAG, "Recording not started");
+    wifi_log_server_set_status("!record:off");
+  }
+}
 
-  while (1) {
-    /* Drain settings queue before processing the next sample */
-    settings_msg_t msg;
-    while (xQueueReceive(s_settings_queue, &msg, 0) == pdTRUE) {
-      switch (msg.type) {
-        case SETTING_MASS:
-          power.mass_kg = msg.f;
-          break;
-        case SETTING_FORWARD_AXIS:
-          power.forward[0] = msg.v3[0];
-          power.forward[1] = msg.v3[1];
-          power.forward[2] = msg.v3[2];
-          break;
-        case SETTING_CATCH_G:
-          stroke.catch_g = msg.f;
-          break;
-        case SETTING_RECOVERY_G:
-          stroke.recovery_g = msg.f;
-          break;
-        case SETTING_VERBOSE:
-          power.verbose = msg.b;
-          break;
-        case SETTING_CALIBRATE:
-          ESP_LOGI(TAG, "Recalibrating: hold device still...");
-          calibrate_until_oriented(&cal, mpu, power.forward);
-          break;
-        case SETTING_SMOOTH_STROKES:
-          stroke.smooth_strokes = msg.i;
-          break;
-      }
+/* Pick up a changed s_config. Called between samples (polled) or bursts
+ * (FIFO); one load when nothing changed. */
+static void apply_config(imu_pipeline_t* p) {
+  if (seqlock_version(&s_config_lock) == p->config_version)
+    return;
+  const pipeline_config_t old = p->config;
+  p->config_version = read_config(&p->config);
+  const pipeline_config_t* c = &p->config;
+
+  p->power.mass_kg = c->mass_kg;
+  memcpy(p->power.forward, c->forward, sizeof(p->power.forward));
+  p->stroke.catch_g = c->catch_g;
+  p->stroke.recovery_g = c->recovery_g;
+  p->stroke.adaptive = c->adaptive;
+  p->stroke.smooth_strokes = c->smooth_strokes;
+#if IMU_POWER_VERBOSE
+  p->power.verbose = c->verbose;
+#endif
+  if (c->record_req != old.record_req) {
+    if (c->record)
+      start_recording(p);
+    else
+      imu_recorder_stop();
+  }
+#if IMU_USE_FIFO
+  if (c->odr_hz != old.odr_hz) {
+    /* A new rate resets the FIFO: its first sample has no dt */
+    imu_sensor_set_odr(c->odr_hz);
+    if (imu_sensor_period_us() != p->period_us) {
+      p->period_us = imu_sensor_period_us();
+      p->last_sample_us = 0;
     }
+  }
+#endif
+}
+
+#if IMU_USE_FIFO
+/* Idle sleep check, once per block. The idle clock runs from the last
+ * confirmed stroke (recovery_start_us); a recording in progress, an open
+ * log page or a BLE IMU stream holds it at "now". */
+static bool sleep_due(imu_pipeline_t* p) {
+  if (imu_recorder_active() || wifi_log_server_client_count() > 0 ||
+      imu_stream_service_active()) {
+    p->busy_us = esp_timer_get_time();
+    return false;
+  }
+  int64_t last = p->stroke.recovery_start_us > p->busy_us ? p->stroke.recovery_start_us
+                                                           : p->busy_us;
+  return p->stroke.phase == STROKE_PHASE_RECOVERY && power_manager_idle_expired(last);
+}
+#endif
 
-    mpu6050_acce_value_t acce;
-    if (mpu6050_get_acce(mpu, &acce) == ESP_OK) {
-      int64_t now = esp_timer_get_time();
-      float dt_s = (now - last_sample_us) / 1e6f;
-      last_sample_us = now;
+/* Run one block of samples through stroke detection and power estimation.
+ * blk->ts_us are acquisition times, not the time the block was processed. */
+static void process_block(imu_pipeline_t* p, imu_block_t* blk) {
+  /* STROKE_MIN_DURATION_US bounds this: a full block spans at most ~320 ms */
+  stroke_event_t events[MAX_STROKES_PER_BLOCK];
+  float event_power_w[MAX_STROKES_PER_BLOCK];
+  float event_dv_ms[MAX_STROKES_PER_BLOCK];
+  imu_power_curve_t event_curve[MAX_STROKES_PER_BLOCK];
+  float event_min_force_n[MAX_STROKES_PER_BLOCK];
+  int64_t t_start = esp_timer_get_time();
+
+  imu_block_prepare(blk, &p->last_sample_us);
+  for (int i = 0; i < blk->count; i++) {
+    if (blk->dt_us[i] > 0)
+      perf_hist_record(&g_perf_stats.sample_jitter_us, abs(blk->dt_us[i] - (int32_t)p->period_us));
+  }
+  int n_events = stroke_detector_update_block(&p->stroke, blk->dynamic_g, blk->ts_us, blk->count,
+                                              blk->phase, events, MAX_STROKES_PER_BLOCK);
+  if (imu_orientation_track_block(&p->cal, blk, p->power.forward))
+    save_gravity(&p->cal);
+  if (seqlock_version(&s_speed_lock) != p->speed_version) {
+    speed_fix_t fix;
+    do {
+      p->speed_version = seqlock_read_begin(&s_speed_lock);
+      fix = s_speed_fix;
+    } while (seqlock_read_retry(&s_speed_lock, p->speed_version));
+    speed_fusion_correct(&p->power.speed, fix.speed_ms, fix.t_us);
+  }
+  /* Per-sample trace only while someone is watching it */
+  p->power.trace = p->config.telemetry || imu_stream_service_derived_active();
+  imu_power_update_block(&p->power, &p->cal, blk, events, n_events, event_power_w,
+                         event_dv_ms, event_curve, event_min_force_n);
+  imu_recorder_push_block(blk, events, n_events);
+  imu_stream_service_push_block(blk, p->period_us, p->power.trace && p->cal.calibrated);
+  if (p->config.telemetry && p->cal.calibrated)
+    telemetry_push_block(blk, events, event_power_w, event_curve, n_events,
+                         p->stroke.stroke_count);
+  if (p->stroke.shake_detected) {
+    p->stroke.shake_detected = false;
+    wifi_control_request(true);
+  }
 
-      float mag =
-          sqrtf(acce.acce_x * acce.acce_x + acce.acce_y * acce.acce_y + acce.acce_z * acce.acce_z);
-      float dynamic_g = fabsf(mag - 1.0f);
+  for (int i = 0; i < n_events; i++) {
+    float drive_s = (events[i].release_us - events[i].catch_us) / 1e6f;
+    power_service_update_stroke(events[i].catch_exact_us, event_power_w[i] * drive_s,
+                                p->power.mass_kg * events[i].peak_accel_g * 9.81f,
+                                event_min_force_n[i]);
+    session_add_stroke(&events[i], event_power_w[i] * drive_s,
+                       p->power.speed_active ? p->power.speed.v_ms : -1.0f);
+    power_service_set_energy(session_energy_j());
+    stroke_history_push(&events[i], event_power_w[i], event_dv_ms[i]);
+
+    power_reading_t reading = {
+        .power_w = event_power_w[i],
+        .stroke_rate_spm = events[i].stroke_rate_spm,
+        .stroke_count = (uint32_t)(p->stroke.stroke_count - (n_events - 1 - i)),
+        .release_us = events[i].release_us,
+        .catch_us = events[i].catch_exact_us,
+        .curve = event_curve[i],
+    };
+    /* In crew mode the watch gets crew strokes, via on_crew_stroke */
+    if (crew_enabled())
+      crew_local_stroke(reading.catch_us, reading.power_w, reading.stroke_rate_spm);
+    else
+      publish_reading(&reading);
+  }
 
-      int stroke_done = stroke_detector_update(&stroke, dynamic_g, now);
-      if (stroke_done) {
-        power_service_update_crank(now);
-      }
+  perf_hist_record(&g_perf_stats.process_us, (uint32_t)(esp_timer_get_time() - t_start));
+}
 
-      float out_w = 0.0f;
-      imu_power_update(&power, &cal, &acce, stroke.phase, dt_s, &out_w);
+#if !IMU_USE_FIFO
+/* Ticks since the timer started; a tick that lands while the IMU task is
+ * still busy is skipped, not replayed, and the count keeps the grid */
+static _Atomic uint32_t s_tick_count;
 
-      if (stroke_done) {
-        power_reading_t reading = {
-            .power_w = power.avg_stroke_power_w,
-            .stroke_rate_spm = stroke.stroke_rate_spm,
-            .stroke_count = (uint32_t)stroke.stroke_count,
-        };
-        xQueueOverwrite(s_power_queue, &reading);
-      }
+/* esp_timer task: wake the IMU task for the next poll */
+static void sample_tick(void* arg) {
+  atomic_fetch_add_explicit(&s_tick_count, 1, memory_order_relaxed);
+  xTaskNotifyGive((TaskHandle_t)arg);
+}
+#endif
+
+static void power_update_task(void* param) {
+  imu_pipeline_t p = {0};
+  /* Static: ~1 KB, owned by this task only */
+  static imu_block_t blk;
+
+  stroke_detector_init(&p.stroke);
+  imu_power_init(&p.power);
+
+  /* Restored settings, seeded into s_config by app_main */
+  apply_config(&p);
+  persisted_settings_t st;
+  settings_store_get(&st);
+
+  /* Warm start: after a motion wakeup the pre-sleep gravity vector, else the
+   * last one saved to NVS (checked against a quick reading in case the
+   * sensor was remounted). Power streams at once; the attitude filter
+   * keeps the vector current from then on. Only a cold, never-calibrated unit
+   * needs the hold-still. */
+  bool warm = power_manager_restore_calibration(&p.cal);
+  if (!warm && st.gravity_valid) {
+    memcpy(p.cal.gravity, st.gravity, sizeof(p.cal.gravity));
+    p.cal.calibrated = true;
+    warm = imu_calibration_matches(&p.cal);
+  }
+  if (!warm || !imu_orientation_ok(&p.cal, p.power.forward)) {
+    calibrate_until_oriented(&p.cal, p.power.forward);
+    save_gravity(&p.cal);
+  } else {
+    memcpy(p.cal.saved, p.cal.gravity, sizeof(p.cal.saved));
+  }
+  p.busy_us = esp_timer_get_time();
+
+#if IMU_USE_FIFO
+  if (imu_sensor_fifo_start(IMU_INT_PIN, xTaskGetCurrentTaskHandle()) != ESP_OK) {
+    ESP_LOGE(TAG, "FIFO mode unavailable: check INT wiring to GPIO %d", IMU_INT_PIN);
+    vTaskDelete(NULL);
+  }
+  p.period_us = imu_sensor_period_us();
+  ESP_LOGI(TAG, "IMU power task running at %u Hz (FIFO)", (unsigned)(1000000 / p.period_us));
+
+  while (1) {
+    apply_config(&p);
+
+    /* Allow a few burst periods before concluding the interrupt has stopped */
+    const TickType_t burst_timeout =
+        pdMS_TO_TICKS(4 * imu_sensor_burst_samples() * p.period_us / 1000);
+    if (imu_sensor_fifo_read(&blk, burst_timeout) > 0) {
+      process_block(&p, &blk);
     }
+    if (sleep_due(&p)) {
+      power_manager_sleep(&p.cal);
+    }
+  }
+#else
+  /* Hardware-timer tick rather than vTaskDelay, so the period doesn't
+   * stretch by the read and processing time and stays off the tick grid.
+   * Samples are timestamped on the tick grid too, so dt is exactly the
+   * period however late the task gets to the read. */
+  p.period_us = IMU_SAMPLE_MS * 1000;
+  const esp_timer_create_args_t tick_args = {
+      .callback = sample_tick,
+      .arg = xTaskGetCurrentTaskHandle(),
+      .name = "imu_tick",
+  };
+  esp_timer_handle_t tick;
+  ESP_ERROR_CHECK(esp_timer_create(&tick_args, &tick));
+  int64_t tick_start_us = esp_timer_get_time();
+  ESP_ERROR_CHECK(esp_timer_start_periodic(tick, p.period_us));
+  ESP_LOGI(TAG, "IMU power task running at %d Hz", 1000 / IMU_SAMPLE_MS);
 
-    vTaskDelay(pdMS_TO_TICKS(IMU_SAMPLE_MS));
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    uint32_t n_ticks = atomic_load_explicit(&s_tick_count, memory_order_relaxed);
+    /* Settings changed since the last sample? One load if not */
+    apply_config(&p);
+
+    imu_raw_sample_t raw;
+    int64_t t_read = esp_timer_get_time();
+    if (imu_sensor_read_sample(&raw) == ESP_OK) {
+      perf_hist_record(&g_perf_stats.imu_read_us, (uint32_t)(esp_timer_get_time() - t_read));
+      blk.count = 1;
+      blk.ax[0] = raw.ax;
+      blk.ay[0] = raw.ay;
+      blk.az[0] = raw.az;
+      blk.gx[0] = raw.gx;
+      blk.gy[0] = raw.gy;
+      blk.gz[0] = raw.gz;
+      blk.ts_us[0] = tick_start_us + (int64_t)n_ticks * p.period_us;
+      process_block(&p, &blk);
+    }
   }
+#endif
 
   vTaskDelete(NULL);
 }
@@ -361,6 +807,14 @@ static void power_update_task(void* param) {
 
 #endif /* USE_IMU_POWER */
 
+/* Runs on the core it is installed from, which is where GPIO interrupts are
+ * then allocated. IRAM so the IMU data-ready timestamp isn't held up by
+ * flash writes (recorder, NVS); both handlers are IRAM_ATTR. */
+static void install_gpio_isr_service(void* arg) {
+  esp_err_t* err = arg;
+  *err = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+}
+
 void app_main(void) {
   esp_err_t ret;
   int rc = 0;
@@ -375,32 +829,96 @@ void app_main(void) {
   }
   ESP_ERROR_CHECK(ret);
 
-  wifi_log_server_start("PowerMeter", "");
+#if USE_IMU_POWER && IMU_USE_FIFO
+  power_manager_init(IMU_INT_PIN);
+#endif
 
 #if USE_IMU_POWER
-  s_settings_queue = xQueueCreate(8, sizeof(settings_msg_t));
-  s_power_queue = xQueueCreate(1, sizeof(power_reading_t));
-  wifi_log_server_set_command_cb(on_ws_command);
-  /* Initialize I2C and MPU6050 */
-  i2c_config_t conf = {
-      .mode = I2C_MODE_MASTER,
-      .sda_io_num = I2C_SDA_PIN,
-      .scl_io_num = I2C_SCL_PIN,
-      .sda_pullup_en = GPIO_PULLUP_ENABLE,
-      .scl_pullup_en = GPIO_PULLUP_ENABLE,
-      .master.clk_speed = I2C_FREQ_HZ,
+  persisted_settings_t settings = {
+      .mass_kg = TOTAL_MASS_KG,
+      .forward = {FORWARD_AXIS_X, FORWARD_AXIS_Y, FORWARD_AXIS_Z},
+      .catch_g = STROKE_CATCH_THRESHOLD_G,
+      .recovery_g = STROKE_RECOVERY_THRESHOLD_G,
+      .smooth_strokes = STROKE_RATE_SMOOTH_DEFAULT,
+      .power_timeout_s = POWER_TIMEOUT_DEFAULT_S,
+      .keepalive_ms = KEEPALIVE_DEFAULT_MS,
+      .strokes_per_rev = 1,
+      .sleep_s = POWER_MANAGER_IDLE_DEFAULT_S,
+#if IMU_USE_FIFO
+      .odr_hz = IMU_FIFO_ODR_HZ,
+#else
+      .odr_hz = 1000 / IMU_SAMPLE_MS,
+#endif
+  };
+  settings_store_init(&settings);
+  /* The IMU task applies its share in power_update_task, the notify task
+   * its own when it starts */
+  seqlock_write_begin(&s_config_lock);
+  s_config = (pipeline_config_t){
+      .mass_kg = settings.mass_kg,
+      .catch_g = settings.catch_g,
+      .recovery_g = settings.recovery_g,
+      .adaptive = settings.adaptive,
+      .smooth_strokes = settings.smooth_strokes,
+      .odr_hz = settings.odr_hz,
+      .power_timeout_s = settings.power_timeout_s,
+      .keepalive_ms = settings.keepalive_ms,
   };
-  ESP_ERROR_CHECK(i2c_param_config(I2C_PORT, &conf));
-  ESP_ERROR_CHECK(i2c_driver_install(I2C_PORT, I2C_MODE_MASTER, 0, 0, 0));
+  memcpy(s_config.forward, settings.forward, sizeof(s_config.forward));
+  seqlock_write_end(&s_config_lock);
+  power_service_set_strokes_per_rev(settings.strokes_per_rev);
+  power_manager_set_idle_timeout(settings.sleep_s);
+#endif
 
-  mpu6050_handle_t mpu = mpu6050_create(I2C_PORT, MPU6050_I2C_ADDRESS);
-  if (mpu == NULL) {
-    ESP_LOGE(TAG, "mpu6050_create failed: check I2C wiring");
+  /* Before anyone else installs it: the IMU data-ready ISR belongs on the IMU
+   * core (task_plan.h) */
+  esp_err_t isr_err;
+#if CONFIG_FREERTOS_UNICORE
+  install_gpio_isr_service(&isr_err);
+#else
+  ESP_ERROR_CHECK(esp_ipc_call_blocking(TASK_CORE_IMU, install_gpio_isr_service, &isr_err));
+#endif
+  ESP_ERROR_CHECK(isr_err);
+
+  /* WiFi is off until requested; keeps the SoftAP bring-up off the path to
+   * the first BLE advertisement */
+  wifi_control_init("PowerMeter", "", WIFI_BUTTON_PIN);
+  control_service_set_wifi_cb(wifi_control_request);
+#if WIFI_START_AT_BOOT
+  wifi_control_request(true);
+#endif
+  perf_stats_init();
+
+#if USE_IMU_POWER
+  control_service_set_speed_cb(on_boat_speed);
+  crew_init(on_crew_stroke);
+  crew_set_enabled(settings.crew);
+  wifi_log_server_set_command_cb(on_ws_command);
+  imu_recorder_init();
+  telemetry_init();
+  stroke_history_init();
+  session_init();
+  power_service_set_energy(session_energy_j());
+  /* Initialize I2C and MPU6050 */
+  if (imu_sensor_init(I2C_SDA_PIN, I2C_SCL_PIN, I2C_FREQ_HZ, IMU_I2C_ADDRESS) != ESP_OK) {
+    return;
+  }
+  /* A motion wakeup finds the sensor still in low-power cycle mode */
+  if (imu_sensor_exit_low_power() != ESP_OK) {
+    ESP_LOGW(TAG, "MPU6050 power mode reset failed");
+  }
+  if (imu_sensor_configure() != ESP_OK) {
+    ESP_LOGE(TAG, "MPU6050 setup failed: check I2C wiring");
     return;
   }
-  ESP_ERROR_CHECK(mpu6050_wake_up(mpu));
-  ESP_ERROR_CHECK(mpu6050_config(mpu, ACCE_FS_4G, GYRO_FS_500DPS));
 
+#if IMU_USE_FIFO
+  /* The DLPF follows the ODR, written when the FIFO starts. At the default
+   * 100 Hz, DLPF_CFG = 4 gives 20 Hz accel bandwidth: Nyquist (50 Hz) stays well
+   * above the cutoff while passing the catch transient, which the 10 Hz
+   * polled-mode filter smears over ~100 ms. */
+  imu_sensor_set_odr(settings.odr_hz);
+#else
   /* Configure MPU6050 digital low-pass filter (DLPF) to 10 Hz cutoff.
    * Register 0x1A (CONFIG), bits 2:0 = 5 gives 10 Hz accel/gyro bandwidth.
    *
@@ -410,19 +928,12 @@ void app_main(void) {
    * build over 500ms+ so they pass cleanly; single-sample vibration spikes
    * get attenuated. Stroke dynamics (~1 Hz) are well below the cutoff. */
   uint8_t dlpf_cfg = 0x05;
-  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-  i2c_master_start(cmd);
-  i2c_master_write_byte(cmd, (MPU6050_I2C_ADDRESS << 1) | I2C_MASTER_WRITE, true);
-  i2c_master_write_byte(cmd, 0x1A, true); /* CONFIG register */
-  i2c_master_write_byte(cmd, dlpf_cfg, true);
-  i2c_master_stop(cmd);
-  esp_err_t dlpf_ret = i2c_master_cmd_begin(I2C_PORT, cmd, pdMS_TO_TICKS(100));
-  i2c_cmd_link_delete(cmd);
-  if (dlpf_ret == ESP_OK) {
-    ESP_LOGI(TAG, "MPU6050 DLPF set to 10 Hz");
+  if (imu_sensor_set_dlpf(dlpf_cfg) == ESP_OK) {
+    ESP_LOGI(TAG, "MPU6050 DLPF_CFG set to %d", dlpf_cfg);
   } else {
     ESP_LOGW(TAG, "MPU6050 DLPF config failed (non-critical)");
   }
+#endif
 
   ESP_LOGI(TAG, "MPU6050 initialized");
 #endif
@@ -443,15 +954,40 @@ void app_main(void) {
     return;
   }
 
+  rc = control_service_init();
+  if (rc != 0) {
+    ESP_LOGE(TAG, "control_service_init failed: %d", rc);
+    return;
+  }
+
+  rc = imu_stream_service_init();
+  if (rc != 0) {
+    ESP_LOGE(TAG, "imu_stream_service_init failed: %d", rc);
+    return;
+  }
+
   nimble_host_config_init();
 
-  xTaskCreate(nimble_host_task, "NimBLE Host", 4 * 1024, NULL, 5, NULL);
+  /* Core and priority plan: task_plan.h */
+  TaskHandle_t task;
+#if USE_IMU_POWER
+  /* First: every stroke publisher wakes it (publish_reading) */
+  xTaskCreatePinnedToCore(ble_notify_task, "BLE Notify", 4 * 1024, NULL, TASK_PRIO_BLE_NOTIFY,
+                          &s_notify_task, TASK_CORE_RADIO);
+  perf_stats_register_task(s_notify_task);
+#endif
+  xTaskCreatePinnedToCore(nimble_host_task, "NimBLE Host", 4 * 1024, NULL, TASK_PRIO_NIMBLE_HOST,
+                          &task, TASK_CORE_RADIO);
+  perf_stats_register_task(task);
 
 #if USE_IMU_POWER
-  xTaskCreate(power_update_task, "Power Update", 4 * 1024, mpu, 5, NULL);
-  xTaskCreate(ble_notify_task, "BLE Notify", 4 * 1024, NULL, 5, NULL);
+  xTaskCreatePinnedToCore(power_update_task, "Power Update", 6 * 1024, NULL, TASK_PRIO_IMU, &task,
+                          TASK_CORE_IMU);
+  perf_stats_register_task(task);
 #else
-  xTaskCreate(power_update_task, "Power Update", 2 * 1024, NULL, 5, NULL);
+  xTaskCreatePinnedToCore(power_update_task, "Power Update", 2 * 1024, NULL, TASK_PRIO_IMU, &task,
+                          TASK_CORE_IMU);
+  perf_stats_register_task(task);
 #endif
 
   ESP_LOGI(TAG, "BLE Cycling Power Meter running");
@@ -0,0 +1,154 @@
+#include "perf_stats.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "wifi_log_server.h"
+
+#define TAG "PERF"
+#define MAX_TASKS 12
+#define JSON_BUF_SIZE 4096
+
+perf_stats_t g_perf_stats;
+
+static TaskHandle_t s_tasks[MAX_TASKS];
+static _Atomic int s_task_count;
+
+void perf_hist_record(perf_hist_t* h, uint32_t value_us) {
+  int b = value_us ? 32 - __builtin_clz(value_us) : 0;
+  if (b >= PERF_HIST_BUCKETS)
+    b = PERF_HIST_BUCKETS - 1;
+  h->bucket[b]++;
+  if (h->count == 0 || value_us < h->min_us)
+    h->min_us = value_us;
+  if (value_us > h->max_us)
+    h->max_us = value_us;
+  h->sum_us += value_us;
+  h->count++;
+}
+
+void perf_stats_register_task(TaskHandle_t task) {
+  int i = atomic_fetch_add(&s_task_count, 1);
+  if (i < MAX_TASKS)
+    s_tasks[i] = task;
+}
+
+/* ---- JSON ---- */
+
+typedef struct {
+  char* buf;
+  size_t len;
+  size_t cap;
+} json_buf_t;
+
+static void jprintf(json_buf_t* j, const char* fmt, ...) {
+  if (j->len >= j->cap)
+    return;
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(j->buf + j->len, j->cap - j->len, fmt, args);
+  va_end(args);
+  if (n > 0)
+    j->len += (size_t)n;
+}
+
+static void json_hist(json_buf_t* j, const char* name, const perf_hist_t* h, bool last) {
+  perf_hist_t snap = *h;
+  jprintf(j, "\"%s\":{\"count\":%u,\"min\":%u,\"max\":%u,\"mean\":%u,\"log2_us\":[", name,
+          (unsigned)snap.count, (unsigned)(snap.count ? snap.min_us : 0), (unsigned)snap.max_us,
+          (unsigned)(snap.count ? snap.sum_us / snap.count : 0));
+  /* Trim trailing empty buckets */
+  int top = PERF_HIST_BUCKETS;
+  while (top > 0 && snap.bucket[top - 1] == 0) top--;
+  for (int i = 0; i < top; i++) jprintf(j, i ? ",%u" : "%u", (unsigned)snap.bucket[i]);
+  jprintf(j, "]}%s", last ? "" : ",");
+}
+
+static void json_counter(json_buf_t* j, const char* name, _Atomic uint32_t* c, bool last) {
+  jprintf(j, "\"%s\":%u%s", name, (unsigned)atomic_load_explicit(c, memory_order_relaxed),
+          last ? "" : ",");
+}
+
+static void reset_stats(void) {
+  perf_stats_t* s = &g_perf_stats;
+  memset(&s->imu_read_us, 0, sizeof(perf_hist_t));
+  memset(&s->imu_wake_us, 0, sizeof(perf_hist_t));
+  memset(&s->process_us, 0, sizeof(perf_hist_t));
+  memset(&s->sample_jitter_us, 0, sizeof(perf_hist_t));
+  memset(&s->notify_latency_us, 0, sizeof(perf_hist_t));
+  atomic_store(&s->ble_notify_fail, 0);
+  atomic_store(&s->ble_keepalives, 0);
+  atomic_store(&s->log_drops, 0);
+  atomic_store(&s->fifo_overflows, 0);
+  atomic_store(&s->stream_drops, 0);
+}
+
+/* GET /stats[?reset=1] — reset clears everything after this report */
+static esp_err_t stats_get_handler(httpd_req_t* req) {
+  json_buf_t j = {.buf = malloc(JSON_BUF_SIZE), .cap = JSON_BUF_SIZE};
+  if (!j.buf)
+    return httpd_resp_send_500(req);
+  perf_stats_t* s = &g_perf_stats;
+
+  jprintf(&j, "{\"uptime_us\":%lld,\"heap_free\":%u,\"heap_min_free\":%u,",
+          (long long)esp_timer_get_time(), (unsigned)esp_get_free_heap_size(),
+          (unsigned)esp_get_minimum_free_heap_size());
+
+  jprintf(&j, "\"hist\":{");
+  json_hist(&j, "imu_read_us", &s->imu_read_us, false);
+  json_hist(&j, "imu_wake_us", &s->imu_wake_us, false);
+  json_hist(&j, "process_us", &s->process_us, false);
+  json_hist(&j, "sample_jitter_us", &s->sample_jitter_us, false);
+  json_hist(&j, "notify_latency_us", &s->notify_latency_us, true);
+  jprintf(&j, "},\"counters\":{");
+  json_counter(&j, "ble_notify_fail", &s->ble_notify_fail, false);
+  json_counter(&j, "ble_keepalives", &s->ble_keepalives, false);
+  json_counter(&j, "log_drops", &s->log_drops, false);
+  json_counter(&j, "fifo_overflows", &s->fifo_overflows, false);
+  json_counter(&j, "stream_drops", &s->stream_drops, true);
+
+  /* Stack high-water mark: minimum free stack ever seen, in bytes */
+  jprintf(&j, "},\"stack_free_min\":{");
+  int n = atomic_load(&s_task_count);
+  if (n > MAX_TASKS)
+    n = MAX_TASKS;
+  for (int i = 0; i < n; i++) {
+    jprintf(&j, "%s\"%s\":%u", i ? "," : "", pcTaskGetName(s_tasks[i]),
+            (unsigned)(uxTaskGetStackHighWaterMark(s_tasks[i]) * sizeof(StackType_t)));
+  }
+  /* Core affinity, to check the task_plan.h layout; -1 = unpinned */
+  jprintf(&j, "},\"core\":{");
+  for (int i = 0; i < n; i++) {
+    BaseType_t core = xTaskGetCoreID(s_tasks[i]);
+    jprintf(&j, "%s\"%s\":%d", i ? "," : "", pcTaskGetName(s_tasks[i]),
+            core == tskNO_AFFINITY ? -1 : (int)core);
+  }
+  jprintf(&j, "}}\n");
+
+  char query[16];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+      strcmp(query, "reset=1") == 0) {
+    reset_stats();
+  }
+
+  if (j.len >= j.cap)
+    ESP_LOGW(TAG, "/stats output truncated");
+  httpd_resp_set_type(req, "application/json");
+  esp_err_t err = httpd_resp_send(req, j.buf, j.len < j.cap ? j.len : j.cap - 1);
+  free(j.buf);
+  return err;
+}
+
+esp_err_t perf_stats_init(void) {
+  static const httpd_uri_t stats_uri = {
+      .uri = "/stats",
+      .method = HTTP_GET,
+      .handler = stats_get_handler,
+  };
+  wifi_log_server_register_uri(&stats_uri);
+  return ESP_OK;
+}
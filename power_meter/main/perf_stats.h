@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Lightweight timing and drop instrumentation, served as JSON at GET /stats.
+ *
+ * Histograms have one writer each (the task that owns the measured code) and
+ * are updated without locks; a /stats reader may see a sample half-applied,
+ * which is fine for monitoring. Counters that several tasks bump are atomic.
+ * Record calls cost a few dozen cycles and stay enabled in production. */
+
+/* Bucket 0 holds 0 us; bucket i (i >= 1) holds [2^(i-1), 2^i) us. The last
+ * bucket also collects everything above (~8 s). */
+#define PERF_HIST_BUCKETS 24
+
+typedef struct {
+  uint32_t count;
+  uint32_t min_us;
+  uint32_t max_us;
+  uint64_t sum_us;
+  uint32_t bucket[PERF_HIST_BUCKETS];
+} perf_hist_t;
+
+typedef struct {
+  /* IMU task */
+  perf_hist_t imu_read_us;      /* I2C time to drain one FIFO burst / poll one sample */
+  perf_hist_t imu_wake_us;      /* Newest data-ready interrupt to burst read done (FIFO) */
+  perf_hist_t process_us;       /* process_block(): detection, power, recorder, telemetry */
+  perf_hist_t sample_jitter_us; /* |sample dt - nominal period| */
+  /* BLE notify task */
+  perf_hist_t notify_latency_us; /* Stroke RELEASE to BLE_GAP_EVENT_NOTIFY_TX (NimBLE host) */
+
+  _Atomic uint32_t ble_notify_fail; /* mbuf allocation or ble_gatts_notify_custom failed */
+  _Atomic uint32_t ble_keepalives;  /* Repeat notifications sent between strokes */
+  _Atomic uint32_t log_drops;       /* Log lines that did not fit the WS log ring */
+  _Atomic uint32_t fifo_overflows;  /* MPU6050 FIFO overflowed and was reset */
+  _Atomic uint32_t stream_drops;    /* BLE IMU stream samples lost to a full queue */
+} perf_stats_t;
+
+extern perf_stats_t g_perf_stats;
+
+/* Add one measurement */
+void perf_hist_record(perf_hist_t* h, uint32_t value_us);
+
+static inline void perf_count(_Atomic uint32_t* counter) {
+  atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+/* Include task in the stack high-water mark report. Safe to call from any
+ * task; later registrations beyond the table size are ignored. */
+void perf_stats_register_task(TaskHandle_t task);
+
+/* Register GET /stats with wifi_log_server */
+esp_err_t perf_stats_init(void);
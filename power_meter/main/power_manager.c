@@ -0,0 +1,117 @@
+#include "power_manager.h"
+#include <stdatomic.h>
+#include <string.h>
+#include "driver/rtc_io.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "imu_recorder.h"
+#include "imu_sensor.h"
+#include "nimble/nimble_port.h"
+#include "soc/soc_caps.h"
+#include "wifi_control.h"
+
+#define TAG "POWER_MGR"
+#define RTC_CAL_MAGIC 0x4C414347 /* "GCAL" */
+/* Longest wait for the WiFi control task to stop the log server */
+#define WIFI_SHUTDOWN_TIMEOUT_MS 10000
+
+/* Survives deep sleep (not power-on reset) */
+typedef struct {
+  uint32_t magic;
+  float gravity[3];
+  float gyro_bias[3];
+} rtc_calibration_t;
+
+RTC_DATA_ATTR static rtc_calibration_t s_rtc_cal;
+
+static gpio_num_t s_wake_pin = GPIO_NUM_NC;
+static bool s_woke;
+static _Atomic uint32_t s_idle_timeout_s = POWER_MANAGER_IDLE_DEFAULT_S;
+
+void power_manager_init(gpio_num_t wake_pin) {
+  s_wake_pin = wake_pin;
+#if SOC_PM_SUPPORT_EXT0_WAKEUP
+  s_woke = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0;
+#else
+  s_woke = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO;
+#endif
+  if (s_woke) {
+#if SOC_RTCIO_INPUT_OUTPUT_SUPPORTED
+    /* ext0 left the pin routed to the RTC mux; the FIFO ISR needs it back */
+    rtc_gpio_deinit(wake_pin);
+#endif
+    ESP_LOGI(TAG, "Woke on motion (GPIO %d)", wake_pin);
+  }
+}
+
+bool power_manager_woke_from_sleep(void) {
+  return s_woke;
+}
+
+bool power_manager_restore_calibration(imu_calibration_t* cal) {
+  if (!s_woke || s_rtc_cal.magic != RTC_CAL_MAGIC)
+    return false;
+  memcpy(cal->gravity, s_rtc_cal.gravity, sizeof(cal->gravity));
+  memcpy(cal->gyro_bias, s_rtc_cal.gyro_bias, sizeof(cal->gyro_bias));
+  cal->calibrated = true;
+  ESP_LOGI(TAG, "Restored gravity [%.3f, %.3f, %.3f] from before sleep", cal->gravity[0],
+           cal->gravity[1], cal->gravity[2]);
+  return true;
+}
+
+void power_manager_set_idle_timeout(uint32_t seconds) {
+  atomic_store_explicit(&s_idle_timeout_s, seconds, memory_order_relaxed);
+}
+
+bool power_manager_idle_expired(int64_t last_activity_us) {
+  uint32_t timeout_s = atomic_load_explicit(&s_idle_timeout_s, memory_order_relaxed);
+  if (timeout_s == 0 || s_wake_pin == GPIO_NUM_NC)
+    return false;
+  return esp_timer_get_time() - last_activity_us >= (int64_t)timeout_s * 1000000;
+}
+
+void power_manager_sleep(const imu_calibration_t* cal) {
+  if (cal->calibrated) {
+    memcpy(s_rtc_cal.gravity, cal->gravity, sizeof(s_rtc_cal.gravity));
+    memcpy(s_rtc_cal.gyro_bias, cal->gyro_bias, sizeof(s_rtc_cal.gyro_bias));
+    s_rtc_cal.magic = RTC_CAL_MAGIC;
+  } else {
+    s_rtc_cal.magic = 0;
+  }
+
+  ESP_LOGI(TAG, "Idle: entering deep sleep, wake on motion > %d mg (GPIO %d)",
+           POWER_MANAGER_WAKE_THRESHOLD_MG, s_wake_pin);
+  imu_recorder_stop();
+  /* Through the control task, which owns start and stop */
+  if (!wifi_control_shutdown(WIFI_SHUTDOWN_TIMEOUT_MS))
+    ESP_LOGW(TAG, "WiFi did not stop in time; sleeping anyway");
+  nimble_port_stop();
+
+  if (imu_sensor_wake_on_motion(POWER_MANAGER_WAKE_THRESHOLD_MG) != ESP_OK) {
+    /* Without the interrupt we would never wake up; stay on instead */
+    ESP_LOGE(TAG, "Sleep aborted, restarting");
+    esp_restart();
+  }
+#if SOC_PM_SUPPORT_EXT0_WAKEUP
+  ESP_ERROR_CHECK(esp_sleep_enable_ext0_wakeup(s_wake_pin, 1));
+#elif SOC_GPIO_SUPPORT_DEEPSLEEP_WAKEUP
+  /* No ext0 (ESP32-C3): only the RTC-domain pads can wake from deep sleep,
+   * GPIO0-5 on the C3 */
+  ESP_ERROR_CHECK(esp_deep_sleep_enable_gpio_wakeup(1ULL << s_wake_pin, ESP_GPIO_WAKEUP_GPIO_HIGH));
+#else
+#error "No deep-sleep GPIO wakeup on this target"
+#endif
+  /* The MPU6050 drives INT push-pull; keep the pad from floating if it's
+   * ever unplugged */
+#if SOC_RTCIO_INPUT_OUTPUT_SUPPORTED
+  rtc_gpio_pullup_dis(s_wake_pin);
+  rtc_gpio_pulldown_en(s_wake_pin);
+#else
+  gpio_pullup_dis(s_wake_pin);
+  gpio_pulldown_en(s_wake_pin);
+#endif
+  esp_deep_sleep_start();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "imu_power.h"
+
+/* Idle deep sleep with MPU6050 wake-on-motion.
+ *
+ * The IMU task asks power_manager_idle_expired() after each block. Once no
+ * stroke has been confirmed for the idle timeout (and nobody is recording or
+ * watching the log page), power_manager_sleep() saves the gravity calibration
+ * in RTC memory, stops WiFi and BLE, arms the sensor's motion interrupt on
+ * the INT pin and enters deep sleep with a wakeup on that pin: ext0 where the
+ * chip has it, else deep-sleep GPIO wakeup (ESP32-C3, where INT must be on
+ * GPIO0-5). Moving the boat resets the chip; power_manager_restore_calibration()
+ * then hands back the saved gravity vector so streaming resumes without a
+ * hold-still.
+ *
+ * Needs the INT pin wired (IMU_USE_FIFO): without it nothing can wake us. */
+
+/* Default idle time before sleeping (s). 0 disables sleep. */
+#define POWER_MANAGER_IDLE_DEFAULT_S 600
+/* High-passed acceleration that wakes the device (mg). Well above sensor
+ * noise, well below a boat being picked up or pushed off. */
+#define POWER_MANAGER_WAKE_THRESHOLD_MG 80
+
+/* Call once early in app_main. Reports why we booted and, after an ext0
+ * wakeup, returns the wake pin to the digital GPIO matrix. */
+void power_manager_init(gpio_num_t wake_pin);
+
+/* True if this boot is a wakeup from power_manager_sleep() */
+bool power_manager_woke_from_sleep(void);
+
+/* Copy the calibration saved before sleep into cal. Returns false (cal
+ * untouched) on a cold boot, or if nothing valid was saved. */
+bool power_manager_restore_calibration(imu_calibration_t* cal);
+
+/* Idle timeout in seconds, 0 = never sleep. Any task. */
+void power_manager_set_idle_timeout(uint32_t seconds);
+
+/* True once last_activity_us (esp_timer time) is older than the timeout */
+bool power_manager_idle_expired(int64_t last_activity_us);
+
+/* Save cal, tear down radios and enter deep sleep. Does not return. Call from
+ * the IMU task: it owns the sensor. */
+void power_manager_sleep(const imu_calibration_t* cal);
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+/* Sequence lock for small blocks that one side publishes and another polls.
+ *
+ * The version is odd while a write is in progress. A reader copies the block
+ * between two loads of the version and retries if they differ or the first
+ * was odd; it never takes a lock and never blocks a writer. Writers hold a
+ * spinlock for the copy, which serialises several writers and keeps a reader
+ * on the writer's core from interrupting a half-written block. Keep the
+ * write section to a few field stores.
+ *
+ *   seqlock_write_begin(&lock);  block.x = v;  seqlock_write_end(&lock);
+ *
+ *   uint32_t v;
+ *   do {
+ *     v = seqlock_read_begin(&lock);
+ *     copy = block;
+ *   } while (seqlock_read_retry(&lock, v));
+ *
+ * seqlock_version() alone is a single load: poll it and read only when it
+ * moved. */
+typedef struct {
+  _Atomic uint32_t seq;
+  portMUX_TYPE writer;
+} seqlock_t;
+
+#define SEQLOCK_INITIALIZER {.seq = 0, .writer = portMUX_INITIALIZER_UNLOCKED}
+
+static inline void seqlock_write_begin(seqlock_t* l) {
+  portENTER_CRITICAL(&l->writer);
+  atomic_store_explicit(&l->seq, atomic_load_explicit(&l->seq, memory_order_relaxed) + 1,
+                        memory_order_relaxed);
+  /* The odd version is visible before any of the block's stores */
+  atomic_thread_fence(memory_order_release);
+}
+
+static inline void seqlock_write_end(seqlock_t* l) {
+  atomic_store_explicit(&l->seq, atomic_load_explicit(&l->seq, memory_order_relaxed) + 1,
+                        memory_order_release);
+  portEXIT_CRITICAL(&l->writer);
+}
+
+/* Even version at which the block was complete; spins out a write in
+ * progress on the other core */
+static inline uint32_t seqlock_read_begin(seqlock_t* l) {
+  uint32_t v;
+  while ((v = atomic_load_explicit(&l->seq, memory_order_acquire)) & 1) {
+  }
+  return v;
+}
+
+/* True if the block changed while it was being copied */
+static inline bool seqlock_read_retry(seqlock_t* l, uint32_t v) {
+  atomic_thread_fence(memory_order_acquire);
+  return atomic_load_explicit(&l->seq, memory_order_relaxed) != v;
+}
+
+/* Current version; compare with the one the last read returned */
+static inline uint32_t seqlock_version(seqlock_t* l) {
+  return atomic_load_explicit(&l->seq, memory_order_relaxed);
+}
@@ -0,0 +1,233 @@
+#include "session.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "ble_power_service.h"
+#include "nvs.h"
+#include "seqlock.h"
+#include "wifi_log_server.h"
+
+#define TAG "SESSION"
+#define NVS_NAMESPACE "pm"
+#define NVS_KEY "session"
+#define SESSION_MAGIC 0x53534553 /* "SESS" */
+#define SESSION_STORE_VERSION 1
+
+/* Running sums; the summary is derived from them on read */
+typedef struct {
+  uint32_t strokes;
+  uint32_t speed_strokes;
+  float energy_j;
+  float moving_s;
+  float distance_m;
+  float np_smooth_w; /* Smoothed stroke-cycle power */
+  float np_acc;      /* Sum of np_smooth_w^4 * dt (W^4 s) */
+} session_totals_t;
+
+/* The live copy. Not cleared at boot: session_init() decides whether it is
+ * still valid. */
+typedef struct {
+  uint32_t magic;
+  session_totals_t totals;
+  uint32_t crc;
+} rtc_session_t;
+
+/* On-flash form: layout guard + payload */
+typedef struct {
+  uint16_t version;
+  uint16_t size;
+  session_totals_t totals;
+} stored_blob_t;
+
+RTC_NOINIT_ATTR static rtc_session_t s_rtc;
+/* Writers: the IMU task (strokes) and whoever resets. Readers: the IMU
+ * task (CPS energy), httpd and the timer service task. */
+static seqlock_t s_lock = SEQLOCK_INITIALIZER;
+/* IMU task only */
+static int64_t s_last_catch_us;
+/* Timer service task only */
+static uint32_t s_saved_version;
+
+static uint32_t totals_crc(const session_totals_t* t) {
+  return esp_rom_crc32_le(0, (const uint8_t*)t, sizeof(*t));
+}
+
+static void read_totals(session_totals_t* out) {
+  uint32_t v;
+  do {
+    v = seqlock_read_begin(&s_lock);
+    *out = s_rtc.totals;
+  } while (seqlock_read_retry(&s_lock, v));
+}
+
+/* Caller holds the write side */
+static void set_totals(const session_totals_t* t) {
+  s_rtc.totals = *t;
+  s_rtc.crc = totals_crc(t);
+  s_rtc.magic = SESSION_MAGIC;
+}
+
+/* ---- persistence ---- */
+
+static bool load_nvs(session_totals_t* out) {
+  stored_blob_t blob;
+  size_t len = sizeof(blob);
+  nvs_handle_t nvs;
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs);
+  if (err == ESP_OK) {
+    err = nvs_get_blob(nvs, NVS_KEY, &blob, &len);
+    nvs_close(nvs);
+  }
+  if (err != ESP_OK || len != sizeof(blob) || blob.version != SESSION_STORE_VERSION ||
+      blob.size != sizeof(session_totals_t)) {
+    return false;
+  }
+  *out = blob.totals;
+  return true;
+}
+
+/* Timer service task: write the totals if they moved since the last save */
+static void save_timer_cb(TimerHandle_t timer) {
+  uint32_t version = seqlock_version(&s_lock);
+  if (version == s_saved_version)
+    return;
+  stored_blob_t blob = {.version = SESSION_STORE_VERSION, .size = sizeof(session_totals_t)};
+  read_totals(&blob.totals);
+
+  nvs_handle_t nvs;
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+  if (err == ESP_OK) {
+    err = nvs_set_blob(nvs, NVS_KEY, &blob, sizeof(blob));
+    if (err == ESP_OK)
+      err = nvs_commit(nvs);
+    nvs_close(nvs);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Saving session failed: %s", esp_err_to_name(err));
+  } else {
+    s_saved_version = version;
+  }
+}
+
+/* ---- accumulation ---- */
+
+void session_add_stroke(const stroke_event_t* ev, float energy_j, float speed_ms) {
+  /* Moving time: the whole cycle while paddling, only the drive after a pause */
+  int64_t gap_us = s_last_catch_us ? ev->catch_us - s_last_catch_us : 0;
+  s_last_catch_us = ev->catch_us;
+  float dt_s = gap_us > 0 && gap_us <= SESSION_PAUSE_US ? gap_us * 1e-6f
+                                                         : (ev->release_us - ev->catch_us) * 1e-6f;
+  if (dt_s <= 0.0f)
+    return;
+  const float cycle_w = energy_j / dt_s;
+  const float k = 1.0f - expf(-dt_s / SESSION_NP_TAU_S);
+
+  seqlock_write_begin(&s_lock);
+  session_totals_t t = s_rtc.totals;
+  t.np_smooth_w = t.strokes ? t.np_smooth_w + k * (cycle_w - t.np_smooth_w) : cycle_w;
+  const float p2 = t.np_smooth_w * t.np_smooth_w;
+  t.np_acc += p2 * p2 * dt_s;
+  t.strokes++;
+  t.energy_j += energy_j;
+  t.moving_s += dt_s;
+  if (speed_ms >= 0.0f) {
+    t.distance_m += speed_ms * dt_s;
+    t.speed_strokes++;
+  }
+  set_totals(&t);
+  seqlock_write_end(&s_lock);
+}
+
+void session_reset(void) {
+  const session_totals_t zero = {0};
+  seqlock_write_begin(&s_lock);
+  set_totals(&zero);
+  seqlock_write_end(&s_lock);
+  power_service_set_energy(0);
+  ESP_LOGI(TAG, "New session");
+}
+
+void session_get(session_summary_t* out) {
+  session_totals_t t;
+  read_totals(&t);
+  *out = (session_summary_t){
+      .strokes = t.strokes,
+      .energy_j = t.energy_j,
+      .moving_s = t.moving_s,
+      .avg_power_w = t.moving_s > 0.0f ? t.energy_j / t.moving_s : 0.0f,
+      .np_w = t.moving_s > 0.0f ? sqrtf(sqrtf(t.np_acc / t.moving_s)) : 0.0f,
+      .distance_m = t.distance_m,
+      .speed_strokes = t.speed_strokes,
+      .dps_m = t.speed_strokes ? t.distance_m / t.speed_strokes : 0.0f,
+  };
+}
+
+uint32_t session_energy_j(void) {
+  session_totals_t t;
+  read_totals(&t);
+  return t.energy_j > 0.0f ? (uint32_t)lrintf(t.energy_j) : 0;
+}
+
+/* ---- GET /session ---- */
+
+static esp_err_t session_get_handler(httpd_req_t* req) {
+  session_summary_t s;
+  session_get(&s);
+  char buf[256];
+  int len = snprintf(buf, sizeof(buf),
+                     "{\"strokes\":%lu,\"energy_kj\":%.1f,\"moving_s\":%.0f,"
+                     "\"avg_power_w\":%.1f,\"np_w\":%.1f,\"distance_m\":%.0f,"
+                     "\"speed_strokes\":%lu,\"dps_m\":%.2f}\n",
+                     (unsigned long)s.strokes, s.energy_j / 1000.0f, s.moving_s, s.avg_power_w,
+                     s.np_w, s.distance_m, (unsigned long)s.speed_strokes, s.dps_m);
+
+  char query[16];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+      strcmp(query, "reset=1") == 0) {
+    session_reset();
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  return httpd_resp_send(req, buf, len < (int)sizeof(buf) ? len : (int)sizeof(buf) - 1);
+}
+
+void session_init(void) {
+  /* Power-on is someone switching the unit on; every other reset happens
+   * to a running unit and continues its session */
+  esp_reset_reason_t reason = esp_reset_reason();
+  const char* from = "new";
+  session_totals_t t = {0};
+  if (reason == ESP_RST_POWERON || reason == ESP_RST_UNKNOWN) {
+    /* Keep the zeroed totals */
+  } else if (s_rtc.magic == SESSION_MAGIC && s_rtc.crc == totals_crc(&s_rtc.totals)) {
+    t = s_rtc.totals;
+    from = "RTC memory";
+  } else if (load_nvs(&t)) {
+    from = "NVS";
+  }
+  /* Through the lock, so the version moves and the first timer tick saves */
+  seqlock_write_begin(&s_lock);
+  set_totals(&t);
+  seqlock_write_end(&s_lock);
+  ESP_LOGI(TAG, "Session (%s): %lu strokes, %.1f kJ", from, (unsigned long)t.strokes,
+           t.energy_j / 1000.0f);
+
+  TimerHandle_t timer = xTimerCreate("session", pdMS_TO_TICKS(SESSION_SAVE_INTERVAL_MS), pdTRUE,
+                                     NULL, save_timer_cb);
+  if (timer == NULL || xTimerStart(timer, 0) != pdPASS)
+    ESP_LOGW(TAG, "No save timer: the session survives only in RTC memory");
+
+  static const httpd_uri_t session_uri = {
+      .uri = "/session",
+      .method = HTTP_GET,
+      .handler = session_get_handler,
+  };
+  wifi_log_server_register_uri(&session_uri);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include "stroke_detector.h"
+
+/* Session totals, kept on the unit so a watch or the browser can read a
+ * handful of numbers instead of every sample.
+ *
+ * The IMU task folds each confirmed stroke in with a constant amount of work:
+ *   energy      stroke energy, as sent in the CPS accumulated energy field
+ *   moving time catch-to-catch intervals up to SESSION_PAUSE_US; after a
+ *               longer gap only the stroke's drive counts
+ *   NP          normalised power: the 4th-power mean of the stroke-cycle
+ *               power smoothed with SESSION_NP_TAU_S, an exponential stand-in
+ *               for the usual 30-second rolling average
+ *   distance    speed estimate (speed_fusion.h) times the interval, for the
+ *               strokes that had one; distance per stroke is over those only
+ * Average power is energy over moving time: work per time paddled, lower
+ * than the per-stroke readings, which average over the drive.
+ *
+ * The totals live in RTC memory, which keeps them through a brownout, panic
+ * or watchdog reset and through deep sleep, and go to NVS every
+ * SESSION_SAVE_INTERVAL_MS while they change, for resets that lose RTC
+ * memory. Any reset except power-on continues the session from the RTC copy,
+ * or failing that the NVS one; power-on and session_reset() start a new one.
+ *
+ * GET /session returns the summary as JSON; /session?reset=1 starts a new
+ * session after reporting the old one. The session:reset command starts one
+ * too. */
+
+#define SESSION_PAUSE_US 6000000 /* 10 spm */
+#define SESSION_NP_TAU_S 30.0f
+#define SESSION_SAVE_INTERVAL_MS 60000
+
+typedef struct {
+  uint32_t strokes;
+  float energy_j;
+  float moving_s;
+  float avg_power_w;   /* energy_j / moving_s */
+  float np_w;          /* Normalised power */
+  float distance_m;    /* Over the strokes with a speed estimate */
+  uint32_t speed_strokes;
+  float dps_m;         /* Distance per stroke, 0 without a speed estimate */
+} session_summary_t;
+
+/* Restore or start the session and register GET /session with
+ * wifi_log_server. Once, after nvs_flash_init() and before the IMU task
+ * starts. */
+void session_init(void);
+
+/* IMU task: a confirmed stroke, its energy (J) and the boat speed at
+ * confirmation (m/s, negative without a speed estimate) */
+void session_add_stroke(const stroke_event_t* ev, float energy_j, float speed_ms);
+
+/* Any task */
+void session_get(session_summary_t* out);
+uint32_t session_energy_j(void);
+/* Zeroes the totals and the CPS accumulated energy */
+void session_reset(void);
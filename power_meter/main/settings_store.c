@@ -0,0 +1,91 @@
+#include "settings_store.h"
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "nvs.h"
+
+#define TAG "SETTINGS"
+#define NVS_NAMESPACE "pm"
+#define NVS_KEY "settings"
+
+/* On-flash form: layout guard + payload */
+typedef struct {
+  uint16_t version;
+  uint16_t size;
+  persisted_settings_t settings;
+} stored_blob_t;
+
+static persisted_settings_t s_settings;
+static SemaphoreHandle_t s_lock;
+static TimerHandle_t s_write_timer;
+
+/* Timer service task. The copy is taken under the lock; the flash write is
+ * not, so the IMU and HTTP tasks never wait on NVS. */
+static void write_timer_cb(TimerHandle_t timer) {
+  stored_blob_t blob = {.version = SETTINGS_STORE_VERSION, .size = sizeof(persisted_settings_t)};
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  blob.settings = s_settings;
+  xSemaphoreGive(s_lock);
+
+  nvs_handle_t nvs;
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+  if (err == ESP_OK) {
+    err = nvs_set_blob(nvs, NVS_KEY, &blob, sizeof(blob));
+    if (err == ESP_OK)
+      err = nvs_commit(nvs);
+    nvs_close(nvs);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Saving settings failed: %s", esp_err_to_name(err));
+  } else {
+    ESP_LOGI(TAG, "Settings saved");
+  }
+}
+
+void settings_store_init(persisted_settings_t* settings) {
+  s_lock = xSemaphoreCreateMutex();
+  s_write_timer = xTimerCreate("settings", pdMS_TO_TICKS(SETTINGS_STORE_DEBOUNCE_MS), pdFALSE,
+                               NULL, write_timer_cb);
+
+  stored_blob_t blob;
+  size_t len = sizeof(blob);
+  nvs_handle_t nvs;
+  esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs);
+  if (err == ESP_OK) {
+    err = nvs_get_blob(nvs, NVS_KEY, &blob, &len);
+    nvs_close(nvs);
+  }
+
+  if (err == ESP_OK && len == sizeof(blob) && blob.version == SETTINGS_STORE_VERSION &&
+      blob.size == sizeof(persisted_settings_t)) {
+    *settings = blob.settings;
+    ESP_LOGI(TAG, "Loaded settings: mass=%.1f kg catch=%.2f g recovery=%.2f g gravity %s",
+             settings->mass_kg, settings->catch_g, settings->recovery_g,
+             settings->gravity_valid ? "stored" : "not stored");
+  } else if (err == ESP_ERR_NVS_NOT_FOUND) {
+    ESP_LOGI(TAG, "No stored settings, using defaults");
+  } else {
+    ESP_LOGW(TAG, "Stored settings unusable (%s), using defaults",
+             err == ESP_OK ? "layout changed" : esp_err_to_name(err));
+  }
+  s_settings = *settings;
+}
+
+void settings_store_get(persisted_settings_t* out) {
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  *out = s_settings;
+  xSemaphoreGive(s_lock);
+}
+
+persisted_settings_t* settings_store_begin(void) {
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  return &s_settings;
+}
+
+void settings_store_commit(void) {
+  xSemaphoreGive(s_lock);
+  /* Restarts the countdown if a write is already pending */
+  xTimerReset(s_write_timer, 0);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Tuning settings and the last good gravity calibration, persisted to NVS.
+ *
+ * One blob under namespace "pm", key "settings". Changes are collected in RAM
+ * and written SETTINGS_STORE_DEBOUNCE_MS after the last one, so dragging a
+ * value around in the browser costs one flash write, not dozens. A blob from
+ * a different firmware layout (version or size mismatch) is ignored and the
+ * defaults are used. */
+
+#define SETTINGS_STORE_VERSION 5
+#define SETTINGS_STORE_DEBOUNCE_MS 5000
+
+typedef struct {
+  /* Browser settings (on_ws_command) */
+  float mass_kg;
+  float forward[3];
+  float catch_g;
+  float recovery_g;
+  bool adaptive; /* stroke_state_t.adaptive */
+  int32_t smooth_strokes;
+  float power_timeout_s;
+  uint32_t keepalive_ms;
+  int32_t strokes_per_rev; /* Crank revolution: 1 stroke, or 2 (L + R) */
+  bool crew;               /* Crew aggregator role (crew.h) */
+  uint32_t sleep_s;
+  uint32_t odr_hz;
+  /* Last good imu_calibration_t.gravity (unit vector) */
+  float gravity[3];
+  bool gravity_valid;
+} persisted_settings_t;
+
+/* Load from NVS into *settings. On entry *settings holds the defaults; they
+ * are kept if nothing valid is stored. Call once after nvs_flash_init(). */
+void settings_store_init(persisted_settings_t* settings);
+
+/* Copy of the current values. Any task. */
+void settings_store_get(persisted_settings_t* out);
+
+/* Edit in place: settings_store_begin() locks and returns the RAM copy,
+ * settings_store_commit() unlocks and (re)starts the debounced write. Keep the
+ * section to plain assignments. Not from an ISR or the timer task. */
+persisted_settings_t* settings_store_begin(void);
+void settings_store_commit(void);
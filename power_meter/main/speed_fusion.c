@@ -0,0 +1,45 @@
+#include "speed_fusion.h"
+#include <string.h>
+
+void speed_fusion_init(speed_fusion_t* f) {
+  memset(f, 0, sizeof(*f));
+  f->p00 = SPEED_FUSION_R;
+  f->p11 = SPEED_FUSION_P_B0;
+}
+
+/* F = [1 -dt; 0 1], Q = diag(q_v, q_b) * dt */
+void speed_fusion_predict(speed_fusion_t* f, float dt_s) {
+  if (f->last_fix_us == 0 || dt_s <= 0.0f)
+    return; /* Nothing to propagate until the first fix */
+  f->p00 += dt_s * (dt_s * f->p11 - 2.0f * f->p01 + SPEED_FUSION_Q_V);
+  f->p01 -= dt_s * f->p11;
+  f->p11 += dt_s * SPEED_FUSION_Q_B;
+}
+
+void speed_fusion_correct(speed_fusion_t* f, float z_ms, int64_t t_us) {
+  if (!speed_fusion_active(f, t_us)) {
+    /* First fix, or the estimate went stale: restart at the fix. The bias
+     * and its variance carry over. */
+    f->v_ms = z_ms;
+    f->p00 = SPEED_FUSION_R;
+    f->p01 = 0.0f;
+    f->last_fix_us = t_us;
+    return;
+  }
+
+  /* H = [1 0] */
+  float s = f->p00 + SPEED_FUSION_R;
+  float k0 = f->p00 / s;
+  float k1 = f->p01 / s;
+  float y = z_ms - f->v_ms;
+  f->v_ms += k0 * y;
+  f->bias_ms2 += k1 * y; /* p01 < 0 once predicted: b enters v with -dt */
+  f->p11 -= k1 * f->p01;
+  f->p01 -= k1 * f->p00;
+  f->p00 -= k0 * f->p00;
+  f->last_fix_us = t_us;
+}
+
+bool speed_fusion_active(const speed_fusion_t* f, int64_t now_us) {
+  return f->last_fix_us != 0 && now_us - f->last_fix_us < SPEED_FUSION_TIMEOUT_US;
+}
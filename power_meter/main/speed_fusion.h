@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Boat speed from external fixes (watch GPS over BLE) fused with the IMU's
+ * forward acceleration.
+ *
+ * Two-state Kalman filter, speed v and accelerometer bias b:
+ *
+ *   v' = v + (a_fwd - b) * dt      z = v + noise
+ *
+ * GPS speed arrives at ~1 Hz and lags; the accelerometer fills in within
+ * the stroke and the fixes pin down drift and bias. The mean step is one
+ * multiply-add, run per sample by the power integrator (imu_power.c) on
+ * whatever representation it integrates in. The covariance only depends on
+ * elapsed time, so it is propagated once per block, and fixes are applied
+ * between blocks. Plain float math, no RTOS: it also builds on the host. */
+
+/* Process noise: unmodelled acceleration (projection error, sensor noise)
+ * on v, (m/s)^2 per s, and bias random walk, (m/s^2)^2 per s */
+#define SPEED_FUSION_Q_V 0.05f
+#define SPEED_FUSION_Q_B 1e-4f
+/* Fix noise, (m/s)^2: ~0.3 m/s for a watch GPS */
+#define SPEED_FUSION_R 0.09f
+/* Initial bias variance: ~0.5 m/s^2, a couple of degrees of tilt error */
+#define SPEED_FUSION_P_B0 0.25f
+/* Without a fix for this long the estimate is no longer trusted; the next
+ * fix restarts it */
+#define SPEED_FUSION_TIMEOUT_US 5000000
+
+typedef struct {
+  float v_ms;     /* Speed estimate */
+  float bias_ms2; /* Forward accelerometer bias estimate */
+  float p00, p01, p11; /* Covariance of (v, b) */
+  int64_t last_fix_us; /* esp_timer time of the last fix, 0 = none yet */
+} speed_fusion_t;
+
+void speed_fusion_init(speed_fusion_t* f);
+
+/* Propagate the covariance over dt_s; the caller has advanced v_ms */
+void speed_fusion_predict(speed_fusion_t* f, float dt_s);
+
+/* Apply a speed fix z_ms taken at t_us */
+void speed_fusion_correct(speed_fusion_t* f, float z_ms, int64_t t_us);
+
+/* True if a fix is recent enough for v_ms to be used at now_us */
+bool speed_fusion_active(const speed_fusion_t* f, int64_t now_us);
@@ -0,0 +1,56 @@
+#include "spsc_ring.h"
+#include <string.h>
+
+bool spsc_ring_init(spsc_ring_t* ring, void* storage, size_t elem_size, uint32_t capacity) {
+  if (!storage || elem_size == 0 || capacity == 0 || (capacity & (capacity - 1)) != 0)
+    return false;
+  ring->buf = storage;
+  ring->elem_size = elem_size;
+  ring->mask = capacity - 1;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->dropped, 0);
+  return true;
+}
+
+bool spsc_ring_push(spsc_ring_t* ring, const void* elem) {
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (head - tail > ring->mask) {
+    atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+    return false;
+  }
+  memcpy(ring->buf + (head & ring->mask) * ring->elem_size, elem, ring->elem_size);
+  /* Release: the element bytes are visible before the new head is */
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return true;
+}
+
+size_t spsc_ring_pop(spsc_ring_t* ring, void* out, size_t max) {
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  uint32_t avail = head - tail;
+  size_t n = avail < max ? avail : max;
+
+  /* Copy in at most two runs: up to the end of storage, then from the start */
+  uint32_t start = tail & ring->mask;
+  size_t first = ring->mask + 1 - start;
+  if (first > n)
+    first = n;
+  memcpy(out, ring->buf + start * ring->elem_size, first * ring->elem_size);
+  memcpy((uint8_t*)out + first * ring->elem_size, ring->buf, (n - first) * ring->elem_size);
+
+  /* Release: we are done reading the slots before the producer may reuse them */
+  atomic_store_explicit(&ring->tail, tail + (uint32_t)n, memory_order_release);
+  return n;
+}
+
+uint32_t spsc_ring_count(spsc_ring_t* ring) {
+  return atomic_load_explicit(&ring->head, memory_order_acquire) -
+         atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+void spsc_ring_clear(spsc_ring_t* ring) {
+  atomic_store_explicit(&ring->tail, atomic_load_explicit(&ring->head, memory_order_acquire),
+                        memory_order_release);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Lock-free single-producer / single-consumer ring of fixed-size elements.
+ *
+ * One task pushes, one task pops; neither blocks. head is only written by the
+ * producer and tail only by the consumer, so each side needs nothing stronger
+ * than acquire/release ordering on the other side's index. If the ring is
+ * full the push fails and dropped is incremented — the producer never waits
+ * on a slow consumer. */
+typedef struct {
+  uint8_t* buf;
+  size_t elem_size;
+  uint32_t mask;          /* capacity - 1, capacity is a power of two */
+  _Atomic uint32_t head;  /* next slot to write (producer) */
+  _Atomic uint32_t tail;  /* next slot to read (consumer) */
+  _Atomic uint32_t dropped;
+} spsc_ring_t;
+
+/* storage must hold capacity * elem_size bytes; capacity must be a power of
+ * two. Returns false on invalid arguments. */
+bool spsc_ring_init(spsc_ring_t* ring, void* storage, size_t elem_size, uint32_t capacity);
+
+/* Producer side. Returns false (and counts a drop) if the ring is full. */
+bool spsc_ring_push(spsc_ring_t* ring, const void* elem);
+
+/* Consumer side. Copies up to max elements into out; returns the count. */
+size_t spsc_ring_pop(spsc_ring_t* ring, void* out, size_t max);
+
+/* Elements currently queued. Exact from either side, approximate otherwise. */
+uint32_t spsc_ring_count(spsc_ring_t* ring);
+
+/* Consumer side. Discard everything queued. */
+void spsc_ring_clear(spsc_ring_t* ring);
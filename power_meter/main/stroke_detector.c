@@ -1,4 +1,5 @@
 #include "stroke_detector.h"
+#include <math.h>
 #include <string.h>
 #include "esp_log.h"
 
@@ -10,19 +11,122 @@ void stroke_detector_init(stroke_state_t* state) {
   state->catch_g = STROKE_CATCH_THRESHOLD_G;
   state->recovery_g = STROKE_RECOVERY_THRESHOLD_G;
   state->smooth_strokes = STROKE_RATE_SMOOTH_DEFAULT;
+  state->thr_catch_g = state->catch_g;
+  state->thr_recovery_g = state->recovery_g;
 }
 
-int stroke_detector_update(stroke_state_t* state, float accel_g, int64_t ts_us) {
+static float clampf(float v, float lo, float hi) {
+  return v < lo ? lo : v > hi ? hi : v;
+}
+
+/* Thresholds in use, from the settings and (adaptive) the statistics */
+static void stroke_detector_refresh(stroke_state_t* state) {
+  if (!state->adaptive) {
+    state->thr_catch_g = state->catch_g;
+    state->thr_recovery_g = state->recovery_g;
+    return;
+  }
+
+  float c = state->catch_g;
+  if (state->peak_buf_count >= STROKE_ADAPT_MIN_STROKES) {
+    c = STROKE_ADAPT_CATCH_FRAC * state->peak_ref_g;
+    c = clampf(c, state->catch_g / STROKE_ADAPT_CLAMP, state->catch_g * STROKE_ADAPT_CLAMP);
+  }
+  /* Chop: keep the catch above what the recovery looks like */
+  if (state->noise_count >= STROKE_ADAPT_MIN_NOISE) {
+    float floor_g = state->noise_mean_g + STROKE_ADAPT_NOISE_K * sqrtf(state->noise_var_g2);
+    if (c < floor_g)
+      c = fminf(floor_g, state->catch_g * STROKE_ADAPT_CLAMP);
+  }
+  /* Recovery is only ever lowered: releasing earlier would cut strokes below
+   * STROKE_MIN_DURATION_US */
+  float rec = fminf(state->recovery_g, STROKE_ADAPT_RECOVERY_MAX_FRAC * c);
+  if (c < rec + STROKE_ADAPT_HYST_G)
+    c = rec + STROKE_ADAPT_HYST_G;
+  state->thr_catch_g = c;
+  state->thr_recovery_g = rec;
+}
+
+/* One recovery sample into the noise EWMA. O(1), adaptive mode only. */
+static inline void stroke_detector_noise(stroke_state_t* state, float accel_g) {
+  float d = accel_g - state->noise_mean_g;
+  state->noise_mean_g += STROKE_ADAPT_NOISE_ALPHA * d;
+  state->noise_var_g2 = (1.0f - STROKE_ADAPT_NOISE_ALPHA) *
+                        (state->noise_var_g2 + STROKE_ADAPT_NOISE_ALPHA * d * d);
+  if (state->noise_count < STROKE_ADAPT_MIN_NOISE) {
+    /* Seed with the first sample so the mean doesn't climb from 0 */
+    if (state->noise_count++ == 0) {
+      state->noise_mean_g = accel_g;
+      state->noise_var_g2 = 0.0f;
+    }
+  }
+}
+
+/* A confirmed stroke's peak into the window; re-rank it. Once per stroke,
+ * so a sort of STROKE_ADAPT_WINDOW values is fine. */
+static void stroke_detector_record_peak(stroke_state_t* state) {
+  state->peak_buf[state->peak_buf_idx] = state->peak_accel_g;
+  state->peak_buf_idx = (state->peak_buf_idx + 1) % STROKE_ADAPT_WINDOW;
+  if (state->peak_buf_count < STROKE_ADAPT_WINDOW)
+    state->peak_buf_count++;
+
+  float sorted[STROKE_ADAPT_WINDOW];
+  int n = state->peak_buf_count;
+  for (int i = 0; i < n; i++) {
+    float v = state->peak_buf[i];
+    int j = i;
+    for (; j > 0 && sorted[j - 1] > v; j--) sorted[j] = sorted[j - 1];
+    sorted[j] = v;
+  }
+  state->peak_ref_g = sorted[(n - 1) * STROKE_ADAPT_PEAK_PCT / 100];
+  stroke_detector_refresh(state);
+  ESP_LOGD(TAG, "Thresholds: catch %.3f g  recovery %.3f g  (peak p%d %.2f g)",
+           state->thr_catch_g, state->thr_recovery_g, STROKE_ADAPT_PEAK_PCT, state->peak_ref_g);
+}
+
+/* A CATCH that ended too soon. Hard enough, often enough, it is a shake. */
+static void stroke_detector_short_jolt(stroke_state_t* state, int64_t ts_us) {
+  if (state->peak_accel_g < STROKE_SHAKE_PEAK_G)
+    return;
+  if (state->shake_count == 0 || ts_us - state->shake_window_us > STROKE_SHAKE_WINDOW_US) {
+    state->shake_count = 0;
+    state->shake_window_us = ts_us;
+  }
+  if (++state->shake_count >= STROKE_SHAKE_COUNT) {
+    state->shake_count = 0;
+    state->shake_detected = true;
+    ESP_LOGI(TAG, "Shake gesture");
+  }
+}
+
+/* Sub-sample catch instant: where the line between the previous sample and
+ * this one crosses the catch threshold. Falls back to the sample time
+ * without a usable previous sample. */
+static inline int64_t stroke_detector_catch_time(const stroke_state_t* state,
+                                                 float accel_g,
+                                                 int64_t ts_us) {
+  int64_t dt_us = ts_us - state->prev_ts_us;
+  float a0 = state->prev_accel_g;
+  if (state->prev_ts_us == 0 || dt_us <= 0 || dt_us > STROKE_INTERP_MAX_GAP_US ||
+      a0 >= state->thr_catch_g)
+    return ts_us;
+  float f = (state->thr_catch_g - a0) / (accel_g - a0);
+  return ts_us - (int64_t)((1.0f - f) * (float)dt_us);
+}
+
+static inline int stroke_detector_step(stroke_state_t* state, float accel_g, int64_t ts_us) {
   int stroke_completed = 0;
 
   switch (state->phase) {
     case STROKE_PHASE_RECOVERY:
-      if (accel_g > state->catch_g) {
+      if (accel_g > state->thr_catch_g) {
         state->phase = STROKE_PHASE_CATCH;
-        state->prev_stroke_start_us = state->stroke_start_us;
         state->stroke_start_us = ts_us;
+        state->catch_exact_us = stroke_detector_catch_time(state, accel_g, ts_us);
         state->peak_accel_g = accel_g;
         ESP_LOGD(TAG, "CATCH at %.3f g", accel_g);
+      } else if (state->adaptive) {
+        stroke_detector_noise(state, accel_g);
       }
       break;
 
@@ -31,8 +135,9 @@ int stroke_detector_update(stroke_state_t* state, float accel_g, int64_t ts_us)
         state->peak_accel_g = accel_g;
         state->phase = STROKE_PHASE_PULL;
         ESP_LOGD(TAG, "PULL peak %.3f g", accel_g);
-      } else if (accel_g < state->recovery_g) {
+      } else if (accel_g < state->thr_recovery_g) {
         /* Spike too brief, treat as noise, return to recovery */
+        stroke_detector_short_jolt(state, ts_us);
         state->phase = STROKE_PHASE_RECOVERY;
       }
       break;
@@ -41,8 +146,9 @@ int stroke_detector_update(stroke_state_t* state, float accel_g, int64_t ts_us)
       if (accel_g > state->peak_accel_g) {
         state->peak_accel_g = accel_g;
       }
-      if (accel_g < state->recovery_g) {
+      if (accel_g < state->thr_recovery_g) {
         state->phase = STROKE_PHASE_RELEASE;
+        state->release_us = ts_us;
         ESP_LOGD(TAG, "RELEASE");
       }
       break;
@@ -50,12 +156,12 @@ int stroke_detector_update(stroke_state_t* state, float accel_g, int64_t ts_us)
     case STROKE_PHASE_RELEASE: {
       int64_t duration_us = ts_us - state->stroke_start_us;
 
-      if (accel_g < state->recovery_g) {
+      if (accel_g < state->thr_recovery_g) {
         /* Confirm stroke only if duration is plausible */
         if (duration_us >= STROKE_MIN_DURATION_US && duration_us <= STROKE_MAX_DURATION_US) {
           state->stroke_duration_s = duration_us / 1e6f;
-          if (state->prev_stroke_start_us > 0) {
-            float period_s = (state->stroke_start_us - state->prev_stroke_start_us) / 1e6f;
+          if (state->last_catch_exact_us > 0) {
+            float period_s = (state->catch_exact_us - state->last_catch_exact_us) / 1e6f;
             state->period_buf[state->period_buf_idx] = period_s;
             state->period_buf_idx = (state->period_buf_idx + 1) % STROKE_RATE_MAX_SMOOTH;
             if (state->period_buf_count < STROKE_RATE_MAX_SMOOTH)
@@ -71,15 +177,20 @@ int stroke_detector_update(stroke_state_t* state, float accel_g, int64_t ts_us)
             }
             state->stroke_rate_spm = 60.0f / (sum / window);
           }
+          state->last_catch_exact_us = state->catch_exact_us;
           state->recovery_start_us = ts_us;
           state->stroke_count++;
           stroke_completed = 1;
+          if (state->adaptive)
+            stroke_detector_record_peak(state);
 
           ESP_LOGI(TAG, "Stroke #%d  peak=%.2fg  dur=%.2fs  rate=%.1f spm", state->stroke_count,
                    state->peak_accel_g, state->stroke_duration_s, state->stroke_rate_spm);
+        } else if (duration_us < STROKE_MIN_DURATION_US) {
+          stroke_detector_short_jolt(state, ts_us);
         }
         state->phase = STROKE_PHASE_RECOVERY;
-      } else if (accel_g > state->catch_g) {
+      } else if (accel_g > state->thr_catch_g) {
         /* Acceleration picked back up, back into pull */
         state->phase = STROKE_PHASE_PULL;
       }
@@ -87,5 +198,64 @@ int stroke_detector_update(stroke_state_t* state, float accel_g, int64_t ts_us)
     }
   }
 
+  state->prev_accel_g = accel_g;
+  state->prev_ts_us = ts_us;
   return stroke_completed;
 }
+
+int stroke_detector_update(stroke_state_t* state, float accel_g, int64_t ts_us) {
+  stroke_detector_refresh(state);
+  return stroke_detector_step(state, accel_g, ts_us);
+}
+
+int stroke_detector_update_block(stroke_state_t* state,
+                                 const float* accel_g,
+                                 const int64_t* ts_us,
+                                 int n,
+                                 stroke_phase_t* phase_out,
+                                 stroke_event_t* events,
+                                 int max_events) {
+  int n_events = 0;
+  int i = 0;
+
+  stroke_detector_refresh(state);
+  while (i < n) {
+    /* Fast path: most samples arrive during recovery and only need the catch
+     * compare. Scan ahead without touching the rest of the state, apart from
+     * the noise statistics in adaptive mode. */
+    if (state->phase == STROKE_PHASE_RECOVERY) {
+      const float catch_g = state->thr_catch_g;
+      const int start = i;
+      if (state->adaptive) {
+        while (i < n && accel_g[i] <= catch_g) {
+          stroke_detector_noise(state, accel_g[i]);
+          phase_out[i++] = STROKE_PHASE_RECOVERY;
+        }
+      } else {
+        while (i < n && accel_g[i] <= catch_g) {
+          phase_out[i++] = STROKE_PHASE_RECOVERY;
+        }
+      }
+      if (i > start) {
+        state->prev_accel_g = accel_g[i - 1];
+        state->prev_ts_us = ts_us[i - 1];
+      }
+      if (i == n)
+        break;
+    }
+
+    if (stroke_detector_step(state, accel_g[i], ts_us[i]) && n_events < max_events) {
+      events[n_events].index = i;
+      events[n_events].timestamp_us = ts_us[i];
+      events[n_events].catch_us = state->stroke_start_us;
+      events[n_events].catch_exact_us = state->catch_exact_us;
+      events[n_events].release_us = state->release_us;
+      events[n_events].peak_accel_g = state->peak_accel_g;
+      events[n_events].stroke_rate_spm = state->stroke_rate_spm;
+      n_events++;
+    }
+    phase_out[i++] = state->phase;
+  }
+
+  return n_events;
+}
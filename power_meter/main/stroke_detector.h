@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 typedef enum {
@@ -21,16 +22,55 @@ typedef enum {
 #define STROKE_RATE_MAX_SMOOTH 8
 /* Default smoothing window size (strokes) */
 #define STROKE_RATE_SMOOTH_DEFAULT 3
+/* Catch instants are interpolated between the two samples straddling the
+ * catch threshold, unless they are further apart than this (FIFO restart) */
+#define STROKE_INTERP_MAX_GAP_US 100000
+/* Shake gesture: STROKE_SHAKE_COUNT too-short "strokes" peaking above
+ * STROKE_SHAKE_PEAK_G within STROKE_SHAKE_WINDOW_US. Paddling never peaks
+ * that hard in under STROKE_MIN_DURATION_US; shaking the paddle does. */
+#define STROKE_SHAKE_PEAK_G 1.5f
+#define STROKE_SHAKE_COUNT 4
+#define STROKE_SHAKE_WINDOW_US 1500000 /* 1.5 s */
+
+/* Adaptive thresholds (stroke_state_t.adaptive). The catch threshold is
+ * STROKE_ADAPT_CATCH_FRAC of the STROKE_ADAPT_PEAK_PCT percentile of the
+ * last STROKE_ADAPT_WINDOW stroke peaks, so a weak stroke in a hard piece
+ * still clears it, within a factor STROKE_ADAPT_CLAMP of the manual setting.
+ * In chop it is raised to STROKE_ADAPT_NOISE_K standard deviations above the
+ * mean of recovery samples (EWMA, STROKE_ADAPT_NOISE_ALPHA per sample: ~1 s
+ * at 100 Hz), up to the same clamp. Recovery is the manual setting, lowered
+ * to STROKE_ADAPT_RECOVERY_MAX_FRAC of a low catch, and catch stays
+ * STROKE_ADAPT_HYST_G above it. Until there are STROKE_ADAPT_MIN_STROKES
+ * peaks and STROKE_ADAPT_MIN_NOISE recovery samples, the manual values are
+ * used. */
+#define STROKE_ADAPT_NOISE_ALPHA 0.01f
+#define STROKE_ADAPT_NOISE_K 3.0f
+#define STROKE_ADAPT_MIN_NOISE 100
+#define STROKE_ADAPT_WINDOW 16
+#define STROKE_ADAPT_PEAK_PCT 25
+#define STROKE_ADAPT_CATCH_FRAC 0.4f
+#define STROKE_ADAPT_RECOVERY_MAX_FRAC 0.5f
+#define STROKE_ADAPT_HYST_G 0.1f
+#define STROKE_ADAPT_CLAMP 2.0f
+#define STROKE_ADAPT_MIN_STROKES 4
 
 typedef struct {
-  /* Settings — owned exclusively by the IMU task, updated via settings queue */
+  /* Settings — owned exclusively by the IMU task, updated from s_config (main.c) */
   float catch_g;      /* Catch threshold (g) */
   float recovery_g;   /* Recovery threshold (g) */
   int smooth_strokes; /* Rate smoothing window (strokes) */
+  bool adaptive;      /* Derive the thresholds from the statistics below */
+
+  /* Thresholds in use: catch_g/recovery_g, or the adaptive ones. Refreshed
+   * once per block (per sample in stroke_detector_update) and per stroke. */
+  float thr_catch_g;
+  float thr_recovery_g;
 
   stroke_phase_t phase;
   int64_t stroke_start_us;      /* Time catch began (current stroke) */
-  int64_t prev_stroke_start_us; /* Time catch began (previous stroke) */
+  int64_t catch_exact_us;       /* Threshold crossing of that catch, interpolated */
+  int64_t last_catch_exact_us;  /* catch_exact_us of the last confirmed stroke */
+  int64_t release_us;           /* Time pull ended (current stroke) */
   int64_t recovery_start_us;    /* Time recovery began */
   float peak_accel_g;           /* Peak acceleration during pull */
   float stroke_duration_s;      /* Duration of last complete stroke */
@@ -40,13 +80,54 @@ typedef struct {
   float period_buf[STROKE_RATE_MAX_SMOOTH];
   int period_buf_idx;   /* Next write position (circular) */
   int period_buf_count; /* Number of valid entries */
+  /* Previous sample, for the catch interpolation */
+  float prev_accel_g;
+  int64_t prev_ts_us;
+  /* Adaptive statistics, kept while adaptive is set */
+  float noise_mean_g;  /* EWMA of recovery samples */
+  float noise_var_g2;  /* EWMA variance of recovery samples */
+  int noise_count;     /* Recovery samples seen, saturates at STROKE_ADAPT_MIN_NOISE */
+  float peak_buf[STROKE_ADAPT_WINDOW]; /* Peaks of the last confirmed strokes */
+  int peak_buf_idx;
+  int peak_buf_count;
+  float peak_ref_g; /* STROKE_ADAPT_PEAK_PCT percentile of peak_buf */
+  /* Shake gesture detection */
+  int shake_count;         /* Jolts in the current window */
+  int64_t shake_window_us; /* Time of the first jolt in the window */
+  bool shake_detected;     /* Set on a shake; the caller clears it */
 } stroke_state_t;
 
+/* A stroke confirmed inside a block (see stroke_detector_update_block) */
+typedef struct {
+  int index;             /* Sample index within the block that confirmed it */
+  int64_t timestamp_us;  /* Timestamp of that sample */
+  int64_t catch_us;      /* Timestamp of the RECOVERY -> CATCH transition */
+  int64_t catch_exact_us; /* Interpolated catch threshold crossing, <= catch_us */
+  int64_t release_us;    /* Timestamp of the PULL -> RELEASE transition */
+  float peak_accel_g;    /* Peak dynamic acceleration during the pull */
+  float stroke_rate_spm; /* Smoothed rate after this stroke, from catch_exact_us */
+} stroke_event_t;
+
 void stroke_detector_init(stroke_state_t* state);
 
-/* Settings (catch_g, recovery_g, smooth_strokes) live in stroke_state_t and are
- * updated directly by the owning task from the settings queue. */
+/* Settings (catch_g, recovery_g, smooth_strokes, adaptive) live in
+ * stroke_state_t and are updated directly by the owning task from its
+ * configuration snapshot. */
 
 /* Feed one acceleration sample (magnitude in g, timestamp in microseconds).
  * Returns 1 if a stroke just completed, 0 otherwise. */
 int stroke_detector_update(stroke_state_t* state, float accel_magnitude_g, int64_t timestamp_us);
+
+/* Feed a block of n samples (magnitudes in g, timestamps in microseconds).
+ *   phase_out  - phase after each sample, n entries
+ *   events     - completed strokes, in sample order
+ *   max_events - capacity of events; later strokes are still counted in the
+ *                state but not reported
+ * Returns the number of events written. */
+int stroke_detector_update_block(stroke_state_t* state,
+                                 const float* accel_magnitude_g,
+                                 const int64_t* timestamp_us,
+                                 int n,
+                                 stroke_phase_t* phase_out,
+                                 stroke_event_t* events,
+                                 int max_events);
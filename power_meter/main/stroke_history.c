@@ -0,0 +1,129 @@
+#include "stroke_history.h"
+#include <math.h>
+#include <stdlib.h>
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "wifi_log_server.h"
+
+#define TAG "STROKE_HIST"
+
+/* Records per HTTP chunk (512 bytes, on the httpd task's stack) */
+#define DOWNLOAD_CHUNK 32
+
+/* One writer (IMU task), readers on the httpd and NimBLE host tasks, on the
+ * other core. A 16-byte push and a chunk copy are short enough for a
+ * spinlock. */
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static stroke_record_t s_ring[STROKE_HISTORY_LEN];
+static uint32_t s_total;
+
+static uint16_t sat_u16(float v) {
+  return v <= 0.0f ? 0 : v >= 65535.0f ? 65535 : (uint16_t)lrintf(v);
+}
+
+static int16_t sat_i16(float v) {
+  return v <= -32768.0f ? -32768 : v >= 32767.0f ? 32767 : (int16_t)lrintf(v);
+}
+
+void stroke_history_push(const stroke_event_t* ev, float power_w, float dv_ms) {
+  const stroke_record_t rec = {
+      .t_ms = (uint32_t)(ev->catch_us / 1000),
+      .duration_ms = sat_u16((ev->timestamp_us - ev->catch_us) / 1000.0f),
+      .drive_ms = sat_u16((ev->release_us - ev->catch_us) / 1000.0f),
+      .peak_mg = sat_u16(ev->peak_accel_g * 1000.0f),
+      .dv_mm_s = sat_i16(dv_ms * 1000.0f),
+      .power_w = sat_u16(power_w),
+      .rate_cspm = sat_u16(ev->stroke_rate_spm * 100.0f),
+  };
+  portENTER_CRITICAL(&s_lock);
+  s_ring[s_total % STROKE_HISTORY_LEN] = rec;
+  s_total++;
+  portEXIT_CRITICAL(&s_lock);
+}
+
+int stroke_history_read(uint32_t from, stroke_record_t* out, int max, uint32_t* first) {
+  portENTER_CRITICAL(&s_lock);
+  uint32_t total = s_total;
+  uint32_t oldest = total > STROKE_HISTORY_LEN ? total - STROKE_HISTORY_LEN : 0;
+  if (from < oldest)
+    from = oldest;
+  int n = from < total ? (int)(total - from) : 0;
+  if (n > max)
+    n = max;
+  for (int i = 0; i < n; i++) out[i] = s_ring[(from + i) % STROKE_HISTORY_LEN];
+  portEXIT_CRITICAL(&s_lock);
+
+  *first = from;
+  return n;
+}
+
+uint32_t stroke_history_total(void) {
+  portENTER_CRITICAL(&s_lock);
+  uint32_t total = s_total;
+  portEXIT_CRITICAL(&s_lock);
+  return total;
+}
+
+/* ---- download ---- */
+
+static esp_err_t strokes_get_handler(httpd_req_t* req) {
+  uint32_t from = 0;
+  char query[32];
+  char val[12];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+      httpd_query_key_value(query, "from", val, sizeof(val)) == ESP_OK) {
+    from = strtoul(val, NULL, 10);
+  }
+
+  /* The header promises what is there now; strokes confirmed during the
+   * download are left for the next ?from= */
+  uint32_t total = stroke_history_total();
+  uint32_t oldest = total > STROKE_HISTORY_LEN ? total - STROKE_HISTORY_LEN : 0;
+  uint32_t first = from > oldest ? from : oldest;
+  stroke_history_header_t hdr = {
+      .magic = STROKE_HISTORY_MAGIC,
+      .version = STROKE_HISTORY_VERSION,
+      .record_size = sizeof(stroke_record_t),
+      .first_index = first,
+      .count = first < total ? total - first : 0,
+      .total = total,
+  };
+
+  httpd_resp_set_type(req, "application/octet-stream");
+  httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"strokes.bin\"");
+  esp_err_t err = httpd_resp_send_chunk(req, (const char*)&hdr, sizeof(hdr));
+
+  stroke_record_t buf[DOWNLOAD_CHUNK];
+  uint32_t next = hdr.first_index;
+  uint32_t remaining = hdr.count;
+  while (err == ESP_OK && remaining > 0) {
+    int max = remaining < DOWNLOAD_CHUNK ? (int)remaining : DOWNLOAD_CHUNK;
+    int n = stroke_history_read(next, buf, max, &first);
+    if (first != next || n == 0) {
+      /* Overwritten under us: only possible with a full ring and a stalled
+       * client. Truncate rather than send a gap the header doesn't show. */
+      ESP_LOGW(TAG, "History overtaken during download");
+      err = ESP_FAIL;
+      break;
+    }
+    err = httpd_resp_send_chunk(req, (const char*)buf, n * sizeof(stroke_record_t));
+    next += n;
+    remaining -= n;
+  }
+
+  if (err != ESP_OK) {
+    ESP_LOGW(TAG, "Download aborted: %s", esp_err_to_name(err));
+    return err;
+  }
+  return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+void stroke_history_init(void) {
+  static const httpd_uri_t strokes_uri = {
+      .uri = "/strokes.bin",
+      .method = HTTP_GET,
+      .handler = strokes_get_handler,
+  };
+  wifi_log_server_register_uri(&strokes_uri);
+}
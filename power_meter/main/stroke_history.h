@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include "stroke_detector.h"
+
+/* Per-stroke analytics, the last STROKE_HISTORY_LEN strokes in RAM.
+ *
+ * The IMU task appends one record per confirmed stroke. The history is read
+ * in bulk at GET /strokes.bin (optionally ?from=<index> for only the newer
+ * strokes) and a page at a time from the BLE control service. Strokes are
+ * numbered from 0 since boot; a record's index is its position in that
+ * sequence, so a reader can resume where it left off and tell how many it
+ * missed. Deep sleep and reboots clear it.
+ *
+ * Download layout (little-endian):
+ *   stroke_history_header_t
+ *   count x stroke_record_t, oldest first
+ */
+
+#define STROKE_HISTORY_LEN 2048 /* 32 KB; ~2 h at 20 spm */
+#define STROKE_HISTORY_MAGIC 0x4B525453 /* "STRK" */
+#define STROKE_HISTORY_VERSION 1
+
+/* One stroke, 16 bytes. Values saturate at the field's range. */
+typedef struct __attribute__((packed)) {
+  uint32_t t_ms;        /* Catch, esp_timer ms (wraps after ~50 days) */
+  uint16_t duration_ms; /* Catch to confirmation */
+  uint16_t drive_ms;    /* Catch to release */
+  uint16_t peak_mg;     /* Peak dynamic acceleration during the pull */
+  int16_t dv_mm_s;      /* Delta-v over catch and pull */
+  uint16_t power_w;
+  uint16_t rate_cspm; /* Smoothed rate after the stroke, 0.01 spm */
+} stroke_record_t;
+
+typedef struct __attribute__((packed)) {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;
+  uint32_t first_index; /* Index of the first record that follows */
+  uint32_t count;
+  uint32_t total; /* Strokes recorded since boot */
+} stroke_history_header_t;
+
+/* Register GET /strokes.bin with wifi_log_server. Once, before the IMU task
+ * starts. */
+void stroke_history_init(void);
+
+/* IMU task: append a confirmed stroke. Never blocks. */
+void stroke_history_push(const stroke_event_t* ev, float power_w, float dv_ms);
+
+/* Any task: copy up to max records starting at stroke index from into out.
+ * *first receives the index of out[0], later than from if those strokes
+ * have already been overwritten. Returns the number copied. */
+int stroke_history_read(uint32_t from, stroke_record_t* out, int max, uint32_t* first);
+
+/* Strokes recorded since boot (the index the next one will get) */
+uint32_t stroke_history_total(void);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+/* Core and priority layout for every task the application creates.
+ *
+ * PRO_CPU (0) runs the radios: BT controller, NimBLE host, WiFi, lwIP,
+ * esp_timer and the HTTP server, pinned there in sdkconfig or here. APP_CPU
+ * (1) is left to the IMU task, so the sample loop never waits behind a
+ * radio burst; its data-ready interrupt is allocated on APP_CPU too
+ * (app_main). Everything that only moves data to a human (WebSocket log,
+ * telemetry, recorder flash writes) sits at the bottom so it yields to both.
+ *
+ *   Task           Core  Prio
+ *   Power Update   IMU   20    FIFO burst / timer tick -> power, strokes
+ *   NimBLE Host    RADIO 6     (controller and WiFi tasks: 23, from IDF)
+ *   BLE Notify     RADIO 5
+ *   httpd          RADIO 4
+ *   wifi_ctl       RADIO 3     WiFi start/stop, blocks for a while
+ *   imu_rec        RADIO 2     Sector writes to flash
+ *   telemetry      RADIO 2
+ *   imu_stream     RADIO 2     BLE sample stream (ble_imu_stream_service.h)
+ *   ws_log_send    RADIO 1     Lowest: logs can wait, they are ring-buffered
+ *
+ * Single-core chips (CONFIG_FREERTOS_UNICORE) put everything on core 0; the
+ * priorities alone then keep the IMU task ahead of the stacks we own. */
+
+#if CONFIG_FREERTOS_UNICORE
+#define TASK_CORE_IMU 0
+#define TASK_CORE_RADIO 0
+#else
+#define TASK_CORE_IMU 1   /* APP_CPU */
+#define TASK_CORE_RADIO 0 /* PRO_CPU */
+#endif
+
+#define TASK_PRIO_IMU 20
+#define TASK_PRIO_NIMBLE_HOST 6
+#define TASK_PRIO_BLE_NOTIFY 5
+#define TASK_PRIO_HTTPD 4
+#define TASK_PRIO_WIFI_CTL 3
+#define TASK_PRIO_RECORDER 2
+#define TASK_PRIO_TELEMETRY 2
+#define TASK_PRIO_IMU_STREAM 2
+#define TASK_PRIO_LOG_SENDER 1
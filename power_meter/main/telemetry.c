@@ -0,0 +1,94 @@
+#include "telemetry.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "perf_stats.h"
+#include "spsc_ring.h"
+#include "task_plan.h"
+#include "wifi_log_server.h"
+
+_Static_assert(sizeof(telemetry_sample_t) == 16, "telemetry_sample_t must stay 16 bytes");
+_Static_assert(sizeof(telemetry_stroke_t) == 16, "telemetry_stroke_t must stay 16 bytes");
+_Static_assert(sizeof(telemetry_curve_t) == 16, "telemetry_curve_t must stay 16 bytes");
+_Static_assert(IMU_CURVE_BIN_MAX_US / 1000 <= UINT8_MAX, "bin_ms must fit telemetry_curve_t");
+
+/* 256 records = 2.5 s at 100 Hz, enough to ride out a stalled client */
+#define RING_CAPACITY 256
+/* Records per WebSocket frame (1 KB) */
+#define FRAME_RECORDS 64
+
+static spsc_ring_t s_ring;
+static telemetry_record_t s_ring_storage[RING_CAPACITY];
+
+static void telemetry_task(void* arg) {
+  static telemetry_record_t frame[FRAME_RECORDS];
+  while (1) {
+    vTaskDelay(pdMS_TO_TICKS(TELEMETRY_PERIOD_MS));
+
+    size_t n;
+    while ((n = spsc_ring_pop(&s_ring, frame, FRAME_RECORDS)) > 0) {
+      wifi_log_server_send_binary(frame, n * sizeof(telemetry_record_t));
+    }
+  }
+}
+
+void telemetry_init(void) {
+  spsc_ring_init(&s_ring, s_ring_storage, sizeof(telemetry_record_t), RING_CAPACITY);
+  /* Below the IMU and BLE tasks, just above the text log sender */
+  TaskHandle_t task;
+  xTaskCreatePinnedToCore(telemetry_task, "telemetry", 3 * 1024, NULL, TASK_PRIO_TELEMETRY, &task,
+                          TASK_CORE_RADIO);
+  perf_stats_register_task(task);
+}
+
+void telemetry_push_block(const imu_block_t* blk,
+                          const stroke_event_t* events,
+                          const float* event_power_w,
+                          const imu_power_curve_t* event_curve,
+                          int n_events,
+                          int stroke_count) {
+  int next_event = 0;
+  for (int i = 0; i < blk->count; i++) {
+    uint32_t t_ms = (uint32_t)(blk->ts_us[i] / 1000);
+    telemetry_record_t rec = {
+        .sample =
+            {
+                .type = TELEMETRY_SAMPLE,
+                .phase = (uint8_t)blk->phase[i],
+                .t_ms = t_ms,
+                .a_fwd_ms2 = blk->a_fwd_ms2[i],
+                .dv_ms = blk->dv_ms[i],
+            },
+    };
+    spsc_ring_push(&s_ring, &rec);
+
+    for (; next_event < n_events && events[next_event].index == i; next_event++) {
+      telemetry_record_t srec = {
+          .stroke =
+              {
+                  .type = TELEMETRY_STROKE,
+                  .stroke_count = (uint16_t)(stroke_count - (n_events - 1 - next_event)),
+                  .t_ms = t_ms,
+                  .power_w = event_power_w[next_event],
+                  .rate_spm = events[next_event].stroke_rate_spm,
+              },
+      };
+      spsc_ring_push(&s_ring, &srec);
+
+      const imu_power_curve_t* c = &event_curve[next_event];
+      for (int k = 0; k < c->n_bins; k += TELEMETRY_CURVE_BINS) {
+        telemetry_record_t crec = {
+            .curve =
+                {
+                    .type = TELEMETRY_CURVE,
+                    .first_bin = (uint8_t)k,
+                    .n_bins = c->n_bins,
+                    .bin_ms = (uint8_t)c->bin_ms,
+                },
+        };
+        for (int j = 0; j < TELEMETRY_CURVE_BINS && k + j < c->n_bins; j++)
+          crec.curve.power_w[j] = c->power_w[k + j];
+        spsc_ring_push(&s_ring, &crec);
+      }
+    }
+  }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include "imu_block.h"
+#include "imu_power.h"
+#include "stroke_detector.h"
+
+/* Structured live telemetry over the log server's WebSocket.
+ *
+ * The IMU task queues fixed 16-byte records into a lock-free ring; a
+ * low-priority sender batches whatever is queued into one
+ * HTTPD_WS_TYPE_BINARY frame every TELEMETRY_PERIOD_MS. The browser page
+ * decodes the records (little-endian) and plots them. Text log lines are
+ * unaffected and still arrive as TEXT frames. */
+
+#define TELEMETRY_PERIOD_MS 100
+
+typedef enum {
+  TELEMETRY_SAMPLE = 1,
+  TELEMETRY_STROKE = 2,
+  TELEMETRY_CURVE = 3,
+} telemetry_type_t;
+
+/* One IMU sample, as fed to the integrator */
+typedef struct __attribute__((packed)) {
+  uint8_t type;  /* TELEMETRY_SAMPLE */
+  uint8_t phase; /* stroke_phase_t after this sample */
+  uint16_t reserved;
+  uint32_t t_ms; /* esp_timer time, ms (wraps after ~50 days) */
+  float a_fwd_ms2;
+  float dv_ms; /* Delta-v of the stroke in progress */
+} telemetry_sample_t;
+
+/* One confirmed stroke; follows the sample that confirmed it */
+typedef struct __attribute__((packed)) {
+  uint8_t type; /* TELEMETRY_STROKE */
+  uint8_t reserved;
+  uint16_t stroke_count; /* Low 16 bits */
+  uint32_t t_ms;
+  float power_w;
+  float rate_spm;
+} telemetry_stroke_t;
+
+/* Part of a stroke's power curve (imu_power_curve_t), six bins per record;
+ * the records follow the stroke record, first_bin ascending */
+#define TELEMETRY_CURVE_BINS 6
+typedef struct __attribute__((packed)) {
+  uint8_t type;      /* TELEMETRY_CURVE */
+  uint8_t first_bin; /* Bin index of power_w[0] */
+  uint8_t n_bins;    /* Bins in the whole curve; slots past the end are 0 */
+  uint8_t bin_ms;
+  int16_t power_w[TELEMETRY_CURVE_BINS];
+} telemetry_curve_t;
+
+typedef union {
+  uint8_t type;
+  telemetry_sample_t sample;
+  telemetry_stroke_t stroke;
+  telemetry_curve_t curve;
+} telemetry_record_t;
+
+/* Create the ring and the sender task. Frames are dropped while WiFi is off. */
+void telemetry_init(void);
+
+/* Producer side (IMU task): queue a block's samples with the strokes it
+ * confirmed, and their power curves, interleaved in sample order. blk->a_fwd_ms2/dv_ms must have been
+ * filled (imu_power_state_t.trace). stroke_count is the detector's count
+ * after the block. Never blocks; records that don't fit are dropped. */
+void telemetry_push_block(const imu_block_t* blk,
+                          const stroke_event_t* events,
+                          const float* event_power_w,
+                          const imu_power_curve_t* event_curve,
+                          int n_events,
+                          int stroke_count);
@@ -0,0 +1,109 @@
+#include "wifi_control.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "perf_stats.h"
+#include "task_plan.h"
+#include "wifi_log_server.h"
+
+#define TAG "WIFI_CTL"
+
+/* Task notification bits */
+#define REQ_ON 0x01
+#define REQ_OFF 0x02
+#define REQ_SHUTDOWN 0x04 /* Off for good, acked through s_shutdown_done */
+
+/* Idle check period while WiFi is on */
+#define POLL_MS 5000
+
+static TaskHandle_t s_task;
+static SemaphoreHandle_t s_shutdown_done;
+static const char* s_ssid;
+static const char* s_password;
+
+static void IRAM_ATTR button_isr(void* arg) {
+  BaseType_t woken = pdFALSE;
+  xTaskNotifyFromISR(s_task, REQ_ON, eSetBits, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+static void wifi_control_task(void* arg) {
+  int64_t last_client_us = 0;
+  bool shut_down = false;
+  while (1) {
+    uint32_t req = 0;
+    xTaskNotifyWait(0, UINT32_MAX, &req,
+                    wifi_log_server_running() ? pdMS_TO_TICKS(POLL_MS) : portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+
+    /* Off wins if both arrived together; after a shutdown nothing starts it */
+    if (req & REQ_SHUTDOWN) {
+      wifi_log_server_stop();
+      shut_down = true;
+      xSemaphoreGive(s_shutdown_done);
+    } else if (req & REQ_OFF) {
+      wifi_log_server_stop();
+    } else if ((req & REQ_ON) && !shut_down && !wifi_log_server_running()) {
+      ESP_LOGI(TAG, "Starting WiFi log server");
+      wifi_log_server_start(s_ssid, s_password);
+      last_client_us = now;
+    }
+
+    if (!wifi_log_server_running())
+      continue;
+    if (wifi_log_server_client_count() > 0) {
+      last_client_us = now;
+    } else if (now - last_client_us >= (int64_t)WIFI_CONTROL_IDLE_OFF_S * 1000000) {
+      ESP_LOGI(TAG, "No log client for %d s, stopping WiFi", WIFI_CONTROL_IDLE_OFF_S);
+      wifi_log_server_stop();
+    }
+  }
+}
+
+void wifi_control_init(const char* ssid, const char* password, gpio_num_t button_pin) {
+  s_ssid = ssid;
+  s_password = password;
+  s_shutdown_done = xSemaphoreCreateBinary();
+
+  /* Below the IMU and BLE tasks; WiFi bring-up can take a while */
+  xTaskCreatePinnedToCore(wifi_control_task, "wifi_ctl", 4 * 1024, NULL, TASK_PRIO_WIFI_CTL,
+                          &s_task, TASK_CORE_RADIO);
+  perf_stats_register_task(s_task);
+
+  if (button_pin == GPIO_NUM_NC)
+    return;
+  const gpio_config_t io = {
+      .pin_bit_mask = 1ULL << button_pin,
+      .mode = GPIO_MODE_INPUT,
+      .pull_up_en = GPIO_PULLUP_ENABLE,
+      .intr_type = GPIO_INTR_NEGEDGE,
+  };
+  esp_err_t err = gpio_config(&io);
+  if (err == ESP_OK) {
+    err = gpio_install_isr_service(0);
+    if (err == ESP_ERR_INVALID_STATE)
+      err = ESP_OK;
+  }
+  if (err == ESP_OK)
+    err = gpio_isr_handler_add(button_pin, button_isr, NULL);
+  if (err != ESP_OK)
+    ESP_LOGW(TAG, "WiFi button on GPIO %d unavailable: %s", button_pin, esp_err_to_name(err));
+}
+
+void wifi_control_request(bool on) {
+  if (s_task)
+    xTaskNotify(s_task, on ? REQ_ON : REQ_OFF, eSetBits);
+}
+
+bool wifi_control_shutdown(uint32_t timeout_ms) {
+  if (!s_task) {
+    /* No control task: the caller is the only one starting or stopping */
+    wifi_log_server_stop();
+    return true;
+  }
+  xTaskNotify(s_task, REQ_SHUTDOWN, eSetBits);
+  return xSemaphoreTake(s_shutdown_done, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/gpio.h"
+
+/* On-demand WiFi for the log server.
+ *
+ * WiFi stays off from boot, so BLE has the radio to itself and the first
+ * advertisement isn't held up by the SoftAP bring-up. A request turns it on:
+ * the BOOT button, a shake of the paddle, or a write to the BLE control
+ * characteristic. It switches itself off after WIFI_CONTROL_IDLE_OFF_S with
+ * no WebSocket client connected. Start and stop run on a small dedicated
+ * task, since both block and some requesters (NimBLE host, httpd) must not. */
+
+/* Auto-off after this long with no log page open (s) */
+#define WIFI_CONTROL_IDLE_OFF_S 300
+
+/* Create the control task and arm the button (active low, GPIO_NUM_NC for
+ * none). ssid/password must stay valid; they're passed to
+ * wifi_log_server_start() on every start. */
+void wifi_control_init(const char* ssid, const char* password, gpio_num_t button_pin);
+
+/* Ask for WiFi on or off. Any task, never blocks; not from an ISR. */
+void wifi_control_request(bool on);
+
+/* Stop WiFi on the control task and keep it off until reboot, waiting up to
+ * timeout_ms for the stop to finish (a start in progress completes first).
+ * For deep sleep; blocks, so not from the NimBLE host or httpd. Returns
+ * false on timeout. */
+bool wifi_control_shutdown(uint32_t timeout_ms);
@@ -1,5 +1,6 @@
 #include "wifi_log_server.h"
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include "esp_event.h"
@@ -8,14 +9,20 @@
 #include "esp_netif.h"
 #include "esp_wifi.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
+#include "freertos/ringbuf.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "perf_stats.h"
+#include "task_plan.h"
 
 #define TAG "WIFI_LOG"
-#define LOG_BUF_SIZE 256   /* max chars per log line (truncated if longer) */
-#define LOG_QUEUE_DEPTH 32 /* lines queued before drops */
+#define LOG_BUF_SIZE 256      /* max chars per log line (truncated if longer) */
+#define LOG_RING_SIZE 4096    /* bytes of log text buffered between flushes */
+#define LOG_FLUSH_MS 50       /* sender wakes this often and sends everything queued */
+#define LOG_FRAGMENT_MAX 1024 /* largest single WS fragment */
 #define MAX_WS_CLIENTS 4
+#define MAX_STATUS 4      /* distinct status keys restored on connect */
+#define MAX_EXTRA_URIS 8  /* handlers added via wifi_log_server_register_uri */
 
 /* ---- embedded HTML viewer ---- */
 static const char HTML_PAGE[] =
@@ -30,6 +37,8 @@ static const char HTML_PAGE[] =
     "#log{white-space:pre-wrap;word-break:break-all}"
     "button{margin-right:6px;padding:4px 12px;cursor:pointer}"
     "button.on{color:#ff0;border-color:#ff0}"
+    "#plot{display:none;margin-bottom:6px}"
+    "#cv{width:100%;height:160px;background:#000}"
     "#settings{display:none;position:fixed;top:40px;left:0;right:0;background:#1a1a1a;"
     "padding:10px 8px;border-bottom:1px solid #444;z-index:2}"
     "#settings label{margin-right:14px;white-space:nowrap}"
@@ -39,12 +48,13 @@ static const char HTML_PAGE[] =
     "<div id='toolbar'>"
     "<button "
     "onclick=\"document.getElementById('log').textContent=''\">Clear</button>"
-    "<button onclick=\"ws.send('recalibrate')\">Recalibrate</button>"
-    "<button id='vbtn' onclick=\"var v=this.classList.toggle('on');"
-    "ws.send(v?'verbose:on':'verbose:off');"
-    "this.textContent='Verbose: '+(v?'ON':'OFF')\">"
-    "Verbose: OFF</button>"
+    "<button id='vbtn' onclick=\"toggle('verbose')\">Verbose: OFF</button>"
     "<button onclick=\"toggleSettings()\">Settings</button>"
+    "<button id='pbtn' onclick=\"toggle('telemetry')\">Plot: OFF</button>"
+    "<button id='rbtn' onclick=\"toggle('record')\">Record: OFF</button>"
+    "<button onclick=\"ws.send('wifi:off')\">WiFi off</button>"
+    "<a href='/record' style='color:#0f0'>Download</a> "
+    "<a href='/strokes.bin' style='color:#0f0'>Strokes</a>"
     "</div>"
     "<div id='settings'>"
     "<label>Mass (kg):<input id='sm' type='number' step='1' min='10' max='500' "
@@ -58,21 +68,77 @@ static const char HTML_PAGE[] =
     "value='0.30'></label> "
     "<label>Recov (g):<input id='sr' type='number' step='0.01' min='0.01' max='1.00' "
     "value='0.10'></label> "
+    "<label title='Follow stroke intensity and water chop, starting from the values above'>"
+    "Adaptive:<input id='sd' type='checkbox'></label> "
     "<label>Smooth (strokes):<input id='ss' type='number' step='1' min='1' max='8' "
     "value='3'></label> "
     "<label>Zero timeout (s):<input id='st' type='number' step='1' min='0' max='30' "
     "value='5' title='0=never zero'></label> "
+    "<label>Keepalive (s):<input id='sk' type='number' step='1' min='1' max='30' "
+    "value='2' title='Longest gap between BLE updates without strokes'></label> "
+    "<label title='Double-blade paddles: one crank revolution per left + right pair'>"
+    "Cadence per:<select id='sp'><option value='1'>stroke</option>"
+    "<option value='2'>L+R pair</option></select></label> "
+    "<label title='This unit combines the other power meters in the boat into one sensor'>"
+    "Crew:<input id='sw' type='checkbox'></label> "
+    "<label>Sleep after (min):<input id='sl' type='number' step='1' min='0' max='120' "
+    "value='10' title='0=never sleep'></label> "
+    "<label>Sample rate (Hz):<input id='so' type='number' step='25' min='100' max='250' "
+    "value='100' title='FIFO ODR, 100-250 Hz'></label> "
     "<button onclick=\"applySettings()\">Apply</button>"
     "</div>"
+    "<div id='plot'><canvas id='cv' width='600' height='160'></canvas> "
+    "<canvas id='cc' width='200' height='160'></canvas>"
+    "<div id='pst'>a_fwd (green, &plusmn;20 m/s&sup2;) &middot; &Delta;v (yellow, &plusmn;5 m/s)"
+    " &middot; last stroke's power curve (right)</div></div>"
     "<div id='log'></div>"
     "<script>"
     "var log=document.getElementById('log');"
     "var ws=new WebSocket('ws://'+location.host+'/ws');"
+    "ws.binaryType='arraybuffer';"
+    "var btns={verbose:['vbtn','Verbose'],telemetry:['pbtn','Plot'],record:['rbtn','Record']};"
+    "function setBtn(k,on){var e=btns[k];if(!e)return;"
+    "var b=document.getElementById(e[0]);"
+    "b.classList.toggle('on',on);b.textContent=e[1]+': '+(on?'ON':'OFF');"
+    "if(k==='telemetry')document.getElementById('plot').style.display=on?'block':'none';}"
+    "function toggle(k){var on=!document.getElementById(btns[k][0]).classList.contains('on');"
+    "ws.send(k==='record'?(on?'record:start':'record:stop'):k+(on?':on':':off'));"
+    "setBtn(k,on);}"
+    /* Telemetry: 16-byte little-endian records, see telemetry.h */
+    "var N=500,af=[],dv=[],ph=[],mk=[],cu=[],cms=0;"
+    "function onBin(buf){var d=new DataView(buf);"
+    "for(var o=0;o+16<=buf.byteLength;o+=16){var t=d.getUint8(o);"
+    "if(t===1){af.push(d.getFloat32(o+8,true));dv.push(d.getFloat32(o+12,true));"
+    "ph.push(d.getUint8(o+1));mk.push(0);}"
+    "else if(t===2&&mk.length){mk[mk.length-1]=1;"
+    "document.getElementById('pst').textContent='Stroke '+d.getUint16(o+2,true)+': '+"
+    "d.getFloat32(o+8,true).toFixed(0)+' W  '+d.getFloat32(o+12,true).toFixed(1)+' spm';}"
+    "else if(t===3){var fb=d.getUint8(o+1),nb=d.getUint8(o+2);if(!fb)cu=[];cms=d.getUint8(o+3);"
+    "for(var j=0;j<6&&fb+j<nb;j++)cu.push(d.getInt16(o+4+2*j,true));"
+    "if(cu.length===nb)drawCurve();}}"
+    "var x=af.length-N;if(x>0){af.splice(0,x);dv.splice(0,x);ph.splice(0,x);mk.splice(0,x);}"
+    "draw();}"
+    "function draw(){var c=document.getElementById('cv'),g=c.getContext('2d'),"
+    "w=c.width,h=c.height,s=w/N;g.clearRect(0,0,w,h);"
+    "for(var i=0;i<ph.length;i++){"
+    "if(ph[i]){g.fillStyle=['','#123','#231','#321'][ph[i]];g.fillRect(i*s,0,s+1,h);}"
+    "if(mk[i]){g.fillStyle='#f00';g.fillRect(i*s,0,2,h);}}"
+    "g.strokeStyle='#333';g.beginPath();g.moveTo(0,h/2);g.lineTo(w,h/2);g.stroke();"
+    "function line(a,k,col){g.strokeStyle=col;g.beginPath();"
+    "for(var i=0;i<a.length;i++){var y=h/2-a[i]*k;if(i)g.lineTo(i*s,y);else g.moveTo(0,y);}"
+    "g.stroke();}"
+    "line(af,h/40,'#0f0');line(dv,h/10,'#ff0');}"
+    /* Bars scaled to the stroke's peak; negative power (catch) below the axis */
+    "function drawCurve(){var c=document.getElementById('cc'),g=c.getContext('2d'),"
+    "w=c.width,h=c.height,m=1;g.clearRect(0,0,w,h);"
+    "for(var i=0;i<cu.length;i++)m=Math.max(m,Math.abs(cu[i]));"
+    "var b=w/cu.length,z=h-20;g.fillStyle='#0af';"
+    "for(var i=0;i<cu.length;i++){var y=cu[i]*(z-10)/m;g.fillRect(i*b,z-Math.max(y,0),b-1,Math.abs(y));}"
+    "g.fillStyle='#aaa';g.fillText(m+' W peak, '+cu.length+' x '+cms+' ms',2,h-4);}"
     "ws.onmessage=function(e){"
+    "if(typeof e.data!=='string'){onBin(e.data);return;}"
     "if(e.data[0]==='!'){"
-    "var on=e.data==='!verbose:on';"
-    "var b=document.getElementById('vbtn');"
-    "b.classList.toggle('on',on);b.textContent='Verbose: '+(on?'ON':'OFF');"
+    "var kv=e.data.substring(1).split(':');setBtn(kv[0],kv[1]==='on');"
     "return;}"
     "log.textContent+=e.data;window.scrollTo(0,document.body.scrollHeight)};"
     "ws.onclose=function(){log.textContent+='\\n[disconnected]\\n'};"
@@ -84,30 +150,69 @@ static const char HTML_PAGE[] =
     "ws.send('set:axis:'+document.getElementById('sa').value);"
     "ws.send('set:catch:'+parseFloat(document.getElementById('sc').value).toFixed(3));"
     "ws.send('set:recovery:'+parseFloat(document.getElementById('sr').value).toFixed(3));"
+    "ws.send('set:adaptive:'+(document.getElementById('sd').checked?1:0));"
     "ws.send('set:smooth:'+parseInt(document.getElementById('ss').value));"
-    "ws.send('set:timeout:'+parseInt(document.getElementById('st').value));}"
+    "ws.send('set:timeout:'+parseInt(document.getElementById('st').value));"
+    "ws.send('set:keepalive:'+parseInt(document.getElementById('sk').value));"
+    "ws.send('set:crank:'+document.getElementById('sp').value);"
+    "ws.send('set:crew:'+(document.getElementById('sw').checked?1:0));"
+    "ws.send('set:sleep:'+parseInt(document.getElementById('sl').value));"
+    "ws.send('set:odr:'+parseInt(document.getElementById('so').value));}"
     "</script></body></html>";
 
 /* ---- state ---- */
-typedef struct {
-  char data[LOG_BUF_SIZE];
-  int len;
-} log_entry_t;
-
-static QueueHandle_t s_log_queue;
+static RingbufHandle_t s_log_ring; /* Byte ring: lines stored back to back, no per-line header */
+static _Atomic uint32_t s_log_dropped; /* Lines that did not fit; reported on the next flush */
 static httpd_handle_t s_hd;
 static int s_ws_fds[MAX_WS_CLIENTS];
 static SemaphoreHandle_t s_fd_mutex;
+/* Live entries in s_ws_fds. Changed under s_fd_mutex, read without it: the
+ * sender holds the mutex through every blocking send of a flush. */
+static _Atomic int s_client_count;
 static vprintf_like_t s_orig_vprintf;
 static ws_command_cb_t s_command_cb;
-static char s_connect_status[64];
+static char s_connect_status[MAX_STATUS][64];
+static const httpd_uri_t* s_extra_uris[MAX_EXTRA_URIS];
+static int s_extra_uri_count;
 
 void wifi_log_server_set_command_cb(ws_command_cb_t cb) {
   s_command_cb = cb;
 }
 
 void wifi_log_server_set_status(const char* msg) {
-  strlcpy(s_connect_status, msg ? msg : "", sizeof(s_connect_status));
+  if (!msg || !msg[0]) {
+    memset(s_connect_status, 0, sizeof(s_connect_status));
+    return;
+  }
+  const char* colon = strchr(msg, ':');
+  size_t key_len = colon ? (size_t)(colon - msg) : strlen(msg);
+
+  /* Replace the slot with the same key, else take the first free one */
+  int slot = -1;
+  for (int i = 0; i < MAX_STATUS; i++) {
+    if (strncmp(s_connect_status[i], msg, key_len) == 0 &&
+        (s_connect_status[i][key_len] == ':' || s_connect_status[i][key_len] == '\0')) {
+      slot = i;
+      break;
+    }
+    if (slot < 0 && !s_connect_status[i][0])
+      slot = i;
+  }
+  if (slot < 0) {
+    ESP_LOGW(TAG, "No status slot for %s", msg);
+    return;
+  }
+  strlcpy(s_connect_status[slot], msg, sizeof(s_connect_status[slot]));
+}
+
+void wifi_log_server_register_uri(const httpd_uri_t* uri) {
+  if (s_extra_uri_count >= MAX_EXTRA_URIS) {
+    ESP_LOGE(TAG, "Too many URI handlers, %s not registered", uri->uri);
+    return;
+  }
+  s_extra_uris[s_extra_uri_count++] = uri;
+  if (s_hd)
+    httpd_register_uri_handler(s_hd, uri);
 }
 
 /* ---- fd list helpers ---- */
@@ -117,6 +222,7 @@ static void fd_add(int fd) {
   for (int i = 0; i < MAX_WS_CLIENTS; i++) {
     if (s_ws_fds[i] < 0) {
       s_ws_fds[i] = fd;
+      atomic_fetch_add_explicit(&s_client_count, 1, memory_order_relaxed);
       break;
     }
   }
@@ -128,6 +234,7 @@ static void fd_remove(int fd) {
   for (int i = 0; i < MAX_WS_CLIENTS; i++) {
     if (s_ws_fds[i] == fd) {
       s_ws_fds[i] = -1;
+      atomic_fetch_sub_explicit(&s_client_count, 1, memory_order_relaxed);
       break;
     }
   }
@@ -137,56 +244,133 @@ static void fd_remove(int fd) {
 /* ---- vprintf hook ---- */
 /* Called from any task context; must be fast and non-blocking. */
 
+static int orig_printf(const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int ret = s_orig_vprintf(fmt, args);
+  va_end(args);
+  return ret;
+}
+
 static int log_vprintf_hook(const char* fmt, va_list args) {
-  /* Preserve original UART output */
+  /* Format once, on the caller's stack, for both UART and WebSocket */
+  char line[LOG_BUF_SIZE];
   va_list args2;
   va_copy(args2, args);
-  int ret = s_orig_vprintf(fmt, args);
-
-  /* Queue for WebSocket. Drop if full rather than block. */
-  log_entry_t entry;
-  entry.len = vsnprintf(entry.data, sizeof(entry.data) - 1, fmt, args2);
+  int len = vsnprintf(line, sizeof(line), fmt, args);
+
+  int ret;
+  if (len >= 0 && len < (int)sizeof(line)) {
+    ret = orig_printf("%s", line);
+  } else {
+    /* Too long for the buffer: UART still gets the full line */
+    ret = s_orig_vprintf(fmt, args2);
+    if (len < 0)
+      len = 0;
+    if (len >= (int)sizeof(line)) {
+      len = sizeof(line) - 1;
+      line[len - 1] = '\n';
+    }
+  }
   va_end(args2);
-  if (entry.len < 0)
-    entry.len = 0;
-  if (entry.len >= (int)sizeof(entry.data))
-    entry.len = sizeof(entry.data) - 1;
-  entry.data[entry.len] = '\0';
-  xQueueSend(s_log_queue, &entry, 0);
 
+  /* All or nothing: a line that doesn't fit is dropped whole, never split */
+  if (len > 0 && xRingbufferSend(s_log_ring, line, (size_t)len, 0) != pdTRUE) {
+    atomic_fetch_add_explicit(&s_log_dropped, 1, memory_order_relaxed);
+    perf_count(&g_perf_stats.log_drops);
+  }
   return ret;
 }
 
 /* ---- sender task ---- */
-/* Drains the log queue and broadcasts each line to all connected WS clients. */
 
+/* Send one frame to every client. Caller holds s_fd_mutex. */
+static void send_to_clients(httpd_ws_frame_t* frame) {
+  for (int i = 0; i < MAX_WS_CLIENTS; i++) {
+    int fd = s_ws_fds[i];
+    if (fd < 0)
+      continue;
+    esp_err_t err = httpd_ws_send_frame_async(s_hd, fd, frame);
+    if (err != ESP_OK) {
+      s_ws_fds[i] = -1; /* dead client, skip logging to avoid re-entrancy */
+      atomic_fetch_sub_explicit(&s_client_count, 1, memory_order_relaxed);
+    }
+  }
+}
+
+static void broadcast_frame(httpd_ws_frame_t* frame) {
+  xSemaphoreTake(s_fd_mutex, portMAX_DELAY);
+  send_to_clients(frame);
+  xSemaphoreGive(s_fd_mutex);
+}
+
+/* Every LOG_FLUSH_MS, send everything queued as one fragmented TEXT message.
+ *
+ * Chunks come straight out of the ring (xRingbufferReceiveUpTo hands back a
+ * pointer into its storage), so the text is never copied again. A chunk may
+ * end mid-line or mid-UTF-8 sequence at the ring's wrap point; that is fine
+ * inside a fragmented message, which is only validated as a whole. The
+ * message ends when the ring is empty, which is always on a line boundary
+ * because the hook writes whole lines. s_fd_mutex is held for the whole
+ * message: one take per flush, and no other data frame can interleave. */
 static void log_sender_task(void* arg) {
-  log_entry_t entry;
   while (1) {
-    if (xQueueReceive(s_log_queue, &entry, portMAX_DELAY) != pdTRUE)
+    vTaskDelay(pdMS_TO_TICKS(LOG_FLUSH_MS));
+
+    size_t len;
+    char* chunk = xRingbufferReceiveUpTo(s_log_ring, &len, 0, LOG_FRAGMENT_MAX);
+    if (!chunk)
       continue;
 
+    xSemaphoreTake(s_fd_mutex, portMAX_DELAY);
     httpd_ws_frame_t frame = {
         .type = HTTPD_WS_TYPE_TEXT,
-        .payload = (uint8_t*)entry.data,
-        .len = (size_t)entry.len,
-        .final = true,
+        .fragmented = true,
+        .final = false,
     };
+    while (chunk) {
+      frame.payload = (uint8_t*)chunk;
+      frame.len = len;
+      send_to_clients(&frame);
+      vRingbufferReturnItem(s_log_ring, chunk);
+      frame.type = HTTPD_WS_TYPE_CONTINUE;
+      chunk = xRingbufferReceiveUpTo(s_log_ring, &len, 0, LOG_FRAGMENT_MAX);
+    }
 
-    xSemaphoreTake(s_fd_mutex, portMAX_DELAY);
-    for (int i = 0; i < MAX_WS_CLIENTS; i++) {
-      int fd = s_ws_fds[i];
-      if (fd < 0)
-        continue;
-      esp_err_t err = httpd_ws_send_frame_async(s_hd, fd, &frame);
-      if (err != ESP_OK) {
-        s_ws_fds[i] = -1; /* dead client, skip logging to avoid re-entrancy */
-      }
+    /* Closing fragment; carries the drop notice if lines were lost */
+    char note[48] = "";
+    uint32_t dropped = atomic_exchange_explicit(&s_log_dropped, 0, memory_order_relaxed);
+    if (dropped) {
+      snprintf(note, sizeof(note), "[%u log lines dropped]\n", (unsigned)dropped);
     }
+    frame.payload = (uint8_t*)note;
+    frame.len = strlen(note);
+    frame.final = true;
+    send_to_clients(&frame);
     xSemaphoreGive(s_fd_mutex);
   }
 }
 
+void wifi_log_server_send_binary(const void* data, size_t len) {
+  if (!s_hd || len == 0)
+    return;
+  httpd_ws_frame_t frame = {
+      .type = HTTPD_WS_TYPE_BINARY,
+      .payload = (uint8_t*)data,
+      .len = len,
+      .final = true,
+  };
+  broadcast_frame(&frame);
+}
+
+bool wifi_log_server_running(void) {
+  return s_hd != NULL;
+}
+
+int wifi_log_server_client_count(void) {
+  return atomic_load_explicit(&s_client_count, memory_order_relaxed);
+}
+
 /* ---- HTTP handlers ---- */
 
 static esp_err_t root_handler(httpd_req_t* req) {
@@ -196,21 +380,25 @@ static esp_err_t root_handler(httpd_req_t* req) {
 
 static esp_err_t ws_handler(httpd_req_t* req) {
   if (req->method == HTTP_GET) {
-    /* New WebSocket client. httpd handles the upgrade; record the fd. */
+    /* New WebSocket client. httpd handles the upgrade; record the fd once
+     * the status frames are out, so they can't land inside a fragmented log
+     * message. */
     int fd = httpd_req_to_sockfd(req);
-    fd_add(fd);
-    ESP_LOGI(TAG, "WS client connected fd=%d", fd);
     /* Send current status so the browser can restore button state after refresh
      */
-    if (s_connect_status[0]) {
+    for (int i = 0; i < MAX_STATUS; i++) {
+      if (!s_connect_status[i][0])
+        continue;
       httpd_ws_frame_t sf = {
           .type = HTTPD_WS_TYPE_TEXT,
-          .payload = (uint8_t*)s_connect_status,
-          .len = strlen(s_connect_status),
+          .payload = (uint8_t*)s_connect_status[i],
+          .len = strlen(s_connect_status[i]),
           .final = true,
       };
       httpd_ws_send_frame(req, &sf);
     }
+    fd_add(fd);
+    ESP_LOGI(TAG, "WS client connected fd=%d", fd);
     return ESP_OK;
   }
 
@@ -241,23 +429,25 @@ static esp_err_t ws_handler(httpd_req_t* req) {
 /* ---- public API ---- */
 
 void wifi_log_server_start(const char* ssid, const char* password) {
-  /* Init fd list */
-  s_fd_mutex = xSemaphoreCreateMutex();
-  for (int i = 0; i < MAX_WS_CLIENTS; i++) s_ws_fds[i] = -1;
+  if (s_hd)
+    return;
 
-  /* Log queue */
-  s_log_queue = xQueueCreate(LOG_QUEUE_DEPTH, sizeof(log_entry_t));
+  /* Once per boot: fd list, log ring, WiFi driver. Kept across stop/start. */
+  if (!s_fd_mutex) {
+    s_fd_mutex = xSemaphoreCreateMutex();
+    for (int i = 0; i < MAX_WS_CLIENTS; i++) s_ws_fds[i] = -1;
+    s_log_ring = xRingbufferCreate(LOG_RING_SIZE, RINGBUF_TYPE_BYTEBUF);
 
-  /* WiFi SoftAP */
-  ESP_ERROR_CHECK(esp_netif_init());
-  esp_err_t loop_err = esp_event_loop_create_default();
-  if (loop_err != ESP_ERR_INVALID_STATE)
-    ESP_ERROR_CHECK(loop_err);
+    ESP_ERROR_CHECK(esp_netif_init());
+    esp_err_t loop_err = esp_event_loop_create_default();
+    if (loop_err != ESP_ERR_INVALID_STATE)
+      ESP_ERROR_CHECK(loop_err);
 
-  esp_netif_create_default_wifi_ap();
+    esp_netif_create_default_wifi_ap();
 
-  wifi_init_config_t wifi_cfg = WIFI_INIT_CONFIG_DEFAULT();
-  ESP_ERROR_CHECK(esp_wifi_init(&wifi_cfg));
+    wifi_init_config_t wifi_cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&wifi_cfg));
+  }
 
   wifi_config_t ap_cfg = {
       .ap =
@@ -280,6 +470,9 @@ void wifi_log_server_start(const char* ssid, const char* password) {
   /* HTTP + WebSocket server */
   httpd_config_t http_cfg = HTTPD_DEFAULT_CONFIG();
   http_cfg.lru_purge_enable = true;
+  http_cfg.max_uri_handlers = 2 + MAX_EXTRA_URIS;
+  http_cfg.core_id = TASK_CORE_RADIO;
+  http_cfg.task_priority = TASK_PRIO_HTTPD;
 
   if (httpd_start(&s_hd, &http_cfg) != ESP_OK) {
     ESP_LOGE(TAG, "Failed to start HTTP server");
@@ -299,10 +492,36 @@ void wifi_log_server_start(const char* ssid, const char* password) {
   };
   httpd_register_uri_handler(s_hd, &root);
   httpd_register_uri_handler(s_hd, &ws);
-
-  /* Sender task, lower priority than IMU and BLE tasks */
-  xTaskCreate(log_sender_task, "ws_log_send", 4096, NULL, 3, NULL);
+  for (int i = 0; i < s_extra_uri_count; i++) httpd_register_uri_handler(s_hd, s_extra_uris[i]);
+
+  /* Sender task, lowest application priority. Idles while stopped. */
+  static TaskHandle_t sender;
+  if (!sender) {
+    xTaskCreatePinnedToCore(log_sender_task, "ws_log_send", 4096, NULL, TASK_PRIO_LOG_SENDER,
+                            &sender, TASK_CORE_RADIO);
+    perf_stats_register_task(sender);
+  }
 
   /* Install vprintf hook last, after everything above is ready to receive */
   s_orig_vprintf = esp_log_set_vprintf(log_vprintf_hook);
 }
+
+void wifi_log_server_stop(void) {
+  if (!s_hd)
+    return;
+
+  /* Back to UART-only logging first, so nothing new lands in the ring */
+  if (s_orig_vprintf)
+    esp_log_set_vprintf(s_orig_vprintf);
+
+  xSemaphoreTake(s_fd_mutex, portMAX_DELAY);
+  httpd_handle_t hd = s_hd;
+  s_hd = NULL;
+  for (int i = 0; i < MAX_WS_CLIENTS; i++) s_ws_fds[i] = -1;
+  atomic_store_explicit(&s_client_count, 0, memory_order_relaxed);
+  xSemaphoreGive(s_fd_mutex);
+
+  httpd_stop(hd);
+  esp_wifi_stop();
+  ESP_LOGI(TAG, "SoftAP stopped");
+}
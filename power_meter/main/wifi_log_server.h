@@ -1,7 +1,12 @@
 #pragma once
 
+#include <stdbool.h>
+#include "esp_http_server.h"
+
 /* Start a WiFi SoftAP and WebSocket log server.
- * Must be called after nvs_flash_init().
+ * Must be called after nvs_flash_init(). Blocks for the WiFi bring-up
+ * (~100 ms); a no-op if already running. May be called again after
+ * wifi_log_server_stop().
  *
  * Once started:
  *   - Phone connects to the AP (SSID, open if password is "")
@@ -11,6 +16,14 @@
  */
 void wifi_log_server_start(const char* ssid, const char* password);
 
+/* Stop the HTTP server and the SoftAP, and return logging to UART only.
+ * Never call from the HTTP server task (httpd_stop waits for it). */
+void wifi_log_server_stop(void);
+bool wifi_log_server_running(void);
+
+/* Number of WebSocket clients currently connected. Any task, never blocks. */
+int wifi_log_server_client_count(void);
+
 /* Register a callback invoked when the browser sends a command over WebSocket.
  * Called from the HTTP server task. Keep it short, no blocking. */
 typedef void (*ws_command_cb_t)(const char* cmd);
@@ -18,5 +31,17 @@ void wifi_log_server_set_command_cb(ws_command_cb_t cb);
 
 /* Set a short status string sent to every new client on connect so the browser
  * can restore UI state after a page refresh. Prefix with '!' to distinguish
- * from log lines (e.g. "!verbose:on"). Pass "" to clear. */
+ * from log lines (e.g. "!verbose:on"). The text before the first ':' is the
+ * key: a new status replaces the previous one with the same key. Pass "" to
+ * clear all. */
 void wifi_log_server_set_status(const char* msg);
+
+/* Send one binary WebSocket frame to every connected client. Blocks briefly
+ * on the client list; call from a low-priority task, never from the HTTP
+ * server task or an ISR. A no-op if no client is connected. */
+void wifi_log_server_send_binary(const void* data, size_t len);
+
+/* Serve an extra URI from the log server (e.g. a file download). uri must stay
+ * valid for the life of the server. Handlers registered before
+ * wifi_log_server_start() are added when the server comes up. */
+void wifi_log_server_register_uri(const httpd_uri_t* uri);